@@ -0,0 +1,131 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include "graphee.hpp"
+
+using namespace graphee;
+
+/**
+ * Times the SpMV of every block of the graph in its CSR layout, with each
+ * `SpmvKernel` level supported by the CPU and 64-bit or 32-bit column
+ * ids, and in the Hilbert ordered layout
+ */
+template <typename MatrixT>
+double time_spmv(Properties *props, MatrixT &block, Vector<double> &vec, int nruns)
+{
+  Vector<double> res(props, block.get_lines(), 0.);
+  std::chrono::duration<double> elapsed(0.);
+  for (int run = 0; run < nruns; run++)
+  {
+    std::fill(res.begin(), res.end(), 0.);
+    auto start = std::chrono::steady_clock::now();
+    block.multiply_add(vec, res);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+  return elapsed.count() / nruns;
+}
+
+int main (int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " filelist [nruns]" << std::endl;
+    return 1;
+  }
+  int nruns = argc > 2 ? std::stoi(argv[2]) : 5;
+
+  /**
+   * Same graph as the Pagerank example
+   */
+  graphee::Properties
+  props (std::string("cc18q1"), // name of your graph
+         98, // number of links in million
+         4, // number of slices
+         8, // number of threads
+         10*graphee::Properties::GB, // max RAM value
+         256*graphee::Properties::MB); // max size of sorting vector
+
+  std::ifstream filelist(argv[1]);
+  std::vector<std::string> filenames;
+  std::string filename;
+  while (filelist.good())
+  {
+    filelist >> filename;
+    if(filename.size()>0 && filename.at(0)!='#')
+    {
+      filenames.push_back(filename);
+    }
+  }
+  filelist.close();
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>
+  adjacency_matrix (&props, "adj");
+  adjacency_matrix.load_edgelist(filenames);
+
+  Vector<double> vec(&props, props.window, 1.);
+  for (uint64_t i = 0; i < props.window; i++)
+  {
+    vec[i] = 1. / (i % 1024 + 1);
+  }
+
+  const int nlevels = SpmvKernel::supported_level() + 1;
+  std::vector<double> total_csr(nlevels, 0.), total_csr32(nlevels, 0.);
+  double total_hilbert = 0.;
+  uint64_t total_edges = 0;
+
+  for (uint64_t line = 0; line < props.nslices; line++)
+  {
+    for (uint64_t col = 0; col < props.nslices; col++)
+    {
+      SparseBMatrixCSR block(std::move(*adjacency_matrix.get_block(line, col)));
+      std::ostringstream oss;
+      oss << "Block [" << line << ";" << col << "] " << block.get_nonzeros() << " edges, CSR";
+
+      for (int level = 0; level < nlevels; level++)
+      {
+        SpmvKernel::set_level(level);
+        double csr = time_spmv(&props, block, vec, nruns);
+        total_csr[level] += csr;
+        oss << " " << SpmvKernel::level_name(level) << " " << csr << " s";
+      }
+
+      block.compact_indices();
+      for (int level = 0; level < nlevels; level++)
+      {
+        SpmvKernel::set_level(level);
+        double csr32 = time_spmv(&props, block, vec, nruns);
+        total_csr32[level] += csr32;
+        oss << " " << SpmvKernel::level_name(level) << "/32 " << csr32 << " s";
+      }
+
+      block.convert(BlockLayout::HILBERT);
+      double hilbert = time_spmv(&props, block, vec, nruns);
+
+      total_hilbert += hilbert;
+      total_edges += block.get_nonzeros();
+
+      oss << ", HILBERT " << hilbert << " s";
+      print_strong_log(oss.str());
+    }
+  }
+
+  for (int level = 0; level < nlevels; level++)
+  {
+    std::ostringstream oss;
+    oss << "SpMV of all the blocks, CSR " << SpmvKernel::level_name(level) << ": "
+        << total_edges / total_csr[level] << " edges/s with 64-bit ids, "
+        << total_edges / total_csr32[level] << " edges/s with 32-bit ids";
+    print_strong_log(oss.str());
+  }
+
+  std::ostringstream oss;
+  oss << "SpMV of all the blocks, HILBERT: " << total_edges / total_hilbert << " edges/s";
+  print_strong_log(oss.str());
+
+  return 0;
+}
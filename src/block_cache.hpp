@@ -0,0 +1,218 @@
+#ifndef GRAPHEE_BLOCK_CACHE_HPP__
+#define GRAPHEE_BLOCK_CACHE_HPP__
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <algorithm>
+
+namespace graphee
+{
+
+/*! \brief Blocks of a `DiskSparseMatrix` kept in RAM between iterations,
+ *         decoded or as their compressed image
+ *
+ * A decoded block is handed as is to the next products. A compressed
+ * image, the bytes of the block file, is decoded again on demand but
+ * costs no disk read. Both tiers share `limit` bytes; the decoded one
+ * leaves room for the images of all the blocks, `image_bytes`, so that
+ * a graph whose compressed blocks fit is read from disk once.
+ *
+ * Eviction follows the access order of the iterations, a cycle over the
+ * `period` blocks of the matrix: a block is used again one period after
+ * its last use. The blocks held are thus never evicted for the block
+ * just read, which is needed the latest of all (plain LRU would evict
+ * the block needed the soonest), only the blocks which missed their
+ * next use, e.g. those of another orientation, make room.
+ */
+
+template <typename MatrixT>
+class BlockCache
+{
+public:
+  BlockCache() : limit(0), decoded_limit(0), period(1), tick(0), decoded_bytes(0), image_bytes(0)
+  {
+    reset_stats();
+  }
+
+  void reset(uint64_t limit, uint64_t image_bytes, uint64_t period);
+  void clear();
+
+  bool enabled() const
+  {
+    return limit > 0;
+  }
+
+  std::shared_ptr<MatrixT> find(uint64_t key, std::shared_ptr<const std::vector<char>> &image);
+
+  void insert(uint64_t key, std::shared_ptr<MatrixT> mat, uint64_t bytes);
+  void insert(uint64_t key, std::shared_ptr<const std::vector<char>> image);
+
+  void reset_stats();
+  void count_read(uint64_t bytes);
+  uint64_t get_read_bytes() const
+  {
+    return read_bytes;
+  }
+  std::string report() const;
+
+private:
+  struct Entry
+  {
+    std::shared_ptr<MatrixT> mat;
+    std::shared_ptr<const std::vector<char>> image;
+    uint64_t bytes;
+    uint64_t last_use;
+  };
+
+  uint64_t limit;
+  uint64_t decoded_limit;
+  uint64_t period;
+  uint64_t tick;
+
+  std::mutex mtx;
+  std::map<uint64_t, Entry> entries;
+  uint64_t decoded_bytes;
+  uint64_t image_bytes;
+
+  std::atomic<uint64_t> decoded_hits;
+  std::atomic<uint64_t> image_hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> read_bytes;
+
+  bool make_room(uint64_t bytes, bool decoded);
+}; // class graphee::BlockCache
+
+/*! `image_bytes` is the size of the images of all the blocks, `period`
+ * the number of blocks read by an iteration
+ */
+template <typename MatrixT>
+void BlockCache<MatrixT>::reset(uint64_t limit, uint64_t image_bytes, uint64_t period)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  entries.clear();
+  decoded_bytes = 0;
+  this->image_bytes = 0;
+
+  this->limit = limit;
+  this->decoded_limit = limit >= image_bytes ? limit - image_bytes : limit / 2;
+  this->period = std::max<uint64_t>(period, 1);
+}
+
+template <typename MatrixT>
+void BlockCache<MatrixT>::clear()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  entries.clear();
+  decoded_bytes = 0;
+  image_bytes = 0;
+}
+
+/*! The decoded block, or else its image, `nullptr` for both on a miss */
+template <typename MatrixT>
+std::shared_ptr<MatrixT> BlockCache<MatrixT>::find(uint64_t key, std::shared_ptr<const std::vector<char>> &image)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  tick++;
+
+  auto found = entries.find(key);
+  if (found == entries.end())
+  {
+    misses++;
+    image = nullptr;
+    return nullptr;
+  }
+
+  found->second.last_use = tick;
+  image = found->second.image;
+  if (found->second.mat != nullptr)
+    decoded_hits++;
+  else
+    image_hits++;
+  return found->second.mat;
+}
+
+template <typename MatrixT>
+void BlockCache<MatrixT>::insert(uint64_t key, std::shared_ptr<MatrixT> mat, uint64_t bytes)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  if (entries.count(key) > 0 || !make_room(bytes, true))
+    return;
+
+  entries[key] = Entry{mat, nullptr, bytes, tick};
+  decoded_bytes += bytes;
+}
+
+template <typename MatrixT>
+void BlockCache<MatrixT>::insert(uint64_t key, std::shared_ptr<const std::vector<char>> image)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  if (entries.count(key) > 0 || !make_room(image->size(), false))
+    return;
+
+  entries[key] = Entry{nullptr, image, image->size(), tick};
+  image_bytes += image->size();
+}
+
+/*! Evicts the blocks which missed their next use, the oldest first, until
+ * `bytes` fit in the cache, and in the decoded tier for a `decoded`
+ * block. False if they do not.
+ */
+template <typename MatrixT>
+bool BlockCache<MatrixT>::make_room(uint64_t bytes, bool decoded)
+{
+  auto fits = [&]()
+  {
+    return (!decoded || decoded_bytes + bytes <= decoded_limit) && decoded_bytes + image_bytes + bytes <= limit;
+  };
+
+  while (!fits())
+  {
+    auto victim = entries.end();
+    for (auto it = entries.begin(); it != entries.end(); it++)
+    {
+      if (tick - it->second.last_use > period &&
+          (victim == entries.end() || it->second.last_use < victim->second.last_use))
+        victim = it;
+    }
+    if (victim == entries.end())
+      return false;
+
+    (victim->second.mat != nullptr ? decoded_bytes : image_bytes) -= victim->second.bytes;
+    entries.erase(victim);
+  }
+  return true;
+}
+
+template <typename MatrixT>
+void BlockCache<MatrixT>::reset_stats()
+{
+  decoded_hits = 0;
+  image_hits = 0;
+  misses = 0;
+  read_bytes = 0;
+}
+
+/*! Bytes of block files read from disk or from the container */
+template <typename MatrixT>
+void BlockCache<MatrixT>::count_read(uint64_t bytes)
+{
+  read_bytes += bytes;
+}
+
+template <typename MatrixT>
+std::string BlockCache<MatrixT>::report() const
+{
+  std::ostringstream oss;
+  oss << "Block cache: " << decoded_hits << " decoded and " << image_hits << " compressed hits, " << misses
+      << " misses, " << read_bytes / (1UL << 20) << " MB read";
+  return oss.str();
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BLOCK_CACHE_HPP__
@@ -0,0 +1,362 @@
+#ifndef GRAPHEE_BLOCK_HEADER_HPP__
+#define GRAPHEE_BLOCK_HEADER_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "codec.hpp"
+#include "block_writer.hpp"
+
+namespace graphee
+{
+
+/*! \brief Chunk of a section, see `BlockHeader` */
+struct ChunkEntry
+{
+  uint64_t row_begin;
+  uint64_t row_end;
+  uint64_t elem_begin;
+  uint64_t elem_end;
+  uint64_t offset;   ///< position of the compressed chunk in the file
+  uint64_t size;     ///< compressed size
+  uint64_t checksum; ///< CRC32 of the compressed bytes
+};
+
+/*! \brief One array (`ia`, `ja`, `a`, vector values) of a block */
+struct SectionIndex
+{
+  uint64_t elem_size;
+  uint64_t nelems;
+  std::vector<ChunkEntry> chunks;
+};
+
+/*! \brief Version 2 header of the chunked `.gpe` files
+ *
+ * It follows the common header (typename, fileformat and dimensions)
+ * of the files written with a chunked codec:
+ * - `uint64_t` magic number `BlockHeader::magic`,
+ * - `uint64_t` version,
+ * - `uint64_t` offset of the footer,
+ * - the compressed chunks of every section, back to back,
+ * - the footer: `uint64_t` number of sections, then for each section
+ *   its element size, number of elements and number of chunks
+ *   (`uint64_t`) followed by one `ChunkEntry` per chunk.
+ *
+ * Every section is cut at the same rows: chunk `c` of each section
+ * holds rows [row_begin, row_end). Any row range is thus loaded by
+ * uncompressing only the chunks it overlaps, and the checksums are
+ * verified without uncompressing anything.
+ */
+
+class BlockHeader
+{
+public:
+  BlockHeader() : version(0), footer_offset(0) {}
+
+  /*! Section to write, chunk `c` holds elements [elem_cuts[c], elem_cuts[c + 1]) */
+  struct SectionSpec
+  {
+    const void *data;
+    uint64_t elem_size;
+    std::vector<uint64_t> elem_cuts;
+  };
+
+  static std::vector<uint64_t> csr_row_cuts(const uint64_t *ia, uint64_t m, size_t nz_bytes);
+  static std::vector<uint64_t> dense_row_cuts(uint64_t m, size_t elem_size);
+
+  static SectionSpec row_section(const void *data, size_t elem_size, uint64_t nelems,
+                                 const std::vector<uint64_t> &row_cuts);
+  static SectionSpec nz_section(const void *data, size_t elem_size, const uint64_t *ia,
+                                const std::vector<uint64_t> &row_cuts);
+
+  static void write(BlockWriter &writer, int fileformat, const std::vector<uint64_t> &row_cuts,
+                    const std::vector<SectionSpec> &sections);
+
+  bool read(std::istream &fp, int fileformat);
+  bool read_elements(std::istream &fp, size_t section, uint64_t begin, uint64_t end,
+                     char *out, uint64_t nthreads) const;
+  bool verify(std::istream &fp) const;
+
+  static const uint64_t magic{0x32564b4c42455047}; // "GPEBLKV2"
+  static const uint64_t current_version{2};
+
+  uint64_t version;
+  uint64_t footer_offset;
+  int fileformat;
+  std::vector<SectionIndex> sections;
+}; // class graphee::BlockHeader
+
+/*! Cuts the rows of a CSR block into chunks of about `Codec::chunk_size`
+ * bytes, counting `sizeof(uint64_t)` per row and `nz_bytes` per non-zero
+ */
+inline std::vector<uint64_t> BlockHeader::csr_row_cuts(const uint64_t *ia, uint64_t m, size_t nz_bytes)
+{
+  std::vector<uint64_t> cuts(1, 0);
+  uint64_t first = 0;
+
+  for (uint64_t i = 0; i < m; i++)
+  {
+    size_t bytes = (i + 1 - first) * sizeof(uint64_t) + (ia[i + 1] - ia[first]) * nz_bytes;
+    if (bytes >= Codec::chunk_size)
+    {
+      cuts.push_back(i + 1);
+      first = i + 1;
+    }
+  }
+
+  if (cuts.size() == 1 || cuts.back() != m)
+    cuts.push_back(m);
+
+  return cuts;
+}
+
+inline std::vector<uint64_t> BlockHeader::dense_row_cuts(uint64_t m, size_t elem_size)
+{
+  uint64_t rows_per_chunk = std::max<uint64_t>(Codec::chunk_size / elem_size, 1);
+  std::vector<uint64_t> cuts;
+
+  for (uint64_t i = 0; i < m; i += rows_per_chunk)
+    cuts.push_back(i);
+  cuts.push_back(m);
+
+  if (cuts.size() == 1)
+    cuts.push_back(m);
+
+  return cuts;
+}
+
+/*! Section with one element per row, plus the trailing ones (`ia[m]`) in the last chunk */
+inline BlockHeader::SectionSpec BlockHeader::row_section(const void *data, size_t elem_size, uint64_t nelems,
+    const std::vector<uint64_t> &row_cuts)
+{
+  SectionSpec spec;
+  spec.data = data;
+  spec.elem_size = elem_size;
+  spec.elem_cuts = row_cuts;
+  spec.elem_cuts.back() = nelems;
+  return spec;
+}
+
+/*! Section with one element per non-zero (`ja`, `a`) */
+inline BlockHeader::SectionSpec BlockHeader::nz_section(const void *data, size_t elem_size, const uint64_t *ia,
+    const std::vector<uint64_t> &row_cuts)
+{
+  SectionSpec spec;
+  spec.data = data;
+  spec.elem_size = elem_size;
+  for (uint64_t row : row_cuts)
+    spec.elem_cuts.push_back(ia[row]);
+  return spec;
+}
+
+/*! Queues the header, the chunks and the footer of all the `sections` */
+inline void BlockHeader::write(BlockWriter &writer, int fileformat, const std::vector<uint64_t> &row_cuts,
+                               const std::vector<SectionSpec> &sections)
+{
+  uint64_t head[3] = {magic, current_version, 0};
+  uint64_t offset_slot = writer.tellp() + 2 * sizeof(uint64_t);
+  writer.write(head, sizeof(head));
+
+  std::vector<BlockWriter::ChunkEntries> written;
+  for (const SectionSpec &spec : sections)
+  {
+    std::vector<uint64_t> bounds;
+    for (uint64_t cut : spec.elem_cuts)
+      bounds.push_back(cut * spec.elem_size);
+
+    written.push_back(writer.write_compressed(spec.data, bounds, fileformat));
+  }
+
+  /* Built by the writer thread, once every chunk has its position */
+  std::vector<SectionSpec> specs(sections);
+  writer.write_footer([specs, written, row_cuts]()
+  {
+    std::vector<uint64_t> footer(1, specs.size());
+
+    for (size_t s = 0; s < specs.size(); s++)
+    {
+      uint64_t nchunks = specs[s].elem_cuts.size() - 1;
+      footer.push_back(specs[s].elem_size);
+      footer.push_back(specs[s].elem_cuts.back());
+      footer.push_back(nchunks);
+
+      for (uint64_t c = 0; c < nchunks; c++)
+      {
+        const BlockWriter::WrittenChunk &chunk = (*written[s])[c];
+        uint64_t entry[7] = {row_cuts[c], row_cuts[c + 1], specs[s].elem_cuts[c], specs[s].elem_cuts[c + 1],
+                             chunk.offset, chunk.size, chunk.checksum
+                            };
+        footer.insert(footer.end(), entry, entry + 7);
+      }
+    }
+
+    const char *bytes = reinterpret_cast<const char *>(footer.data());
+    return std::vector<char>(bytes, bytes + footer.size() * sizeof(uint64_t));
+  }, offset_slot);
+}
+
+/*! Reads the header at the current position and its footer */
+inline bool BlockHeader::read(std::istream &fp, int fmt)
+{
+  uint64_t head[3];
+  fp.read(reinterpret_cast<char *>(head), sizeof(head));
+
+  if (!fp.good() || head[0] != magic)
+  {
+    print_error("Missing version 2 block header");
+    return false;
+  }
+
+  version = head[1];
+  footer_offset = head[2];
+  fileformat = fmt;
+
+  if (version != current_version)
+  {
+    std::ostringstream err;
+    err << "Unsupported block header version " << version;
+    print_error(err.str());
+    return false;
+  }
+
+  fp.seekg(footer_offset);
+
+  uint64_t nsections = 0;
+  fp.read(reinterpret_cast<char *>(&nsections), sizeof(uint64_t));
+  sections.resize(nsections);
+
+  for (SectionIndex &section : sections)
+  {
+    uint64_t desc[3];
+    fp.read(reinterpret_cast<char *>(desc), sizeof(desc));
+    section.elem_size = desc[0];
+    section.nelems = desc[1];
+    section.chunks.resize(desc[2]);
+    fp.read(reinterpret_cast<char *>(section.chunks.data()), desc[2] * sizeof(ChunkEntry));
+  }
+
+  if (!fp.good())
+  {
+    print_error("Truncated block footer");
+    return false;
+  }
+
+  return true;
+}
+
+/*! Uncompresses the elements [begin, end) of `section` into `out`,
+ * only the overlapping chunks are read, with `nthreads` threads
+ */
+inline bool BlockHeader::read_elements(std::istream &fp, size_t section, uint64_t begin, uint64_t end,
+                                       char *out, uint64_t nthreads) const
+{
+  if (section >= sections.size() || begin > end || end > sections[section].nelems)
+  {
+    print_error("Requested elements are out of the block section");
+    return false;
+  }
+
+  if (begin == end)
+    return true;
+
+  const SectionIndex &sec = sections[section];
+  const Codec &codec = Codec::get(fileformat);
+
+  uint64_t first = 0;
+  while (sec.chunks[first].elem_end <= begin)
+    first++;
+  uint64_t last = first;
+  while (last < sec.chunks.size() && sec.chunks[last].elem_begin < end)
+    last++;
+
+  /* Chunks of a section are contiguous, they are read at once */
+  uint64_t read_begin = sec.chunks[first].offset;
+  uint64_t read_end = sec.chunks[last - 1].offset + sec.chunks[last - 1].size;
+
+  std::vector<char> compressed(read_end - read_begin);
+  fp.clear();
+  fp.seekg(read_begin);
+  fp.read(compressed.data(), compressed.size());
+
+  if (!fp.good())
+  {
+    print_error("Truncated block section");
+    return false;
+  }
+
+  bool succeed = true;
+
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic) reduction(&& : succeed)
+  for (uint64_t c = first; c < last; c++)
+  {
+    const ChunkEntry &chunk = sec.chunks[c];
+    const char *src = compressed.data() + (chunk.offset - read_begin);
+    size_t raw_len = (chunk.elem_end - chunk.elem_begin) * sec.elem_size;
+
+    if (chunk.elem_begin >= begin && chunk.elem_end <= end)
+    {
+      succeed = codec.uncompress(src, chunk.size, out + (chunk.elem_begin - begin) * sec.elem_size, raw_len)
+                && succeed;
+    }
+    else
+    {
+      /* Chunk partially requested */
+      std::vector<char> raw(raw_len);
+      bool ok = codec.uncompress(src, chunk.size, raw.data(), raw_len);
+
+      uint64_t from = std::max(begin, chunk.elem_begin);
+      uint64_t to = std::min(end, chunk.elem_end);
+      if (ok)
+      {
+        std::memcpy(out + (from - begin) * sec.elem_size, raw.data() + (from - chunk.elem_begin) * sec.elem_size,
+                    (to - from) * sec.elem_size);
+      }
+      succeed = ok && succeed;
+    }
+  }
+
+  if (!succeed)
+  {
+    print_error(codec.codec_name() + " uncompression of a block chunk failed");
+  }
+
+  return succeed;
+}
+
+/*! Checks the CRC32 of every chunk, nothing is uncompressed */
+inline bool BlockHeader::verify(std::istream &fp) const
+{
+  std::vector<char> compressed;
+
+  for (size_t s = 0; s < sections.size(); s++)
+  {
+    for (const ChunkEntry &chunk : sections[s].chunks)
+    {
+      compressed.resize(chunk.size);
+      fp.clear();
+      fp.seekg(chunk.offset);
+      fp.read(compressed.data(), chunk.size);
+
+      if (!fp.good() || Codec::checksum(compressed.data(), chunk.size) != chunk.checksum)
+      {
+        std::ostringstream err;
+        err << "Checksum mismatch in section " << s << " for rows [" << chunk.row_begin << ";"
+            << chunk.row_end << ")";
+        print_error(err.str());
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BLOCK_HEADER_HPP__
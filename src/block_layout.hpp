@@ -0,0 +1,197 @@
+#ifndef GRAPHEE_BLOCK_LAYOUT_HPP__
+#define GRAPHEE_BLOCK_LAYOUT_HPP__
+
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <initializer_list>
+
+namespace graphee
+{
+
+/*! \brief Storage layouts of a `SparseBMatrixCSR` block
+ *
+ * - `CSR`: `ia` (m + 1) and `ja` (nnz), 8 bytes per edge,
+ * - `HYPERSPARSE`: CSR over the non-empty lines only, `rows` holds
+ *   their ids, for blocks far from the diagonal,
+ * - `BITMAP`: one bit per element, `words_per_row(n)` words per line,
+ *   for dense blocks such as the diagonal ones of a host graph,
+ * - `HILBERT`: the elements sorted along a Hilbert curve, grouped by
+ *   tiles of `tile_side` x `tile_side` with 16-bit coordinates inside
+ *   the tile, 4 bytes per edge. Consecutive edges touch close lines and
+ *   columns, the SpMV keeps both vectors in cache.
+ *
+ * `choose()` keeps the smallest of the first three, `HILBERT` is only
+ * used on request. A block with repeated elements is never a bitmap,
+ * which holds each element once. The layout is recorded in the bits
+ * 8 to 15 of the fileformat of the block header, thus files written
+ * before the layouts are read as CSR.
+ */
+
+class BlockLayout
+{
+public:
+  enum
+  {
+    CSR,
+    HYPERSPARSE,
+    BITMAP,
+    HILBERT,
+    AUTO
+  };
+
+  /*! Tags selecting the SpMV kernel of each layout at compile time */
+  struct CsrTag {};
+  struct HypersparseTag {};
+  struct BitmapTag {};
+  struct HilbertTag {};
+
+  static const uint64_t tile_bits{16};
+  static const uint64_t tile_side{uint64_t(1) << tile_bits};
+
+  static size_t bytes(int layout, uint64_t m, uint64_t n, uint64_t nnz, uint64_t aux);
+  static int choose(uint64_t m, uint64_t n, uint64_t nnz, uint64_t nrows, bool repeated = false);
+
+  static uint64_t hilbert_order(uint64_t m, uint64_t n);
+  static uint64_t hilbert_index(uint64_t order, uint64_t i, uint64_t j);
+  static void hilbert_coords(uint64_t order, uint64_t d, uint64_t &i, uint64_t &j);
+
+  static uint64_t words_per_row(uint64_t n)
+  {
+    return (n + 63) / 64;
+  }
+
+  static int pack(int fileformat, int layout)
+  {
+    return fileformat | (layout << 8);
+  }
+
+  static int format_of(int packed)
+  {
+    return packed & 0xff;
+  }
+
+  static int layout_of(int packed)
+  {
+    return (packed >> 8) & 0xff;
+  }
+
+  static std::string name(int layout);
+}; // class graphee::BlockLayout
+
+/*! Size of a block of `nnz` edges, `aux` is the number of non-empty
+ * lines (hypersparse) or of tiles (Hilbert)
+ */
+inline size_t BlockLayout::bytes(int layout, uint64_t m, uint64_t n, uint64_t nnz, uint64_t aux)
+{
+  switch (layout)
+  {
+  case HYPERSPARSE:
+    return (2 * aux + 1 + nnz) * sizeof(uint64_t);
+  case HILBERT:
+    return (2 * aux + 1) * sizeof(uint64_t) + nnz * sizeof(uint32_t);
+  case BITMAP:
+    return m * words_per_row(n) * sizeof(uint64_t);
+  default:
+    return (m + 1 + nnz) * sizeof(uint64_t);
+  }
+}
+
+/*! Smallest layout, CSR on ties, not `BITMAP` when the block has
+ * `repeated` elements */
+inline int BlockLayout::choose(uint64_t m, uint64_t n, uint64_t nnz, uint64_t nrows, bool repeated)
+{
+  int best = CSR;
+  size_t best_bytes = bytes(CSR, m, n, nnz, nrows);
+
+  for (int layout : {HYPERSPARSE, BITMAP})
+  {
+    if (layout == BITMAP && repeated)
+      continue;
+    if (bytes(layout, m, n, nnz, nrows) < best_bytes)
+    {
+      best = layout;
+      best_bytes = bytes(layout, m, n, nnz, nrows);
+    }
+  }
+
+  return best;
+}
+
+/*! Number of levels of the Hilbert curve covering a `m` x `n` block */
+inline uint64_t BlockLayout::hilbert_order(uint64_t m, uint64_t n)
+{
+  uint64_t order = 0;
+  while ((uint64_t(1) << order) < std::max(m, n) && order < 32)
+    order++;
+  return order;
+}
+
+/*! Distance of the element (i, j) along the curve of `order` levels */
+inline uint64_t BlockLayout::hilbert_index(uint64_t order, uint64_t i, uint64_t j)
+{
+  uint64_t d = 0;
+  for (uint64_t s = (uint64_t(1) << order) >> 1; s > 0; s >>= 1)
+  {
+    uint64_t ri = (i & s) > 0;
+    uint64_t rj = (j & s) > 0;
+    d += s * s * ((3 * ri) ^ rj);
+
+    /* Rotate the quadrant */
+    if (rj == 0)
+    {
+      if (ri == 1)
+      {
+        i = s - 1 - (i & (s - 1));
+        j = s - 1 - (j & (s - 1));
+      }
+      std::swap(i, j);
+    }
+  }
+  return d;
+}
+
+/*! Inverse of `hilbert_index()` */
+inline void BlockLayout::hilbert_coords(uint64_t order, uint64_t d, uint64_t &i, uint64_t &j)
+{
+  i = 0;
+  j = 0;
+  for (uint64_t s = 1; s < (uint64_t(1) << order); s <<= 1)
+  {
+    uint64_t ri = 1 & (d / 2);
+    uint64_t rj = 1 & (d ^ ri);
+
+    if (rj == 0)
+    {
+      if (ri == 1)
+      {
+        i = s - 1 - i;
+        j = s - 1 - j;
+      }
+      std::swap(i, j);
+    }
+
+    i += s * ri;
+    j += s * rj;
+    d /= 4;
+  }
+}
+
+inline std::string BlockLayout::name(int layout)
+{
+  switch (layout)
+  {
+  case HILBERT:
+    return "HILBERT";
+  case HYPERSPARSE:
+    return "HYPERSPARSE";
+  case BITMAP:
+    return "BITMAP";
+  default:
+    return "CSR";
+  }
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BLOCK_LAYOUT_HPP__
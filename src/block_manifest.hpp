@@ -0,0 +1,236 @@
+#ifndef GRAPHEE_BLOCK_MANIFEST_HPP__
+#define GRAPHEE_BLOCK_MANIFEST_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "block_writer.hpp"
+#include "graph_container.hpp"
+
+namespace graphee
+{
+
+/*! \brief Content of a block: non-zero elements, non-empty lines and
+ *         columns, their smallest and largest ids (relative to the block,
+ *         meaningless for an empty block) and size of the saved block
+ */
+struct BlockStats
+{
+  uint64_t nnz;
+  uint64_t nrows;
+  uint64_t ncols;
+  uint64_t min_line;
+  uint64_t max_line;
+  uint64_t min_col;
+  uint64_t max_col;
+  uint64_t bytes;
+
+  BlockStats() : nnz(0), nrows(0), ncols(0), min_line(0), max_line(0), min_col(0), max_col(0), bytes(0) {}
+
+  /*! Statistics of the transposed block, but its size */
+  BlockStats transposed() const
+  {
+    BlockStats tstats(*this);
+    std::swap(tstats.nrows, tstats.ncols);
+    std::swap(tstats.min_line, tstats.min_col);
+    std::swap(tstats.max_line, tstats.max_col);
+    tstats.bytes = 0;
+    return tstats;
+  }
+}; // struct graphee::BlockStats
+
+/*! \brief `BlockStats` of all the blocks of a `DiskSparseMatrix`, saved
+ *         by `load_edgelist` next to the blocks
+ *
+ * The products of the `DiskVector` skip the empty blocks, and the loads
+ * of the slices they would multiply, and start with the lines (or the
+ * columns) with the most bytes to read. Without a manifest, e.g. for
+ * blocks built by an older version, no block is skipped and the lines
+ * are taken in order.
+ *
+ * File: the common prefix with the typename `BlockManifest` and the
+ * `Utils::BIN` format, `uint64_t nslices`, then the `BlockStats` of the
+ * blocks line by line, as 8 `uint64_t`.
+ */
+
+class BlockManifest
+{
+public:
+  BlockManifest(uint64_t nslices = 0) : nslices(nslices), loaded(false) {}
+
+  void reset(uint64_t nslices);
+
+  void set(uint64_t line, uint64_t col, const BlockStats &block_stats);
+  const BlockStats &get(uint64_t line, uint64_t col) const;
+
+  bool is_loaded() const
+  {
+    return loaded;
+  }
+
+  bool is_empty(uint64_t line, uint64_t col) const;
+
+  std::vector<uint64_t> lines_by_size() const;
+  std::vector<uint64_t> columns_by_size() const;
+
+  void save(BlockWriter &manfp) const;
+  void save(std::string filename) const;
+  void save(GraphContainer &container, std::string key) const;
+
+  bool load(std::istream &manfp);
+  bool load(std::string filename);
+  bool load(GraphContainer &container, std::string key);
+
+  const std::string manifest_typename{"BlockManifest"};
+
+private:
+  uint64_t nslices;
+  bool loaded;
+
+  std::vector<BlockStats> stats;
+
+  std::vector<uint64_t> by_size(bool lines) const;
+}; // class graphee::BlockManifest
+
+inline void BlockManifest::reset(uint64_t nslices)
+{
+  this->nslices = nslices;
+  stats.assign(nslices * nslices, BlockStats());
+  loaded = true;
+}
+
+inline void BlockManifest::set(uint64_t line, uint64_t col, const BlockStats &block_stats)
+{
+  stats[line * nslices + col] = block_stats;
+}
+
+inline const BlockStats &BlockManifest::get(uint64_t line, uint64_t col) const
+{
+  return stats[line * nslices + col];
+}
+
+inline bool BlockManifest::is_empty(uint64_t line, uint64_t col) const
+{
+  return loaded && stats[line * nslices + col].nnz == 0;
+}
+
+/*! Lines by decreasing number of bytes of their blocks */
+inline std::vector<uint64_t> BlockManifest::lines_by_size() const
+{
+  return by_size(true);
+}
+
+/*! Columns by decreasing number of bytes of their blocks */
+inline std::vector<uint64_t> BlockManifest::columns_by_size() const
+{
+  return by_size(false);
+}
+
+inline std::vector<uint64_t> BlockManifest::by_size(bool lines) const
+{
+  std::vector<uint64_t> order(nslices);
+  std::iota(order.begin(), order.end(), 0);
+
+  if (!loaded)
+    return order;
+
+  std::vector<uint64_t> bytes(nslices, 0);
+  for (uint64_t line = 0; line < nslices; line++)
+  {
+    for (uint64_t col = 0; col < nslices; col++)
+    {
+      bytes[lines ? line : col] += get(line, col).bytes;
+    }
+  }
+
+  std::stable_sort(order.begin(), order.end(), [&bytes](uint64_t lhs, uint64_t rhs)
+  {
+    return bytes[lhs] > bytes[rhs];
+  });
+  return order;
+}
+
+inline void BlockManifest::save(BlockWriter &manfp) const
+{
+  size_t typename_size = manifest_typename.size();
+  int fileformat = Utils::BIN;
+
+  manfp.write(reinterpret_cast<const char *>(&typename_size), sizeof(size_t));
+  manfp.write(manifest_typename.c_str(), typename_size);
+  manfp.write(reinterpret_cast<const char *>(&fileformat), sizeof(int));
+  manfp.write(reinterpret_cast<const char *>(&nslices), sizeof(uint64_t));
+  manfp.write(reinterpret_cast<const char *>(stats.data()), stats.size() * sizeof(BlockStats));
+}
+
+inline void BlockManifest::save(std::string filename) const
+{
+  BlockWriter manfp(filename);
+  save(manfp);
+  manfp.close();
+}
+
+inline void BlockManifest::save(GraphContainer &container, std::string key) const
+{
+  std::vector<char> image;
+  BlockWriter manfp(&image);
+  save(manfp);
+  manfp.close();
+
+  container.write(key, image);
+}
+
+/*! False, and the manifest is left unloaded, when the stream is not a
+ * manifest of the same number of slices
+ */
+inline bool BlockManifest::load(std::istream &manfp)
+{
+  size_t typename_size = 0;
+  manfp.read(reinterpret_cast<char *>(&typename_size), sizeof(size_t));
+  if (!manfp.good() || typename_size != manifest_typename.size())
+    return false;
+
+  std::string read_typename(typename_size, '\0');
+  int fileformat;
+  uint64_t read_nslices = 0;
+
+  manfp.read(&read_typename[0], typename_size);
+  manfp.read(reinterpret_cast<char *>(&fileformat), sizeof(int));
+  manfp.read(reinterpret_cast<char *>(&read_nslices), sizeof(uint64_t));
+
+  if (!manfp.good() || read_typename != manifest_typename || read_nslices != nslices)
+    return false;
+
+  std::vector<BlockStats> read_stats(nslices * nslices);
+  manfp.read(reinterpret_cast<char *>(read_stats.data()), read_stats.size() * sizeof(BlockStats));
+  if (!manfp.good())
+    return false;
+
+  stats = std::move(read_stats);
+  loaded = true;
+  return true;
+}
+
+inline bool BlockManifest::load(std::string filename)
+{
+  std::ifstream manfp(filename, std::ios_base::binary);
+  return manfp.is_open() && load(manfp);
+}
+
+inline bool BlockManifest::load(GraphContainer &container, std::string key)
+{
+  if (!container.contains(key))
+    return false;
+
+  MappedStream manfp(container.map(key));
+  return load(manfp);
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BLOCK_MANIFEST_HPP__
@@ -0,0 +1,176 @@
+#ifndef GRAPHEE_BLOCK_SCHEDULE_HPP__
+#define GRAPHEE_BLOCK_SCHEDULE_HPP__
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include "block_manifest.hpp"
+
+namespace graphee
+{
+
+/*! \brief Order in which a product of a `DiskVector` goes through the
+ *         blocks of a `DiskSparseMatrix`, chosen to read the fewest bytes
+ *
+ * `LINES` multiplies the blocks line by line: each line reads the slices
+ * of all its non-empty columns, thus a slice is read once per line.
+ * `COLUMNS` keeps the accumulators of a group of lines in RAM, as many
+ * as `max_group` of them, and reads each column slice once per group,
+ * multiplying it by the blocks of all the lines of the group. The
+ * result slices are read and written once by both orders.
+ *
+ * `AUTO` plans both and keeps the one with the fewest planned bytes, the
+ * blocks from the manifest plus the slices read, `LINES` on a tie (e.g.
+ * a constant input vector costs no read).
+ */
+
+class BlockSchedule
+{
+public:
+  enum Order
+  {
+    AUTO,
+    LINES,
+    COLUMNS
+  };
+
+  /*! Lines whose accumulators are held together, and the non-empty
+   * columns of their blocks */
+  struct Group
+  {
+    std::vector<uint64_t> lines;
+    std::vector<uint64_t> cols;
+  };
+
+  BlockSchedule()
+    : order(LINES), slice_loads(0), planned_block_bytes(0), planned_slice_bytes(0), read_block_bytes(0),
+      read_slice_bytes(0)
+  {
+  }
+
+  static BlockSchedule plan(Order order, const BlockManifest &manifest, const std::vector<uint64_t> &lines,
+                            uint64_t max_group, const std::vector<uint64_t> &col_bytes,
+                            const std::vector<uint64_t> &line_bytes);
+
+  static std::string order_name(Order order);
+
+  uint64_t planned_bytes() const
+  {
+    return planned_block_bytes + planned_slice_bytes;
+  }
+
+  uint64_t read_bytes() const
+  {
+    return read_block_bytes + read_slice_bytes;
+  }
+
+  std::string report() const;
+
+  Order order;
+  std::vector<Group> groups;
+
+  /*! Column slices read by the product */
+  uint64_t slice_loads;
+  uint64_t planned_block_bytes;
+  uint64_t planned_slice_bytes;
+
+  /*! Bytes read by the product, set once it is done */
+  uint64_t read_block_bytes;
+  uint64_t read_slice_bytes;
+
+private:
+  static BlockSchedule plan_groups(Order order, const BlockManifest &manifest, const std::vector<uint64_t> &lines,
+                                   uint64_t group_size, const std::vector<uint64_t> &col_bytes,
+                                   const std::vector<uint64_t> &line_bytes);
+}; // class graphee::BlockSchedule
+
+/*! `lines` in the order they are taken, `col_bytes` and `line_bytes` the
+ * bytes of each column slice and of each result slice
+ */
+inline BlockSchedule BlockSchedule::plan(Order order, const BlockManifest &manifest,
+                                         const std::vector<uint64_t> &lines, uint64_t max_group,
+                                         const std::vector<uint64_t> &col_bytes,
+                                         const std::vector<uint64_t> &line_bytes)
+{
+  max_group = std::max<uint64_t>(max_group, 1);
+  if (order == LINES)
+    return plan_groups(LINES, manifest, lines, 1, col_bytes, line_bytes);
+  if (order == COLUMNS)
+    return plan_groups(COLUMNS, manifest, lines, max_group, col_bytes, line_bytes);
+
+  BlockSchedule by_lines = plan_groups(LINES, manifest, lines, 1, col_bytes, line_bytes);
+  BlockSchedule by_columns = plan_groups(COLUMNS, manifest, lines, max_group, col_bytes, line_bytes);
+  return by_columns.planned_bytes() < by_lines.planned_bytes() ? by_columns : by_lines;
+}
+
+inline BlockSchedule BlockSchedule::plan_groups(Order order, const BlockManifest &manifest,
+                                                const std::vector<uint64_t> &lines, uint64_t group_size,
+                                                const std::vector<uint64_t> &col_bytes,
+                                                const std::vector<uint64_t> &line_bytes)
+{
+  BlockSchedule schedule;
+  schedule.order = order;
+
+  const uint64_t nslices = col_bytes.size();
+  for (uint64_t first = 0; first < lines.size(); first += group_size)
+  {
+    Group group;
+    group.lines.assign(lines.begin() + first, lines.begin() + std::min<uint64_t>(first + group_size, lines.size()));
+
+    for (uint64_t col = 0; col < nslices; col++)
+    {
+      bool used = false;
+      for (uint64_t line : group.lines)
+      {
+        if (!manifest.is_empty(line, col))
+        {
+          used = true;
+          schedule.planned_block_bytes += manifest.is_loaded() ? manifest.get(line, col).bytes : 0;
+        }
+      }
+      if (used)
+      {
+        group.cols.push_back(col);
+        schedule.slice_loads++;
+        schedule.planned_slice_bytes += col_bytes[col];
+      }
+    }
+
+    for (uint64_t line : group.lines)
+    {
+      schedule.planned_slice_bytes += line_bytes[line];
+    }
+    schedule.groups.push_back(group);
+  }
+  return schedule;
+}
+
+inline std::string BlockSchedule::order_name(Order order)
+{
+  switch (order)
+  {
+  case AUTO:
+    return "auto";
+  case LINES:
+    return "lines";
+  default:
+    return "columns";
+  }
+}
+
+inline std::string BlockSchedule::report() const
+{
+  std::ostringstream oss;
+  oss << "Block schedule: " << order_name(order) << " in " << groups.size() << " groups, " << slice_loads
+      << " slice loads, planned " << planned_block_bytes / (1UL << 20) << " MB of blocks and "
+      << planned_slice_bytes / (1UL << 20) << " MB of slices, read " << read_block_bytes / (1UL << 20) << " MB and "
+      << read_slice_bytes / (1UL << 20) << " MB";
+  return oss.str();
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BLOCK_SCHEDULE_HPP__
@@ -0,0 +1,338 @@
+#ifndef GRAPHEE_BLOCK_STORE_HPP__
+#define GRAPHEE_BLOCK_STORE_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.hpp"
+#include "codec.hpp"
+
+namespace graphee
+{
+
+/*! \brief Directory of block files named after their content, shared by
+ *         the snapshots of a graph
+ *
+ * A block is stored once as `<directory>/<key>.gpe`, the key being the
+ * CRC-32 and the size of the file; every snapshot holding the same block
+ * only has a hard link to it. The objects are read-only: a snapshot
+ * rebuilt later replaces its links, the `BlockWriter` never writes
+ * through them.
+ *
+ * A block differing from the same block of a base snapshot by less
+ * than `max_delta` of its elements is saved as a `BlockDelta` of the
+ * object of the base block instead.
+ */
+
+class BlockStore
+{
+public:
+  BlockStore(std::string directory, double max_delta = 0.05);
+
+  static std::string key_of(const std::vector<char> &image);
+  std::string object_path(const std::string &key) const;
+
+  bool find(const std::vector<char> &image, std::string &key);
+  bool put(const std::vector<char> &image, std::string &key);
+  bool link(const std::string &key, const std::string &path);
+
+  static bool read_file(const std::string &path, std::vector<char> &image);
+
+  const double max_delta;
+
+  /*! Bytes of the blocks linked to an existing object, written as new
+   * objects and written as deltas
+   */
+  std::atomic<uint64_t> reused_bytes;
+  std::atomic<uint64_t> written_bytes;
+  std::atomic<uint64_t> delta_bytes;
+
+private:
+  std::string directory;
+  std::atomic<uint64_t> tmp_id;
+
+  std::string tmp_path(const std::string &dir);
+}; // class graphee::BlockStore
+
+/*! \brief Elements added to and removed from the object `base_key` of
+ *         a `BlockStore`, as sorted `SparseBMatrixCSR::element_keys()`
+ *
+ * File: the common prefix with the typename `BlockDelta` and the
+ * `Utils::BIN` format, then the base key, the layout of the block and
+ * the two arrays of keys.
+ */
+
+struct BlockDelta
+{
+  std::string base_key;
+  int layout;
+  std::vector<uint64_t> added;
+  std::vector<uint64_t> removed;
+
+  static bool diff(const std::vector<uint64_t> &base, const std::vector<uint64_t> &keys,
+                   uint64_t max_changes, BlockDelta &delta);
+  std::vector<uint64_t> apply(const std::vector<uint64_t> &base) const;
+
+  static bool is_delta(const std::string &path);
+  size_t save(const std::string &path) const;
+  void load(const std::string &path);
+}; // struct graphee::BlockDelta
+
+const std::string block_delta_typename{"BlockDelta"};
+
+inline BlockStore::BlockStore(std::string directory, double max_delta)
+  : max_delta(max_delta), reused_bytes(0), written_bytes(0), delta_bytes(0), directory(directory), tmp_id(0)
+{
+  struct stat st;
+  if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+  {
+    std::ostringstream err;
+    err << "Block store \'" << directory << "\' is not a directory";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  if (this->directory.back() != '/')
+    this->directory += '/';
+}
+
+inline std::string BlockStore::key_of(const std::vector<char> &image)
+{
+  std::ostringstream key;
+  key << std::hex << std::setfill('0') << std::setw(8) << Codec::checksum(image.data(), image.size())
+      << std::setw(16) << image.size();
+  return key.str();
+}
+
+inline std::string BlockStore::object_path(const std::string &key) const
+{
+  return directory + key + ".gpe";
+}
+
+/*! Whether an object with the same bytes as `image` exists, its key is
+ * set in any case
+ */
+inline bool BlockStore::find(const std::vector<char> &image, std::string &key)
+{
+  key = key_of(image);
+
+  std::vector<char> object;
+  return read_file(object_path(key), object) && object == image;
+}
+
+/*! Stores `image` if no object has its content, false when another
+ * content has the same key
+ */
+inline bool BlockStore::put(const std::vector<char> &image, std::string &key)
+{
+  std::vector<char> object;
+  key = key_of(image);
+
+  if (read_file(object_path(key), object))
+    return object == image;
+
+  std::string tmpname = tmp_path(directory);
+  std::ofstream objfp(tmpname, std::ios_base::binary);
+  objfp.write(image.data(), image.size());
+  objfp.close();
+
+  if (!objfp.good())
+  {
+    std::remove(tmpname.c_str());
+    return false;
+  }
+
+  chmod(tmpname.c_str(), 0444);
+  if (rename(tmpname.c_str(), object_path(key).c_str()) != 0)
+  {
+    std::remove(tmpname.c_str());
+    return false;
+  }
+
+  written_bytes += image.size();
+  return true;
+}
+
+/*! Replaces `path` by a hard link to the object `key`, false when they
+ * are not on the same file system
+ */
+inline bool BlockStore::link(const std::string &key, const std::string &path)
+{
+  size_t slash = path.find_last_of('/');
+  std::string tmpname = tmp_path(slash == std::string::npos ? "" : path.substr(0, slash + 1));
+
+  if (::link(object_path(key).c_str(), tmpname.c_str()) != 0)
+    return false;
+
+  if (rename(tmpname.c_str(), path.c_str()) != 0)
+  {
+    std::remove(tmpname.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+inline bool BlockStore::read_file(const std::string &path, std::vector<char> &image)
+{
+  std::ifstream fp(path, std::ios_base::binary);
+  if (!fp.is_open())
+    return false;
+
+  fp.seekg(0, fp.end);
+  image.resize(fp.tellg());
+  fp.seekg(0, fp.beg);
+  fp.read(image.data(), image.size());
+  return fp.good();
+}
+
+inline std::string BlockStore::tmp_path(const std::string &dir)
+{
+  std::ostringstream tmpname;
+  tmpname << dir << ".gpe_store_" << getpid() << "_" << tmp_id++ << ".tmp";
+  return tmpname.str();
+}
+
+/*! Fills `delta` with the keys of `keys` not in `base` and conversely,
+ * false as soon as there are more than `max_changes` of them
+ */
+inline bool BlockDelta::diff(const std::vector<uint64_t> &base, const std::vector<uint64_t> &keys,
+                             uint64_t max_changes, BlockDelta &delta)
+{
+  delta.added.clear();
+  delta.removed.clear();
+
+  auto b = base.begin();
+  auto k = keys.begin();
+  while (b != base.end() || k != keys.end())
+  {
+    if (b == base.end() || (k != keys.end() && *k < *b))
+      delta.added.push_back(*k++);
+    else if (k == keys.end() || *b < *k)
+      delta.removed.push_back(*b++);
+    else
+    {
+      b++;
+      k++;
+    }
+
+    if (delta.added.size() + delta.removed.size() > max_changes)
+      return false;
+  }
+
+  return true;
+}
+
+inline std::vector<uint64_t> BlockDelta::apply(const std::vector<uint64_t> &base) const
+{
+  std::vector<uint64_t> kept;
+  kept.reserve(base.size() - std::min(base.size(), removed.size()));
+  std::set_difference(base.begin(), base.end(), removed.begin(), removed.end(), std::back_inserter(kept));
+
+  std::vector<uint64_t> keys;
+  keys.reserve(kept.size() + added.size());
+  std::merge(kept.begin(), kept.end(), added.begin(), added.end(), std::back_inserter(keys));
+  return keys;
+}
+
+inline bool BlockDelta::is_delta(const std::string &path)
+{
+  std::ifstream fp(path, std::ios_base::binary);
+  size_t typename_size = 0;
+  fp.read(reinterpret_cast<char *>(&typename_size), sizeof(size_t));
+
+  if (!fp.good() || typename_size != block_delta_typename.size())
+    return false;
+
+  std::string read_typename(typename_size, '\0');
+  fp.read(&read_typename[0], typename_size);
+  return fp.good() && read_typename == block_delta_typename;
+}
+
+/*! Returns the size of the file */
+inline size_t BlockDelta::save(const std::string &path) const
+{
+  std::ofstream fp(path, std::ios_base::binary | std::ios_base::trunc);
+
+  auto write_array = [&fp](const std::vector<uint64_t> &keys)
+  {
+    uint64_t nkeys = keys.size();
+    fp.write(reinterpret_cast<const char *>(&nkeys), sizeof(uint64_t));
+    fp.write(reinterpret_cast<const char *>(keys.data()), nkeys * sizeof(uint64_t));
+  };
+
+  size_t typename_size = block_delta_typename.size();
+  int fileformat = Utils::BIN;
+  size_t key_size = base_key.size();
+
+  fp.write(reinterpret_cast<const char *>(&typename_size), sizeof(size_t));
+  fp.write(block_delta_typename.c_str(), typename_size);
+  fp.write(reinterpret_cast<const char *>(&fileformat), sizeof(int));
+  fp.write(reinterpret_cast<const char *>(&key_size), sizeof(size_t));
+  fp.write(base_key.c_str(), key_size);
+  fp.write(reinterpret_cast<const char *>(&layout), sizeof(int));
+  write_array(added);
+  write_array(removed);
+
+  size_t bytes = fp.tellp();
+  fp.close();
+
+  if (!fp.good())
+  {
+    std::ostringstream err;
+    err << "Could not write the block delta \'" << path << "\'";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  return bytes;
+}
+
+inline void BlockDelta::load(const std::string &path)
+{
+  std::ifstream fp(path, std::ios_base::binary);
+
+  auto read_array = [&fp](std::vector<uint64_t> &keys)
+  {
+    uint64_t nkeys = 0;
+    fp.read(reinterpret_cast<char *>(&nkeys), sizeof(uint64_t));
+    keys.resize(fp.good() ? nkeys : 0);
+    fp.read(reinterpret_cast<char *>(keys.data()), keys.size() * sizeof(uint64_t));
+  };
+
+  size_t typename_size = 0, key_size = 0;
+  int fileformat;
+
+  fp.read(reinterpret_cast<char *>(&typename_size), sizeof(size_t));
+  fp.ignore(typename_size);
+  fp.read(reinterpret_cast<char *>(&fileformat), sizeof(int));
+  fp.read(reinterpret_cast<char *>(&key_size), sizeof(size_t));
+  base_key.assign(fp.good() ? key_size : 0, '\0');
+  fp.read(&base_key[0], base_key.size());
+  fp.read(reinterpret_cast<char *>(&layout), sizeof(int));
+  read_array(added);
+  read_array(removed);
+
+  if (!fp.good())
+  {
+    std::ostringstream err;
+    err << "Could not read the block delta \'" << path << "\'";
+    print_error(err.str());
+    exit(-1);
+  }
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BLOCK_STORE_HPP__
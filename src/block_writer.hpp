@@ -0,0 +1,431 @@
+#ifndef GRAPHEE_BLOCK_WRITER_HPP__
+#define GRAPHEE_BLOCK_WRITER_HPP__
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <algorithm>
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "utils.hpp"
+#include "codec.hpp"
+#include "thread_pool.hpp"
+
+namespace graphee
+{
+
+/*! \brief Asynchronous writer of `.gpe` files
+ *
+ * The caller only queues what has to be written, a dedicated writer
+ * thread gathers it into a page-aligned staging buffer and writes it
+ * with large `pwrite` calls, or into a memory image for the extents of
+ * a `GraphContainer`.
+ * `write_compressed` splits an array into chunks compressed by
+ * `ThreadPool::shared()`: compression of the next chunks overlaps with
+ * the write of the previous ones. The chunk index is written at the end
+ * by `write_footer` (see `BlockHeader` for the layout).
+ *
+ * Arrays given to `write_array` and `write_compressed` are not copied,
+ * they must stay valid until `close()`. Temporaries, such as filtered
+ * copies of an array, can be given to `hold()` which keeps them alive
+ * until then.
+ */
+
+class BlockWriter
+{
+public:
+  BlockWriter(std::string filename);
+  BlockWriter(std::vector<char> *image);
+  ~BlockWriter();
+
+  BlockWriter(const BlockWriter &) = delete;
+  BlockWriter &operator=(const BlockWriter &) = delete;
+
+  void write(const void *data, size_t bytes);
+  void write_array(const void *data, size_t bytes);
+
+  struct WrittenChunk
+  {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+  };
+  typedef std::shared_ptr<std::vector<WrittenChunk>> ChunkEntries;
+
+  ChunkEntries write_compressed(const void *data, const std::vector<uint64_t> &bounds, int fileformat);
+  void write_footer(std::function<std::vector<char>()> make_footer, uint64_t offset_slot);
+
+  const char *hold(std::vector<char> &&data);
+
+  void seek(uint64_t offset);
+  uint64_t tellp() const;
+
+  void close();
+
+  static const size_t buffer_size{1UL << 23}; // 8 MB
+  static const size_t buffer_alignment{1UL << 12};
+
+private:
+  struct CompressedChunk
+  {
+    std::vector<char> bytes;
+    uint64_t checksum;
+  };
+
+  std::string filename;
+  int fd;
+  std::vector<char> *image;
+
+  /* Only used by the writer thread */
+  char *buffer;
+  size_t buffer_fill;
+  uint64_t buffer_offset;
+
+  /* Position seen by the caller, unknown after a compressed array */
+  uint64_t logical_offset;
+  bool offset_known;
+
+  std::thread writer;
+  std::deque<std::function<void()>> queue;
+  std::mutex mtx;
+  std::condition_variable cond;
+  bool closing;
+
+  /* Buffers given to `hold()`, released by `close()` */
+  std::deque<std::vector<char>> held;
+
+  void start();
+  void enqueue(std::function<void()> task);
+  void run();
+
+  void append(const char *data, size_t bytes);
+  void patch(uint64_t offset, const char *data, size_t bytes);
+  void flush();
+  void pwrite_all(const char *data, size_t bytes, uint64_t offset);
+}; // class graphee::BlockWriter
+
+inline BlockWriter::BlockWriter(std::string filename)
+  : filename(filename), image(nullptr), buffer(nullptr), buffer_fill(0), buffer_offset(0),
+    logical_offset(0), offset_known(true), closing(false)
+{
+  /* A hard link to an object of a `BlockStore` is replaced, not rewritten */
+  unlink(filename.c_str());
+  fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    std::ostringstream err;
+    err << "Could not open file \'" << filename << "\' for writing";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  start();
+}
+
+/*! Writes into `image` instead of a file, it is complete after `close()` */
+inline BlockWriter::BlockWriter(std::vector<char> *image)
+  : filename("memory image"), fd(-1), image(image), buffer(nullptr), buffer_fill(0), buffer_offset(0),
+    logical_offset(0), offset_known(true), closing(false)
+{
+  image->clear();
+  start();
+}
+
+inline void BlockWriter::start()
+{
+  void *ptr;
+  if (posix_memalign(&ptr, buffer_alignment, buffer_size) != 0)
+  {
+    print_error("Could not allocate the staging buffer of the writer");
+    exit(-1);
+  }
+  buffer = static_cast<char *>(ptr);
+
+  writer = std::thread(&BlockWriter::run, this);
+}
+
+inline BlockWriter::~BlockWriter()
+{
+  close();
+}
+
+/*! Queues a copy of `data` */
+inline void BlockWriter::write(const void *data, size_t bytes)
+{
+  std::shared_ptr<std::vector<char>> copy =
+    std::make_shared<std::vector<char>>(static_cast<const char *>(data),
+                                        static_cast<const char *>(data) + bytes);
+  enqueue([this, copy]()
+  {
+    append(copy->data(), copy->size());
+  });
+  logical_offset += bytes;
+}
+
+/*! Queues `data` without copy */
+inline void BlockWriter::write_array(const void *data, size_t bytes)
+{
+  const char *ptr = static_cast<const char *>(data);
+  enqueue([this, ptr, bytes]()
+  {
+    append(ptr, bytes);
+  });
+  logical_offset += bytes;
+}
+
+/*! Queues the chunks of `data` compressed with the codec of `fileformat`,
+ * chunk `c` holds the bytes [bounds[c], bounds[c + 1]).
+ * The returned entries (position in the file, compressed size and CRC32
+ * of the compressed bytes) are filled by the writer thread, they can be
+ * read by a later `write_footer`.
+ */
+inline BlockWriter::ChunkEntries BlockWriter::write_compressed(const void *data, const std::vector<uint64_t> &bounds,
+    int fileformat)
+{
+  const Codec &codec = Codec::get(fileformat);
+  const char *ptr = static_cast<const char *>(data);
+
+  uint64_t nchunks = bounds.size() - 1;
+  ChunkEntries entries = std::make_shared<std::vector<WrittenChunk>>(nchunks);
+
+  for (uint64_t c = 0; c < nchunks; c++)
+  {
+    const char *raw = ptr + bounds[c];
+    size_t raw_len = bounds[c + 1] - bounds[c];
+
+    std::shared_ptr<std::future<CompressedChunk>> chunk = std::make_shared<std::future<CompressedChunk>>(
+          ThreadPool::shared().submit([&codec, raw, raw_len]()
+    {
+      CompressedChunk comp;
+      size_t comp_len = codec.max_compressed_length(raw_len);
+      comp.bytes.resize(comp_len);
+
+      if (!codec.compress(raw, raw_len, comp.bytes.data(), &comp_len))
+      {
+        print_error(codec.codec_name() + " compression of a chunk failed");
+        exit(-1);
+      }
+
+      comp.bytes.resize(comp_len);
+      comp.checksum = Codec::checksum(comp.bytes.data(), comp_len);
+      return comp;
+    }));
+
+    enqueue([this, entries, chunk, c]()
+    {
+      CompressedChunk comp = chunk->get();
+      (*entries)[c].offset = buffer_offset + buffer_fill;
+      (*entries)[c].size = comp.bytes.size();
+      (*entries)[c].checksum = comp.checksum;
+      append(comp.bytes.data(), comp.bytes.size());
+    });
+  }
+
+  offset_known = false;
+  return entries;
+}
+
+/*! Queues a footer built by `make_footer` once everything queued before
+ * is written, its offset is then stored at `offset_slot` (8 bytes
+ * reserved by the caller)
+ */
+inline void BlockWriter::write_footer(std::function<std::vector<char>()> make_footer, uint64_t offset_slot)
+{
+  enqueue([this, make_footer, offset_slot]()
+  {
+    uint64_t footer_offset = buffer_offset + buffer_fill;
+    std::vector<char> footer = make_footer();
+    append(footer.data(), footer.size());
+    patch(offset_slot, reinterpret_cast<const char *>(&footer_offset), sizeof(uint64_t));
+  });
+
+  offset_known = false;
+}
+
+/*! Pads with zeros up to `offset`, used by the in-place layouts */
+inline void BlockWriter::seek(uint64_t offset)
+{
+  if (!offset_known || offset < logical_offset)
+  {
+    print_error("BlockWriter can only seek forward before any compressed array");
+    exit(-1);
+  }
+
+  uint64_t padding = offset - logical_offset;
+  enqueue([this, padding]()
+  {
+    uint64_t stage = buffer_size;
+    std::vector<char> zeros(std::min(padding, stage), 0);
+    for (uint64_t done = 0; done < padding; done += zeros.size())
+    {
+      append(zeros.data(), std::min<uint64_t>(zeros.size(), padding - done));
+    }
+  });
+  logical_offset = offset;
+}
+
+inline uint64_t BlockWriter::tellp() const
+{
+  return logical_offset;
+}
+
+/*! Waits for every queued write and closes the file */
+inline void BlockWriter::close()
+{
+  if (buffer == nullptr)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    closing = true;
+  }
+  cond.notify_one();
+  writer.join();
+
+  flush();
+  if (fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+
+  free(buffer);
+  buffer = nullptr;
+  held.clear();
+}
+
+/*! Keeps `data` alive until `close()`, the returned pointer can be
+ * given to `write_array` or `write_compressed`
+ */
+inline const char *BlockWriter::hold(std::vector<char> &&data)
+{
+  held.push_back(std::move(data));
+  return held.back().data();
+}
+
+inline void BlockWriter::enqueue(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    queue.push_back(std::move(task));
+  }
+  cond.notify_one();
+}
+
+inline void BlockWriter::run()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      while (!closing && queue.empty())
+      {
+        cond.wait(lock);
+      }
+
+      if (queue.empty())
+        return;
+
+      task = std::move(queue.front());
+      queue.pop_front();
+    }
+    task();
+  }
+}
+
+inline void BlockWriter::append(const char *data, size_t bytes)
+{
+  /* Large arrays skip the staging buffer when it is empty */
+  if (buffer_fill == 0 && bytes >= buffer_size)
+  {
+    size_t direct = bytes / buffer_size * buffer_size;
+    pwrite_all(data, direct, buffer_offset);
+    buffer_offset += direct;
+    data += direct;
+    bytes -= direct;
+  }
+
+  while (bytes > 0)
+  {
+    size_t len = std::min(bytes, buffer_size - buffer_fill);
+    std::memcpy(buffer + buffer_fill, data, len);
+    buffer_fill += len;
+    data += len;
+    bytes -= len;
+
+    if (buffer_fill == buffer_size)
+      flush();
+  }
+}
+
+/*! Overwrites bytes already appended, either still staged or on disk */
+inline void BlockWriter::patch(uint64_t offset, const char *data, size_t bytes)
+{
+  if (offset < buffer_offset)
+  {
+    size_t on_disk = std::min<uint64_t>(bytes, buffer_offset - offset);
+    pwrite_all(data, on_disk, offset);
+    offset += on_disk;
+    data += on_disk;
+    bytes -= on_disk;
+  }
+
+  if (bytes > 0)
+  {
+    std::memcpy(buffer + (offset - buffer_offset), data, bytes);
+  }
+}
+
+inline void BlockWriter::flush()
+{
+  if (buffer_fill > 0)
+  {
+    pwrite_all(buffer, buffer_fill, buffer_offset);
+    buffer_offset += buffer_fill;
+    buffer_fill = 0;
+  }
+}
+
+inline void BlockWriter::pwrite_all(const char *data, size_t bytes, uint64_t offset)
+{
+  if (image != nullptr)
+  {
+    if (image->size() < offset + bytes)
+      image->resize(offset + bytes);
+
+    std::memcpy(image->data() + offset, data, bytes);
+    return;
+  }
+
+  while (bytes > 0)
+  {
+    ssize_t ret = pwrite(fd, data, bytes, offset);
+    if (ret < 0)
+    {
+      std::ostringstream err;
+      err << "Write to \'" << filename << "\' failed";
+      print_error(err.str());
+      exit(-1);
+    }
+    data += ret;
+    bytes -= ret;
+    offset += ret;
+  }
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BLOCK_WRITER_HPP__
@@ -0,0 +1,588 @@
+#ifndef GRAPHEE_BVGRAPH_HPP__
+#define GRAPHEE_BVGRAPH_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <iterator>
+#include <cctype>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.hpp"
+#include "mapped_file.hpp"
+
+namespace graphee
+{
+
+/*! \brief Reads the instantaneous codes of WebGraph, most significant
+ *         bit first, from a buffer
+ */
+class BitStream
+{
+public:
+  BitStream(const char *data, size_t size)
+    : data(reinterpret_cast<const unsigned char *>(data)), nbits(size * 8), pos(0) {}
+
+  void seek(uint64_t bit)
+  {
+    pos = bit;
+  }
+
+  uint64_t position() const
+  {
+    return pos;
+  }
+
+  uint64_t read_bit()
+  {
+    return read_int(1);
+  }
+
+  uint64_t read_int(int len);
+  uint64_t read_unary();
+  uint64_t read_gamma();
+  uint64_t read_delta();
+  uint64_t read_zeta(int k);
+
+private:
+  const unsigned char *data;
+  uint64_t nbits;
+  uint64_t pos;
+
+  void check(uint64_t bits) const;
+}; // class graphee::BitStream
+
+/*! \brief Graph compressed in the BVGraph format of WebGraph, as
+ *         published by the LAW and CommonCrawl
+ *
+ * A graph is the files `<basename>.properties`, `<basename>.graph`, the
+ * successor lists, and optionally `<basename>.offsets`, the position of
+ * each list in the `.graph` file. Each list is coded against one of the
+ * `windowsize` previous lists (copy blocks), then as intervals of
+ * consecutive successors and gaps between the remaining ones.
+ *
+ * The lists are read in order by a `BVGraphReader`. With the offsets,
+ * `split()` cuts the nodes in ranges read in parallel, the lists before
+ * a range referenced from it are decoded again.
+ */
+
+class BVGraph
+{
+public:
+  enum
+  {
+    GAMMA,
+    DELTA,
+    UNARY,
+    ZETA
+  };
+
+  BVGraph(std::string basename);
+
+  uint64_t get_nodes() const
+  {
+    return nodes;
+  }
+
+  uint64_t get_arcs() const
+  {
+    return arcs;
+  }
+
+  int get_window_size() const
+  {
+    return window_size;
+  }
+
+  std::vector<uint64_t> split(uint64_t nparts);
+
+  uint64_t offset_of(uint64_t node) const;
+  void successors(uint64_t node, std::vector<uint64_t> &succ) const;
+
+  template <typename RefList>
+  void decode(BitStream &bits, uint64_t node, std::vector<uint64_t> &succ, RefList ref_list) const;
+
+  BitStream stream() const
+  {
+    return BitStream(graph.data(), graph.size());
+  }
+
+private:
+  std::string basename;
+
+  uint64_t nodes;
+  uint64_t arcs;
+
+  int window_size;
+  int max_ref_count;
+  int min_interval_length;
+  int zeta_k;
+
+  int outdegree_code;
+  int reference_code;
+  int block_count_code;
+  int block_code;
+  int residual_code;
+  int offset_code;
+
+  MappedFile graph;
+
+  /* Bit offsets of the first node of each range of `split()`, and of the
+   * lists it can reference
+   */
+  std::map<uint64_t, uint64_t> offsets;
+
+  void read_properties();
+  void set_compression_flags(const std::string &flags);
+  uint64_t read_code(BitStream &bits, int code) const;
+
+  /*! The first interval and residual are coded as the signed gap to the
+   * node: 0, -1, 1, -2...
+   */
+  static int64_t nat2int(uint64_t x)
+  {
+    return (x & 1) == 0 ? static_cast<int64_t>(x >> 1) : -static_cast<int64_t>((x + 1) >> 1);
+  }
+}; // class graphee::BVGraph
+
+/*! \brief Successor lists of the nodes [first; last) of a `BVGraph`, in order
+ *
+ * The last `windowsize` lists are kept to decode the references.
+ */
+class BVGraphReader
+{
+public:
+  BVGraphReader(const BVGraph &graph, uint64_t first, uint64_t last);
+
+  bool next();
+
+  uint64_t node() const
+  {
+    return current;
+  }
+
+  const std::vector<uint64_t> &successors() const
+  {
+    return window[current % window.size()];
+  }
+
+private:
+  const BVGraph *graph;
+  BitStream bits;
+
+  uint64_t first;
+  uint64_t last;
+  uint64_t current;
+  bool started;
+
+  std::vector<std::vector<uint64_t>> window;
+  std::map<uint64_t, std::vector<uint64_t>> lead_in;
+}; // class graphee::BVGraphReader
+
+inline void BitStream::check(uint64_t bits) const
+{
+  if (pos + bits > nbits)
+  {
+    print_error("Truncated BVGraph bit stream");
+    exit(-1);
+  }
+}
+
+inline uint64_t BitStream::read_int(int len)
+{
+  check(len);
+
+  uint64_t x = 0;
+  while (len > 0)
+  {
+    int avail = 8 - static_cast<int>(pos & 7);
+    int take = std::min(avail, len);
+    uint64_t byte = data[pos >> 3];
+
+    x = (x << take) | ((byte >> (avail - take)) & ((1UL << take) - 1));
+    pos += take;
+    len -= take;
+  }
+
+  return x;
+}
+
+/*! Number of zeros before the next one */
+inline uint64_t BitStream::read_unary()
+{
+  uint64_t count = 0;
+
+  while (true)
+  {
+    check(1);
+
+    int avail = 8 - static_cast<int>(pos & 7);
+    unsigned int bits = data[pos >> 3] & ((1U << avail) - 1);
+
+    if (bits == 0)
+    {
+      count += avail;
+      pos += avail;
+    }
+    else
+    {
+      int zeros = avail - 1 - (31 - __builtin_clz(bits));
+      count += zeros;
+      pos += zeros + 1;
+      return count;
+    }
+  }
+}
+
+inline uint64_t BitStream::read_gamma()
+{
+  int msb = static_cast<int>(read_unary());
+  return ((1UL << msb) | read_int(msb)) - 1;
+}
+
+inline uint64_t BitStream::read_delta()
+{
+  int msb = static_cast<int>(read_gamma());
+  return ((1UL << msb) | read_int(msb)) - 1;
+}
+
+inline uint64_t BitStream::read_zeta(int k)
+{
+  int h = static_cast<int>(read_unary());
+  uint64_t left = 1UL << (h * k);
+  uint64_t m = read_int(h * k + k - 1);
+
+  if (m < left)
+    return m + left - 1;
+  return (m << 1) + read_bit() - 1;
+}
+
+inline BVGraph::BVGraph(std::string basename)
+  : basename(basename), nodes(0), arcs(0), window_size(7), max_ref_count(3), min_interval_length(4), zeta_k(3),
+    outdegree_code(GAMMA), reference_code(UNARY), block_count_code(GAMMA), block_code(GAMMA),
+    residual_code(ZETA), offset_code(GAMMA)
+{
+  read_properties();
+
+  if (nodes > 0)
+  {
+    graph = MappedFile(basename + ".graph");
+    graph.advise(MADV_SEQUENTIAL);
+  }
+
+  offsets[0] = 0;
+}
+
+inline void BVGraph::read_properties()
+{
+  std::ifstream propfp(basename + ".properties");
+  if (!propfp.is_open())
+  {
+    std::ostringstream err;
+    err << "Could not open the BVGraph properties \'" << basename << ".properties\'";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  std::string line;
+  while (std::getline(propfp, line))
+  {
+    size_t eq = line.find('=');
+    if (line.empty() || line[0] == '#' || line[0] == '!' || eq == std::string::npos)
+      continue;
+
+    auto trim = [](std::string s)
+    {
+      s.erase(0, s.find_first_not_of(" \t\r"));
+      s.erase(s.find_last_not_of(" \t\r") + 1);
+      return s;
+    };
+
+    std::string key = trim(line.substr(0, eq));
+    std::string value = trim(line.substr(eq + 1));
+
+    if (key == "nodes")
+      nodes = std::stoull(value);
+    else if (key == "arcs")
+      arcs = std::stoull(value);
+    else if (key == "windowsize")
+      window_size = std::stoi(value);
+    else if (key == "maxrefcount")
+      max_ref_count = std::stoi(value);
+    else if (key == "minintervallength")
+      min_interval_length = std::stoi(value);
+    else if (key == "zetak")
+      zeta_k = std::stoi(value);
+    else if (key == "compressionflags")
+      set_compression_flags(value);
+    else if (key == "version" && value != "0")
+    {
+      print_error("Only the version 0 of the BVGraph format is supported");
+      exit(-1);
+    }
+    else if (key == "graphclass" && value.find("BVGraph") == std::string::npos)
+    {
+      std::ostringstream err;
+      err << "The graph \'" << basename << "\' is a " << value << ", not a BVGraph";
+      print_error(err.str());
+      exit(-1);
+    }
+  }
+}
+
+/*! Parses `OUTDEGREES_DELTA|RESIDUALS_GAMMA`, the unnamed parts keep the
+ * default codes
+ */
+inline void BVGraph::set_compression_flags(const std::string &flags)
+{
+  std::istringstream flagss(flags);
+  std::string flag;
+
+  while (std::getline(flagss, flag, '|'))
+  {
+    flag.erase(std::remove_if(flag.begin(), flag.end(), ::isspace), flag.end());
+    if (flag.empty())
+      continue;
+
+    size_t sep = flag.rfind('_');
+    std::string part = flag.substr(0, sep == std::string::npos ? 0 : sep);
+    std::string name = sep == std::string::npos ? flag : flag.substr(sep + 1);
+
+    int code = name == "GAMMA" ? GAMMA : name == "DELTA" ? DELTA : name == "UNARY" ? UNARY : name == "ZETA" ? ZETA : -1;
+    int *target = part == "OUTDEGREES" ? &outdegree_code : part == "REFERENCES" ? &reference_code :
+                  part == "BLOCK_COUNT" ? &block_count_code : part == "BLOCKS" ? &block_code :
+                  part == "RESIDUALS" ? &residual_code : part == "OFFSETS" ? &offset_code : nullptr;
+
+    if (code < 0 || target == nullptr)
+    {
+      std::ostringstream err;
+      err << "Unsupported BVGraph compression flag \'" << flag << "\'";
+      print_error(err.str());
+      exit(-1);
+    }
+
+    *target = code;
+  }
+}
+
+inline uint64_t BVGraph::read_code(BitStream &bits, int code) const
+{
+  switch (code)
+  {
+  case DELTA:
+    return bits.read_delta();
+  case UNARY:
+    return bits.read_unary();
+  case ZETA:
+    return bits.read_zeta(zeta_k);
+  default:
+    return bits.read_gamma();
+  }
+}
+
+/*! First nodes of `nparts` ranges of about the same compressed size,
+ * followed by the number of nodes. Without the `.offsets` file, the
+ * graph is a single range.
+ */
+inline std::vector<uint64_t> BVGraph::split(uint64_t nparts)
+{
+  std::vector<uint64_t> starts{0};
+
+  struct stat st;
+  std::string offsetsname = basename + ".offsets";
+  if (nparts <= 1 || nodes == 0 || max_ref_count < 0 || stat(offsetsname.c_str(), &st) != 0 || st.st_size == 0)
+  {
+    starts.push_back(nodes);
+    return starts;
+  }
+
+  MappedFile offsetsfile(offsetsname);
+  offsetsfile.advise(MADV_SEQUENTIAL);
+  BitStream offsetbits(offsetsfile.data(), offsetsfile.size());
+
+  /* A list references a list at most `windowsize` nodes before, which
+   * itself references a list... at most `maxrefcount` times
+   */
+  uint64_t lead = static_cast<uint64_t>(window_size) * static_cast<uint64_t>(max_ref_count);
+  std::deque<std::pair<uint64_t, uint64_t>> previous;
+
+  uint64_t total_bits = graph.size() * 8;
+  uint64_t offset = 0;
+
+  for (uint64_t node = 0; node < nodes && starts.size() < nparts; node++)
+  {
+    offset += read_code(offsetbits, offset_code);
+
+    previous.push_back(std::make_pair(node, offset));
+    if (previous.size() > lead + 1)
+      previous.pop_front();
+
+    if (node > starts.back() && offset >= total_bits / nparts * starts.size())
+    {
+      starts.push_back(node);
+      offsets.insert(previous.begin(), previous.end());
+    }
+  }
+
+  starts.push_back(nodes);
+  return starts;
+}
+
+inline uint64_t BVGraph::offset_of(uint64_t node) const
+{
+  auto found = offsets.find(node);
+  if (found == offsets.end())
+  {
+    std::ostringstream err;
+    err << "The offset of the node " << node << " of \'" << basename << "\' is not loaded";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  return found->second;
+}
+
+/*! Decodes the list of `node` alone, the nodes it references must be
+ * before a range of `split()`
+ */
+inline void BVGraph::successors(uint64_t node, std::vector<uint64_t> &succ) const
+{
+  BitStream bits = stream();
+  bits.seek(offset_of(node));
+
+  std::vector<uint64_t> reference;
+  decode(bits, node, succ, [this, &reference](uint64_t ref_node) -> const std::vector<uint64_t> &
+  {
+    successors(ref_node, reference);
+    return reference;
+  });
+}
+
+/*! Decodes the list of `node` at the position of `bits`, `ref_list(n)`
+ * gives the list of the node `n` when it is referenced
+ */
+template <typename RefList>
+void BVGraph::decode(BitStream &bits, uint64_t node, std::vector<uint64_t> &succ, RefList ref_list) const
+{
+  succ.clear();
+
+  uint64_t outdegree = read_code(bits, outdegree_code);
+  if (outdegree == 0)
+    return;
+
+  uint64_t ref = window_size > 0 ? read_code(bits, reference_code) : 0;
+
+  std::vector<uint64_t> copied;
+  if (ref > 0)
+  {
+    if (ref > node)
+    {
+      std::ostringstream err;
+      err << "The list of the node " << node << " of \'" << basename << "\' references a node before 0";
+      print_error(err.str());
+      exit(-1);
+    }
+
+    const std::vector<uint64_t> &reference = ref_list(node - ref);
+
+    /* Blocks of the reference list alternately copied and skipped, the
+     * rest is copied after an even number of blocks
+     */
+    uint64_t nblocks = read_code(bits, block_count_code);
+    uint64_t pos = 0;
+    for (uint64_t b = 0; b < nblocks; b++)
+    {
+      uint64_t len = read_code(bits, block_code) + (b == 0 ? 0 : 1);
+      uint64_t end = std::min<uint64_t>(pos + len, reference.size());
+      if (b % 2 == 0)
+        copied.insert(copied.end(), reference.begin() + pos, reference.begin() + end);
+      pos = end;
+    }
+
+    if (nblocks % 2 == 0)
+      copied.insert(copied.end(), reference.begin() + pos, reference.end());
+  }
+
+  uint64_t extra = outdegree - std::min<uint64_t>(outdegree, copied.size());
+
+  std::vector<uint64_t> intervals;
+  if (extra > 0 && min_interval_length != 0)
+  {
+    uint64_t nintervals = bits.read_gamma();
+    uint64_t prev = 0;
+    for (uint64_t i = 0; i < nintervals; i++)
+    {
+      uint64_t left = i == 0 ? node + nat2int(bits.read_gamma()) : prev + bits.read_gamma() + 1;
+      uint64_t len = bits.read_gamma() + min_interval_length;
+
+      for (uint64_t v = left; v < left + len; v++)
+        intervals.push_back(v);
+
+      prev = left + len;
+      extra -= std::min(extra, len);
+    }
+  }
+
+  std::vector<uint64_t> residuals(extra);
+  for (uint64_t r = 0; r < extra; r++)
+  {
+    uint64_t gap = read_code(bits, residual_code);
+    residuals[r] = r == 0 ? node + nat2int(gap) : residuals[r - 1] + gap + 1;
+  }
+
+  std::vector<uint64_t> merged;
+  merged.reserve(copied.size() + intervals.size());
+  std::merge(copied.begin(), copied.end(), intervals.begin(), intervals.end(), std::back_inserter(merged));
+
+  succ.reserve(outdegree);
+  std::merge(merged.begin(), merged.end(), residuals.begin(), residuals.end(), std::back_inserter(succ));
+}
+
+inline BVGraphReader::BVGraphReader(const BVGraph &graph, uint64_t first, uint64_t last)
+  : graph(&graph), bits(graph.stream()), first(first), last(last), current(first), started(false),
+    window(graph.get_window_size() + 1)
+{
+  if (first < last)
+    bits.seek(graph.offset_of(first));
+}
+
+/*! Decodes the next list, false after the last node of the range */
+inline bool BVGraphReader::next()
+{
+  if (started)
+    current++;
+  started = true;
+
+  if (current >= last)
+    return false;
+
+  graph->decode(bits, current, window[current % window.size()],
+                [this](uint64_t ref_node) -> const std::vector<uint64_t> &
+  {
+    if (ref_node >= first)
+      return window[ref_node % window.size()];
+
+    /* Referenced from the first lists of the range */
+    auto found = lead_in.find(ref_node);
+    if (found == lead_in.end())
+    {
+      found = lead_in.insert(std::make_pair(ref_node, std::vector<uint64_t>())).first;
+      graph->successors(ref_node, found->second);
+    }
+    return found->second;
+  });
+
+  return true;
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_BVGRAPH_HPP__
@@ -0,0 +1,207 @@
+#ifndef GRAPHEE_CODEC_HPP__
+#define GRAPHEE_CODEC_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "snappy/snappy.h"
+
+#ifdef GRAPHEE_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef GRAPHEE_USE_LZ4
+#include <lz4.h>
+#endif
+
+#include "utils.hpp"
+
+namespace graphee
+{
+
+/*! \brief Block compression interface
+ *
+ * A `Codec` compresses one buffer into another one, it is stateless
+ * and thus shared by all threads. The chunked file formats
+ * (`Utils::SNAPPY_CHUNKS`, `Utils::ZSTD` and `Utils::LZ4`) split each
+ * array in independent chunks of about `Codec::chunk_size` bytes,
+ * which are (un)compressed in parallel. They are indexed by a
+ * `BlockHeader`.
+ */
+
+class Codec
+{
+public:
+  virtual ~Codec() {}
+
+  virtual size_t max_compressed_length(size_t length) const = 0;
+  virtual bool compress(const char *in, size_t length, char *out, size_t *out_length) const = 0;
+  virtual bool uncompress(const char *in, size_t length, char *out, size_t out_length) const = 0;
+  virtual std::string codec_name() const = 0;
+
+  static const Codec &get(int fileformat);
+  static bool is_chunked(int fileformat);
+
+  static uint64_t checksum(const char *data, size_t bytes);
+
+  static const size_t chunk_size{1UL << 22}; // 4 MB
+}; // class graphee::Codec
+
+class SnappyCodec : public Codec
+{
+public:
+  size_t max_compressed_length(size_t length) const
+  {
+    return snappy::MaxCompressedLength64(length);
+  }
+
+  bool compress(const char *in, size_t length, char *out, size_t *out_length) const
+  {
+    snappy::RawCompress64(in, length, out, out_length);
+    return true;
+  }
+
+  bool uncompress(const char *in, size_t length, char *out, size_t out_length) const
+  {
+    size_t decoded_length;
+    if (!snappy::GetUncompressedLength(in, length, &decoded_length) || decoded_length != out_length)
+      return false;
+    return snappy::RawUncompress64(in, length, out);
+  }
+
+  std::string codec_name() const
+  {
+    return "SNAPPY";
+  }
+}; // class graphee::SnappyCodec
+
+#ifdef GRAPHEE_USE_ZSTD
+/*! zstd has a better ratio than Snappy, for blocks in cold storage */
+class ZstdCodec : public Codec
+{
+public:
+  ZstdCodec(int compression_level = 3) : level(compression_level) {}
+
+  size_t max_compressed_length(size_t length) const
+  {
+    return ZSTD_compressBound(length);
+  }
+
+  bool compress(const char *in, size_t length, char *out, size_t *out_length) const
+  {
+    size_t ret = ZSTD_compress(out, *out_length, in, length, level);
+    if (ZSTD_isError(ret))
+      return false;
+    *out_length = ret;
+    return true;
+  }
+
+  bool uncompress(const char *in, size_t length, char *out, size_t out_length) const
+  {
+    size_t ret = ZSTD_decompress(out, out_length, in, length);
+    return !ZSTD_isError(ret) && ret == out_length;
+  }
+
+  std::string codec_name() const
+  {
+    return "ZSTD";
+  }
+
+private:
+  const int level;
+}; // class graphee::ZstdCodec
+#endif
+
+#ifdef GRAPHEE_USE_LZ4
+/*! LZ4 decodes faster than Snappy, for blocks reread every iteration */
+class Lz4Codec : public Codec
+{
+public:
+  size_t max_compressed_length(size_t length) const
+  {
+    return LZ4_compressBound(static_cast<int>(length));
+  }
+
+  bool compress(const char *in, size_t length, char *out, size_t *out_length) const
+  {
+    int ret = LZ4_compress_default(in, out, static_cast<int>(length), static_cast<int>(*out_length));
+    if (ret <= 0)
+      return false;
+    *out_length = static_cast<size_t>(ret);
+    return true;
+  }
+
+  bool uncompress(const char *in, size_t length, char *out, size_t out_length) const
+  {
+    int ret = LZ4_decompress_safe(in, out, static_cast<int>(length), static_cast<int>(out_length));
+    return ret >= 0 && static_cast<size_t>(ret) == out_length;
+  }
+
+  std::string codec_name() const
+  {
+    return "LZ4";
+  }
+}; // class graphee::Lz4Codec
+#endif
+
+inline bool Codec::is_chunked(int fileformat)
+{
+  return fileformat == Utils::SNAPPY_CHUNKS || fileformat == Utils::ZSTD
+         || fileformat == Utils::LZ4;
+}
+
+inline const Codec &Codec::get(int fileformat)
+{
+  static const SnappyCodec snappy_codec;
+#ifdef GRAPHEE_USE_ZSTD
+  static const ZstdCodec zstd_codec;
+#endif
+#ifdef GRAPHEE_USE_LZ4
+  static const Lz4Codec lz4_codec;
+#endif
+
+  switch (fileformat)
+  {
+  case Utils::SNAPPY_CHUNKS:
+    return snappy_codec;
+#ifdef GRAPHEE_USE_ZSTD
+  case Utils::ZSTD:
+    return zstd_codec;
+#endif
+#ifdef GRAPHEE_USE_LZ4
+  case Utils::LZ4:
+    return lz4_codec;
+#endif
+  default:
+    std::ostringstream err;
+    err << "No codec available for fileformat " << fileformat
+        << " (is Graphee built with GRAPHEE_USE_ZSTD/GRAPHEE_USE_LZ4 ?)";
+    print_error(err.str());
+    exit(-1);
+  }
+}
+
+/*! CRC32 of `data`, zlib takes at most 4 GB at once */
+inline uint64_t Codec::checksum(const char *data, size_t bytes)
+{
+  uLong crc = crc32(0L, Z_NULL, 0);
+  const size_t step{1UL << 30};
+
+  for (size_t done = 0; done < bytes; done += step)
+  {
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(data + done),
+                static_cast<uInt>(std::min(step, bytes - done)));
+  }
+
+  return crc;
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_CODEC_HPP__
@@ -11,6 +11,10 @@
 #include <mutex>
 #include <condition_variable>
 #include <algorithm>
+#include <map>
+#include <memory>
+
+#include <sys/stat.h>
 
 #include "snappy/snappy.h"
 
@@ -18,6 +22,14 @@
 #include "properties.hpp"
 #include "vector.hpp"
 #include "edgelist.hpp"
+#include "bvgraph.hpp"
+#include "graph_container.hpp"
+#include "block_layout.hpp"
+#include "storage_roots.hpp"
+#include "block_store.hpp"
+#include "block_manifest.hpp"
+#include "block_cache.hpp"
+#include "object_pool.hpp"
 
 #define SORT_NAME gpe
 #define SORT_TYPE uint64_t *
@@ -44,9 +56,17 @@ class DiskSparseMatrix
 public:
   using MatrixType = MatrixT;
 
-  DiskSparseMatrix(Properties *properties) : props(properties) {}
+  /*! Owning handle of a block, its buffers go back to the pool of the
+   * matrix once the last handle is released */
+  using BlockHandle = std::shared_ptr<MatrixT>;
+
+  DiskSparseMatrix(Properties *properties) : props(properties), block_format(Utils::SNAPPY),
+    block_layout(BlockLayout::CSR), orientations(Utils::TRANS), block_store(nullptr), build_failed(false),
+    cache_limit(properties->ram_limit / 2), cache_ready(false), block_pool(make_block_pool(properties)) {}
   DiskSparseMatrix(Properties *properties, std::string matrix_name) : props(properties), name(matrix_name),
-    m(properties->nvertices), n(properties->nvertices)
+    m(properties->nvertices), n(properties->nvertices), block_format(Utils::SNAPPY),
+    block_layout(BlockLayout::CSR), orientations(Utils::TRANS), block_store(nullptr), build_failed(false),
+    cache_limit(properties->ram_limit / 2), cache_ready(false), block_pool(make_block_pool(properties))
   {
     tmpfp = std::vector<std::fstream>(props->nblocks);
   }
@@ -58,10 +78,53 @@ public:
 
   void load_edgelist(std::vector<std::string> &filenames, int ftype = Utils::GZ, int options = Utils::TRANS);
 
-  MatrixT &get_block(uint64_t line, uint64_t col);
+  BlockHandle get_block(uint64_t line, uint64_t col, int orientation = Utils::TRANS);
+  BlockHandle fetch_block(uint64_t line, uint64_t col, int orientation = Utils::TRANS);
+  BlockHandle get_block_rows(uint64_t line, uint64_t col, uint64_t first, uint64_t last,
+                             int orientation = Utils::TRANS);
+
+  bool check_blocks();
 
   bool empty() const;
 
+  /*! File format of the blocks written by `load_edgelist`,
+   * with `Utils::ALIGNED` the blocks are mapped in place by `get_block`
+   */
+  void set_block_format(int fileformat);
+
+  /*! `BlockLayout` of the `SparseBMatrixCSR` blocks written by
+   * `load_edgelist`, `BlockLayout::AUTO` picks it block per block
+   */
+  void set_block_layout(int layout);
+
+  /*! Blocks written from now on are linked to the objects of `store`,
+   * or saved as deltas of the blocks of the snapshot `base_graph` (its
+   * `Properties::name`) when they are close enough. The store is also
+   * needed to read the deltas back.
+   */
+  void set_block_store(BlockStore *store, std::string base_graph = "");
+
+  /*! `BlockStats` of the blocks in `orientation`, written by
+   * `load_edgelist` and read back on first use. The manifest is not
+   * loaded if the blocks were built without one.
+   */
+  const BlockManifest &get_manifest(int orientation = Utils::TRANS);
+
+  /*! Bytes of RAM kept by `fetch_block` for the blocks read by the next
+   * iterations, half of the `ram_limit` by default, 0 reads every block
+   * from disk. See `BlockCache`.
+   */
+  void set_block_cache(uint64_t bytes);
+  BlockCache<MatrixT> &get_block_cache()
+  {
+    return block_cache;
+  }
+
+  ObjectPool<MatrixT> &get_block_pool()
+  {
+    return *block_pool;
+  }
+
   const uint64_t m;
   const uint64_t n;
 
@@ -74,16 +137,55 @@ private:
 
   std::string name;
 
+  int block_format;
+  int block_layout;
+
+  /* `Utils::TRANS` and/or `Utils::DIRECT`, the block sets built by `load_edgelist` */
+  int orientations;
+
+  BlockStore *block_store;
+  std::string base_graph;
+
+  std::map<int, BlockManifest> manifests;
+  bool build_failed; ///< A block of the last `load_edgelist` could not be built
+
+  uint64_t cache_limit;
+  bool cache_ready;
+  std::mutex cache_mtx;
+  BlockCache<MatrixT> block_cache;
+  std::vector<uint64_t> block_nnz;
+
+  std::shared_ptr<ObjectPool<MatrixT>> block_pool;
+  static std::shared_ptr<ObjectPool<MatrixT>> make_block_pool(Properties *props);
+
+  uint64_t block_key(uint64_t line, uint64_t col, int orientation);
+  void prepare_cache();
+  std::shared_ptr<const std::vector<char>> read_block_image(uint64_t line, uint64_t col, int orientation);
+
   void read_and_split_list(std::vector<std::string> &filenames, int ftype = Utils::GZ);
+  template <typename SplitEdge>
+  void read_bvgraphs(std::vector<std::string> &basenames, size_t buf_size, SplitEdge &split_edge);
 
   static void sort_and_save_list(std::vector<uint64_t> &block, uint64_t nelems,
-                                 std::fstream &fp, std::mutex &mtx, uint64_t bid);
+                                 std::fstream &fp, std::mutex &mtx, uint64_t bid, Properties *props);
 
   void diskblock_manager();
   static void diskblock_builder(DiskSparseMatrix<MatrixT> *dmat, uint64_t line, uint64_t col,
                                 std::fstream &tmpfp, std::mutex &mtx, std::condition_variable &cond);
 
-  std::string get_block_filename(uint64_t line, uint64_t col);
+  std::string get_block_filename(uint64_t line, uint64_t col, int orientation = Utils::TRANS);
+  std::string get_block_path(uint64_t line, uint64_t col, int orientation = Utils::TRANS, size_t bytes = 0);
+  std::string get_tmp_filename(uint64_t line, uint64_t col);
+  std::string get_manifest_filename(int orientation);
+  uint64_t get_block_bytes(uint64_t line, uint64_t col, int orientation);
+  void save_manifests();
+  void save_block(MatrixT &mat, uint64_t line, uint64_t col, int orientation = Utils::TRANS);
+  void store_blocks(MatrixT &mat, uint64_t line, uint64_t col, std::mutex &mtx);
+  void prepare_block(MatrixT &mat, uint64_t line, uint64_t col, std::mutex &mtx);
+
+  void store_block(MatrixT &mat, uint64_t line, uint64_t col, int orientation);
+  bool save_delta(MatrixT &mat, uint64_t line, uint64_t col, int orientation);
+  void load_block(MatrixT &mat, const std::string &path);
 
   void open_files(std::ios_base::openmode mode);
   void close_files();
@@ -94,32 +196,425 @@ template <typename MatrixT>
     return props->nslices;
   }
 
+/*! Builds the blocks of the matrix from edgelist files.
+ *
+ * The files are gzipped text edge lists, or with `Utils::BVGRAPH` the
+ * basenames of WebGraph graphs (see `BVGraph`).
+ *
+ * `options` selects the orientations: with `Utils::TRANS` the lines
+ * of the matrix are the targets of the edges (the layout used by the
+ * Pagerank), with `Utils::DIRECT` they are the sources. Both sets of
+ * blocks can be built by a single read of the files, the `Utils::DIRECT`
+ * blocks are the transposed `Utils::TRANS` ones.
+ */
 template <typename MatrixT>
 void DiskSparseMatrix<MatrixT>::load_edgelist(std::vector<std::string> &filenames, int ftype, int options)
 {
+  orientations = options & (Utils::TRANS | Utils::DIRECT);
+  if (orientations == 0)
+  {
+    orientations = Utils::TRANS;
+  }
+
+  /* The cached blocks are the ones being rebuilt */
+  cache_ready = false;
+  block_cache.clear();
+
   read_and_split_list(filenames, ftype);
   diskblock_manager();
 }
 
+/*! Loads the block [line, col] of the matrix in `orientation`,
+ * `Utils::TRANS` or `Utils::DIRECT`
+ */
 template <typename MatrixT>
-MatrixT &DiskSparseMatrix<MatrixT>::get_block(uint64_t line, uint64_t col)
+typename DiskSparseMatrix<MatrixT>::BlockHandle DiskSparseMatrix<MatrixT>::get_block(uint64_t line, uint64_t col,
+    int orientation)
 {
   std::ostringstream oss;
   oss << "Start to load disk block [" << line << ":" << col << "]";
   print_log(oss.str());
 
-  MatrixT& mat = *new MatrixT(props);
-  mat.load(get_block_filename(line, col));
+  prepare_cache();
+  BlockHandle mat = block_pool->acquire(block_nnz[block_key(line, col, orientation)]);
+  if (props->container != nullptr)
+  {
+    mat->load(*props->container, get_block_filename(line, col, orientation));
+  }
+  else
+  {
+    load_block(*mat, get_block_path(line, col, orientation));
+  }
+
+  return mat;
+}
+
+/*! The block [line, col] through the `BlockCache`: a decoded block is
+ * shared with the cache and the next callers, it must not be modified.
+ * The blocks mapped in place (`Utils::ALIGNED`) are left to the page
+ * cache, the deltas are only kept decoded.
+ */
+template <typename MatrixT>
+typename DiskSparseMatrix<MatrixT>::BlockHandle DiskSparseMatrix<MatrixT>::fetch_block(uint64_t line, uint64_t col,
+    int orientation)
+{
+  prepare_cache();
+  if (!block_cache.enabled())
+  {
+    BlockHandle mat = get_block(line, col, orientation);
+    if (!mat->is_mapped())
+      block_cache.count_read(get_block_bytes(line, col, orientation));
+    return mat;
+  }
+
+  uint64_t key = block_key(line, col, orientation);
+  std::string blockname = get_block_filename(line, col, orientation);
+
+  std::shared_ptr<const std::vector<char>> image;
+  BlockHandle mat = block_cache.find(key, image);
+  if (mat != nullptr)
+    return mat;
+
+  bool cached_image = image != nullptr;
+  if (!cached_image)
+    image = read_block_image(line, col, orientation);
+
+  mat = block_pool->acquire(block_nnz[key]);
+  if (image == nullptr)
+  {
+    /* A delta, or a block mapped in place */
+    if (props->container != nullptr)
+      mat->load(*props->container, blockname);
+    else
+      load_block(*mat, get_block_path(line, col, orientation));
+
+    if (mat->is_mapped())
+      return mat;
+    block_cache.count_read(get_block_bytes(line, col, orientation));
+  }
+  else
+  {
+    MemoryStream matfp(image->data(), image->size());
+    mat->load(matfp, blockname);
+  }
+
+  if (!cached_image)
+  {
+    uint64_t bytes = (mat->get_lines() + 1 + mat->get_nonzeros()) * sizeof(uint64_t);
+    block_cache.insert(key, mat, bytes);
+    if (image != nullptr)
+      block_cache.insert(key, image);
+  }
+  return mat;
+}
+
+/*! Bytes of the block file or extent, `nullptr` for a delta or for an
+ * `Utils::ALIGNED` block
+ */
+template <typename MatrixT>
+std::shared_ptr<const std::vector<char>> DiskSparseMatrix<MatrixT>::read_block_image(uint64_t line, uint64_t col,
+    int orientation)
+{
+  auto is_aligned = [](std::istream &matfp)
+  {
+    size_t typename_size = 0;
+    int packed_format = 0;
+    matfp.read(reinterpret_cast<char *>(&typename_size), sizeof(size_t));
+    matfp.ignore(typename_size);
+    matfp.read(reinterpret_cast<char *>(&packed_format), sizeof(int));
+    return BlockLayout::format_of(packed_format) == Utils::ALIGNED;
+  };
+
+  std::shared_ptr<std::vector<char>> image = std::make_shared<std::vector<char>>();
+  if (props->container != nullptr)
+  {
+    MappedFile extent = props->container->map(get_block_filename(line, col, orientation));
+    MemoryStream matfp(extent.data(), extent.size());
+    if (is_aligned(matfp))
+      return nullptr;
+
+    image->assign(extent.data(), extent.data() + extent.size());
+  }
+  else
+  {
+    std::string blockpath = get_block_path(line, col, orientation);
+    if (block_store != nullptr && BlockDelta::is_delta(blockpath))
+      return nullptr;
+
+    std::ifstream matfp(blockpath, std::ios_base::binary);
+    if (is_aligned(matfp))
+      return nullptr;
+
+    matfp.seekg(0, matfp.end);
+    image->resize(matfp.tellg());
+    matfp.seekg(0, matfp.beg);
+    matfp.read(image->data(), image->size());
+  }
+
+  block_cache.count_read(image->size());
+  return image;
+}
+
+/*! Sized on the manifest at the first read, else on the number of
+ * blocks; the number of elements of each block is kept for the pool
+ */
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::prepare_cache()
+{
+  std::lock_guard<std::mutex> lock(cache_mtx);
+  if (cache_ready)
+    return;
+
+  uint64_t image_bytes = 0;
+  uint64_t nblocks = 0;
+  block_nnz.assign(2 * props->nslices * props->nslices, 0);
+  for (int orientation : {Utils::TRANS, Utils::DIRECT})
+  {
+    if ((orientations & orientation) == 0)
+      continue;
+
+    const BlockManifest &manifest = get_manifest(orientation);
+    for (uint64_t line = 0; line < props->nslices; line++)
+    {
+      for (uint64_t col = 0; col < props->nslices; col++)
+      {
+        image_bytes += manifest.is_loaded() ? manifest.get(line, col).bytes : 0;
+        nblocks += manifest.is_empty(line, col) ? 0 : 1;
+        block_nnz[block_key(line, col, orientation)] = manifest.is_loaded() ? manifest.get(line, col).nnz : 0;
+      }
+    }
+  }
+
+  block_cache.reset(cache_limit, image_bytes, nblocks);
+  cache_ready = true;
+}
+
+/*! Blocks of both orientations, `Utils::DIRECT` ones after the others */
+template <typename MatrixT>
+uint64_t DiskSparseMatrix<MatrixT>::block_key(uint64_t line, uint64_t col, int orientation)
+{
+  return (orientation == Utils::DIRECT ? props->nslices * props->nslices : 0) + line * props->nslices + col;
+}
+
+/*! Enough idle blocks for the blocks read ahead by all the threads */
+template <typename MatrixT>
+std::shared_ptr<ObjectPool<MatrixT>> DiskSparseMatrix<MatrixT>::make_block_pool(Properties *props)
+{
+  size_t max_idle = 4 * std::max<size_t>(props->nthreads, std::thread::hardware_concurrency());
+  return ObjectPool<MatrixT>::create([props]() { return new MatrixT(props); },
+                                     [](MatrixT &mat) { return mat.get_nonzeros(); }, max_idle);
+}
+
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::set_block_cache(uint64_t bytes)
+{
+  std::lock_guard<std::mutex> lock(cache_mtx);
+  cache_limit = bytes;
+  cache_ready = false;
+}
+
+/*! Loads the lines [first, last) of a block, relative to the block,
+ * the blocks must be saved with a chunked format
+ */
+template <typename MatrixT>
+typename DiskSparseMatrix<MatrixT>::BlockHandle DiskSparseMatrix<MatrixT>::get_block_rows(uint64_t line, uint64_t col,
+    uint64_t first, uint64_t last, int orientation)
+{
+  std::ostringstream oss;
+  oss << "Start to load lines [" << first << ";" << last << ") of disk block [" << line << ":" << col << "]";
+  print_log(oss.str());
+
+  std::string blockname = get_block_filename(line, col, orientation);
+  BlockHandle mat = block_pool->acquire();
+  if (props->container != nullptr)
+  {
+    MappedStream matfp(props->container->map(blockname));
+    mat->load_rows(matfp, blockname, first, last);
+  }
+  else
+  {
+    mat->load_rows(get_block_path(line, col, orientation), first, last);
+  }
 
   return mat;
 }
 
+/*! Verifies the checksums of every block, without uncompressing them */
+template <typename MatrixT>
+bool DiskSparseMatrix<MatrixT>::check_blocks()
+{
+  MatrixT mat(props);
+  bool valid = true;
+
+  for (int orientation : {Utils::TRANS, Utils::DIRECT})
+  {
+    if ((orientations & orientation) == 0)
+      continue;
+
+    for (uint64_t line = 0; line < props->nslices; line++)
+    {
+      for (uint64_t col = 0; col < props->nslices; col++)
+      {
+        std::string blockname = get_block_filename(line, col, orientation);
+        if (props->container != nullptr)
+        {
+          MappedStream matfp(props->container->map(blockname));
+          valid = mat.check_integrity(matfp, blockname) && valid;
+        }
+        else
+        {
+          /* The object of a delta is checked instead */
+          std::string blockpath = get_block_path(line, col, orientation);
+          if (block_store != nullptr && BlockDelta::is_delta(blockpath))
+          {
+            BlockDelta delta;
+            delta.load(blockpath);
+            blockpath = block_store->object_path(delta.base_key);
+          }
+          valid = mat.check_integrity(blockpath) && valid;
+        }
+      }
+    }
+  }
+
+  return valid;
+}
+
 template <typename MatrixT>
 bool DiskSparseMatrix<MatrixT>::empty() const
 {
   return (props == nullptr);
 }
 
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::set_block_format(int fileformat)
+{
+  block_format = fileformat;
+}
+
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::set_block_store(BlockStore *store, std::string base)
+{
+  block_store = store;
+  base_graph = base;
+}
+
+template <typename MatrixT>
+const BlockManifest &DiskSparseMatrix<MatrixT>::get_manifest(int orientation)
+{
+  auto found = manifests.find(orientation);
+  if (found == manifests.end())
+  {
+    BlockManifest manifest(props->nslices);
+    std::string manifestname = get_manifest_filename(orientation);
+
+    if (props->container != nullptr)
+      manifest.load(*props->container, manifestname);
+    else
+      manifest.load(storage_path(props, manifestname, StorageRoots::BLOCK, 0));
+
+    found = manifests.insert(std::make_pair(orientation, std::move(manifest))).first;
+  }
+
+  return found->second;
+}
+
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::set_block_layout(int layout)
+{
+  block_layout = layout;
+}
+
+/*! Last changes before a block is saved, nothing by default */
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::prepare_block(MatrixT &mat, uint64_t line, uint64_t col, std::mutex &mtx)
+{
+}
+
+/*! Converts the block to `block_layout`, mapped blocks are read in place
+ * and stay in CSR
+ */
+template <>
+inline void DiskSparseMatrix<SparseBMatrixCSR>::prepare_block(SparseBMatrixCSR &mat, uint64_t line, uint64_t col,
+    std::mutex &mtx)
+{
+  if (block_layout != BlockLayout::CSR && block_format != Utils::ALIGNED)
+  {
+    mat.convert(block_layout);
+
+    mtx.lock();
+    std::ostringstream log;
+    log << "Block [" << line << ";" << col << "] stored as " << BlockLayout::name(mat.get_layout());
+    print_log(log.str());
+    mtx.unlock();
+  }
+}
+
+/*! Computes the delta against the object of the block of the base
+ * snapshot, the base block is added to the store if it is not shared yet
+ */
+template <>
+inline bool DiskSparseMatrix<SparseBMatrixCSR>::save_delta(SparseBMatrixCSR &mat, uint64_t line, uint64_t col,
+    int orientation)
+{
+  std::string blockname = get_block_filename(line, col, orientation);
+  std::string basename = base_graph + blockname.substr(props->name.size());
+  int kind = orientation == Utils::DIRECT ? StorageRoots::DIRECT_BLOCK : StorageRoots::BLOCK;
+  std::string basepath = storage_path(props, basename, kind, line + col);
+
+  std::string base_key;
+  SparseBMatrixCSR base(props);
+
+  if (BlockDelta::is_delta(basepath))
+  {
+    BlockDelta base_delta;
+    base_delta.load(basepath);
+    base_key = base_delta.base_key;
+  }
+  else
+  {
+    std::vector<char> image;
+    if (!BlockStore::read_file(basepath, image) || !block_store->put(image, base_key))
+      return false;
+    block_store->link(base_key, basepath);
+  }
+
+  base.load(block_store->object_path(base_key));
+  if (base.get_lines() != mat.get_lines() || base.get_columns() != mat.get_columns())
+    return false;
+
+  std::vector<uint64_t> keys = mat.element_keys();
+  BlockDelta delta;
+  if (!BlockDelta::diff(base.element_keys(), keys, static_cast<uint64_t>(block_store->max_delta * keys.size()), delta))
+    return false;
+
+  delta.base_key = base_key;
+  delta.layout = mat.get_layout();
+  block_store->delta_bytes += delta.save(get_block_path(line, col, orientation));
+  return true;
+}
+
+/*! The delta is applied to the elements of its object, the block gets
+ * back the layout it was saved with
+ */
+template <>
+inline void DiskSparseMatrix<SparseBMatrixCSR>::load_block(SparseBMatrixCSR &mat, const std::string &path)
+{
+  if (block_store == nullptr || !BlockDelta::is_delta(path))
+  {
+    mat.load(path);
+    return;
+  }
+
+  BlockDelta delta;
+  delta.load(path);
+  mat.load(block_store->object_path(delta.base_key));
+  mat.assign_keys(delta.apply(mat.element_keys()));
+
+  if (delta.layout != BlockLayout::CSR)
+    mat.convert(delta.layout);
+}
+
 /*! Reads the raw edgelist files
  *  Including some in GNU Zip format
  *
@@ -148,57 +643,70 @@ void DiskSparseMatrix<MatrixT>::read_and_split_list(std::vector<std::string> &fi
   uint64_t block_id, from_id, to_id;
   open_files(std::ios_base::out | std::ios_base::binary);
 
-  std::stringstream in_stream;
-  std::stringstream out_stream;
+  /* `from_id` is the target of the edge, the line of its block */
+  auto split_edge = [&](uint64_t from_id, uint64_t to_id)
+  {
+    block_id = from_id / props->window + to_id / props->window * props->nslices;
 
-  uint64_t nsec = 0;
+    if (edglst_pos[block_id] < maxElemsPerSortBlock - 1)
+    {
+      edglst_in[block_id][edglst_pos[block_id]] = from_id;
+      edglst_in[block_id][edglst_pos[block_id] + 1] = to_id;
+      edglst_pos[block_id] += 2;
+    }
+    else
+    {
+      write_mtxs[block_id].lock();
+      std::swap(edglst_in[block_id], edglst_out[block_id]);
 
-  const size_t buf_size {1UL << 29}; // 512 MB
-  Edgelist edglst(props, &read_mtx, buf_size, filenames);
+      std::thread sort_write_thread(sort_and_save_list, std::ref(edglst_out[block_id]),
+                                    edglst_pos[block_id], std::ref(tmpfp[block_id]), std::ref(write_mtxs[block_id]), block_id,
+                                    props);
+      sort_write_thread.detach();
 
-  edglst.read(in_stream);
+      edglst_in[block_id][0] = from_id;
+      edglst_in[block_id][1] = to_id;
+      edglst_pos[block_id] = 2;
+    }
+  };
+
+  const size_t buf_size {1UL << 29}; // 512 MB
 
-  while (true)
+  if (ftype == Utils::BVGRAPH)
+  {
+    read_bvgraphs(filenames, buf_size, split_edge);
+  }
+  else
   {
-    read_mtx.lock();
-    std::swap(in_stream, out_stream);
-    read_mtx.unlock();
+    std::stringstream in_stream;
+    std::stringstream out_stream;
+
+    Edgelist edglst(props, &read_mtx, buf_size, filenames);
 
-    if (!edglst.read(in_stream))
-      break;
+    edglst.read(in_stream);
 
-    while (!out_stream.eof())
+    while (true)
     {
-      out_stream >> to_id >> from_id;
-      if (to_id == from_id)
-        continue; // oriented graph !
+      read_mtx.lock();
+      std::swap(in_stream, out_stream);
+      read_mtx.unlock();
 
-      block_id = from_id / props->window + to_id / props->window * props->nslices;
+      if (!edglst.read(in_stream))
+        break;
 
-      if (edglst_pos[block_id] < maxElemsPerSortBlock - 1)
-      {
-        edglst_in[block_id][edglst_pos[block_id]] = from_id;
-        edglst_in[block_id][edglst_pos[block_id] + 1] = to_id;
-        edglst_pos[block_id] += 2;
-      }
-      else
+      while (!out_stream.eof())
       {
-        write_mtxs[block_id].lock();
-        std::swap(edglst_in[block_id], edglst_out[block_id]);
-
-        std::thread sort_write_thread(sort_and_save_list, std::ref(edglst_out[block_id]),
-                                      edglst_pos[block_id], std::ref(tmpfp[block_id]), std::ref(write_mtxs[block_id]), block_id);
-        sort_write_thread.detach();
+        out_stream >> to_id >> from_id;
+        if (to_id == from_id)
+          continue; // oriented graph !
 
-        edglst_in[block_id][0] = from_id;
-        edglst_in[block_id][1] = to_id;
-        edglst_pos[block_id] = 2;
+        split_edge(from_id, to_id);
       }
-    }
 
-    std::ostringstream oss;
-    oss << "Sorted a part of file \'" << edglst.get_filename() << "\'";
-    print_strong_log(oss.str());
+      std::ostringstream oss;
+      oss << "Sorted a part of file \'" << edglst.get_filename() << "\'";
+      print_strong_log(oss.str());
+    }
   }
 
   std::vector<std::thread> sort_write_threads;
@@ -208,7 +716,7 @@ void DiskSparseMatrix<MatrixT>::read_and_split_list(std::vector<std::string> &fi
     {
       write_mtxs[i].lock();
       sort_write_threads.push_back(std::thread (sort_and_save_list, std::ref(edglst_in[i]),
-                                   edglst_pos[i], std::ref(tmpfp[i]), std::ref(write_mtxs[i]), i));
+                                   edglst_pos[i], std::ref(tmpfp[i]), std::ref(write_mtxs[i]), i, props));
     }
   }
 
@@ -220,9 +728,85 @@ void DiskSparseMatrix<MatrixT>::read_and_split_list(std::vector<std::string> &fi
   close_files();
 }
 
+/*! Reads the successor lists of WebGraph graphs, the ranges of nodes
+ * of `BVGraph::split()` are decoded by `props->nthreads` threads while
+ * the edges decoded before are split into the blocks
+ */
+template <typename MatrixT>
+template <typename SplitEdge>
+void DiskSparseMatrix<MatrixT>::read_bvgraphs(std::vector<std::string> &basenames, size_t buf_size,
+    SplitEdge &split_edge)
+{
+  for (const std::string &basename : basenames)
+  {
+    BVGraph graph(basename);
+    if (graph.get_nodes() > props->nvertices)
+    {
+      std::ostringstream err;
+      err << "The graph \'" << basename << "\' has " << graph.get_nodes() << " nodes, more than "
+          << props->nvertices;
+      print_error(err.str());
+      exit(-1);
+    }
+
+    std::vector<uint64_t> starts = graph.split(props->nthreads);
+    const uint64_t nparts = starts.size() - 1;
+
+    std::vector<BVGraphReader> readers;
+    for (uint64_t p = 0; p < nparts; p++)
+    {
+      readers.push_back(BVGraphReader(graph, starts[p], starts[p + 1]));
+    }
+
+    /* Pairs (source, target), two sets of buffers of `buf_size` bytes */
+    const size_t max_elems = std::max<size_t>(buf_size / (2 * nparts * sizeof(uint64_t)), 2);
+    std::vector<std::vector<uint64_t>> decoded(nparts), next_decoded(nparts);
+
+    auto decode = [&readers, max_elems](std::vector<std::vector<uint64_t>> &edges)
+    {
+      #pragma omp parallel for num_threads(edges.size()) schedule(static, 1)
+      for (uint64_t p = 0; p < edges.size(); p++)
+      {
+        edges[p].clear();
+        while (edges[p].size() < max_elems && readers[p].next())
+        {
+          for (uint64_t succ : readers[p].successors())
+          {
+            edges[p].push_back(readers[p].node());
+            edges[p].push_back(succ);
+          }
+        }
+      }
+    };
+
+    decode(decoded);
+
+    while (std::any_of(decoded.begin(), decoded.end(), [](const std::vector<uint64_t> &e) { return !e.empty(); }))
+    {
+      std::thread decode_thread(decode, std::ref(next_decoded));
+
+      for (const std::vector<uint64_t> &edges : decoded)
+      {
+        for (size_t e = 0; e < edges.size(); e += 2)
+        {
+          if (edges[e] != edges[e + 1])
+            split_edge(edges[e + 1], edges[e]);
+        }
+      }
+
+      decode_thread.join();
+      std::swap(decoded, next_decoded);
+
+      std::ostringstream oss;
+      oss << "Sorted a part of graph \'" << basename << "\'";
+      print_strong_log(oss.str());
+    }
+  }
+}
+
 template <typename MatrixT>
 void DiskSparseMatrix<MatrixT>::sort_and_save_list(std::vector<uint64_t> &block, uint64_t nelems,
-    std::fstream &ofp, std::mutex &mtx, uint64_t bid)
+    std::fstream &ofp, std::mutex &mtx, uint64_t bid, Properties *props)
 {
   if (nelems % 2 != 0)
   {
@@ -239,7 +823,12 @@ void DiskSparseMatrix<MatrixT>::sort_and_save_list(std::vector<uint64_t> &block,
 
   gpe_heap_sort(edgeptrs, nedges);
 
-  ofp.write(reinterpret_cast<const char *>(block.data()), sizeof(uint64_t) * nelems);
+  {
+    /* bid = line + col * nslices */
+    StorageStream stream(props->storage,
+                         storage_root(props, "", StorageRoots::SPILL, bid % props->nslices + bid / props->nslices));
+    ofp.write(reinterpret_cast<const char *>(block.data()), sizeof(uint64_t) * nelems);
+  }
 
   mtx.unlock();
 
@@ -259,6 +848,14 @@ void DiskSparseMatrix<MatrixT>::diskblock_manager()
   size_t ram_limit{props->ram_limit};
   uint64_t block_id;
 
+  build_failed = false;
+  manifests.clear();
+  for (int orientation : {Utils::TRANS, Utils::DIRECT})
+  {
+    if (orientations & orientation)
+      manifests[orientation].reset(props->nslices);
+  }
+
   for (uint64_t line = 0; line < props->nslices; line++)
   {
     for (uint64_t col = 0; col < props->nslices; col++)
@@ -276,6 +873,32 @@ void DiskSparseMatrix<MatrixT>::diskblock_manager()
   }
 
   close_files();
+
+  /* The manifests would skip the blocks which were not built */
+  if (build_failed)
+  {
+    std::ostringstream err;
+    err << "Some blocks of \'" << name << "\' were not built, the matrix has no manifest";
+    print_error(err.str());
+    manifests.clear();
+    for (int orientation : {Utils::TRANS, Utils::DIRECT})
+    {
+      if (!(orientations & orientation))
+        continue;
+      manifests.insert(std::make_pair(orientation, BlockManifest(props->nslices)));
+      if (props->container == nullptr)
+        std::remove(storage_path(props, get_manifest_filename(orientation), StorageRoots::BLOCK, 0).c_str());
+    }
+  }
+  else
+  {
+    save_manifests();
+  }
+
+  if (props->container != nullptr)
+  {
+    props->container->commit();
+  }
 }
 
 template <typename MatrixT>
@@ -291,8 +914,10 @@ void DiskSparseMatrix<MatrixT>::diskblock_builder(DiskSparseMatrix<MatrixT> *dma
   uint64_t nnz = filelen / (2 * sizeof(uint64_t));
   uint64_t nsections = filelen / props->sort_limit + (filelen % props->sort_limit == 0 ? 0 : 1);
 
+  /* The transposition needs a second block */
   size_t alloc_needs =
-  {(props->window + 1 + nnz) * sizeof(uint64_t) + nnz * sizeof(typename MatrixT::ValueType)};
+  {((props->window + 1 + nnz) * sizeof(uint64_t) + nnz * sizeof(typename MatrixT::ValueType))
+   * (dmat->orientations & Utils::DIRECT ? 2 : 1)};
 
   if (alloc_needs > props->ram_limit)
   {
@@ -303,6 +928,7 @@ void DiskSparseMatrix<MatrixT>::diskblock_builder(DiskSparseMatrix<MatrixT> *dma
     err.str("");
     err << "which is more memory than \'ram_limit\' " << props->ram_limit / (1UL << 30) << "GB";
     print_error(err.str());
+    dmat->build_failed = true;
     mtx.unlock();
     return; // not exit(-1); because we are within a thread
   }
@@ -339,6 +965,11 @@ void DiskSparseMatrix<MatrixT>::diskblock_builder(DiskSparseMatrix<MatrixT> *dma
   uint64_t offl = line * props->window;
   uint64_t offc = col * props->window;
 
+  /* The spill run is merged while holding a stream of its drive */
+  uint64_t spill_root = storage_root(props, dmat->get_tmp_filename(line, col), StorageRoots::SPILL, line + col);
+  if (props->storage != nullptr)
+    props->storage->acquire(spill_root);
+
   uint64_t nb = 0;
 
   while (currentid < (line + 1) * props->window)
@@ -380,13 +1011,19 @@ void DiskSparseMatrix<MatrixT>::diskblock_builder(DiskSparseMatrix<MatrixT> *dma
     currentid = minid;
   }
 
+  if (props->storage != nullptr)
+    props->storage->release(spill_root);
+
   if (!mat.verify())
   {
     mtx.lock();
     std::ostringstream err;
     err << "Block [" << line << ";" << col << "] conversion to \'" << mat.matrix_typename << "\' failed !";
     print_error(err.str());
+    dmat->build_failed = true;
+    dmat->props->alloc_memory -= alloc_needs;
     mtx.unlock();
+    cond.notify_one();
     return;
   }
   else
@@ -398,7 +1035,7 @@ void DiskSparseMatrix<MatrixT>::diskblock_builder(DiskSparseMatrix<MatrixT> *dma
     mtx.unlock();
   }
 
-  mat.save(dmat->get_block_filename(line, col), Utils::SNAPPY);
+  dmat->store_blocks(mat, line, col, mtx);
 
   dmat->props->alloc_memory -= alloc_needs;
   cond.notify_one();
@@ -418,7 +1055,8 @@ void DiskSparseMatrix<SparseBMatrixCSR>::diskblock_builder(DiskSparseMatrix<Spar
   uint64_t nnz = filelen / (2 * sizeof(uint64_t));
   uint64_t nsections = filelen / props->sort_limit + (filelen % props->sort_limit == 0 ? 0 : 1);
 
-  size_t alloc_needs {(props->window + 1 + nnz) * sizeof(uint64_t)};
+  /* The transposition needs a second block */
+  size_t alloc_needs {(props->window + 1 + nnz) * sizeof(uint64_t) * (dmat->orientations & Utils::DIRECT ? 2 : 1)};
 
   if (alloc_needs > props->ram_limit)
   {
@@ -429,6 +1067,7 @@ void DiskSparseMatrix<SparseBMatrixCSR>::diskblock_builder(DiskSparseMatrix<Spar
     err.str("");
     err << "which is more memory than \'ram_limit\' " << props->ram_limit / (1UL << 30) << "GB";
     print_error(err.str());
+    dmat->build_failed = true;
     mtx.unlock();
     return; // not exit(-1); because we are within a thread
   }
@@ -465,6 +1104,11 @@ void DiskSparseMatrix<SparseBMatrixCSR>::diskblock_builder(DiskSparseMatrix<Spar
   uint64_t offl = line * props->window;
   uint64_t offc = col * props->window;
 
+  /* The spill run is merged while holding a stream of its drive */
+  uint64_t spill_root = storage_root(props, dmat->get_tmp_filename(line, col), StorageRoots::SPILL, line + col);
+  if (props->storage != nullptr)
+    props->storage->acquire(spill_root);
+
   while (currentid < (line + 1) * props->window)
   {
     minid = (line + 1) * props->window;
@@ -503,13 +1147,19 @@ void DiskSparseMatrix<SparseBMatrixCSR>::diskblock_builder(DiskSparseMatrix<Spar
     currentid = minid;
   }
 
+  if (props->storage != nullptr)
+    props->storage->release(spill_root);
+
   if (!mat.verify())
   {
     mtx.lock();
     std::ostringstream err;
     err << "Block [" << line << ";" << col << "] conversion to \'" << mat.matrix_typename << "\' failed !";
     print_error(err.str());
+    dmat->build_failed = true;
+    dmat->props->alloc_memory -= alloc_needs;
     mtx.unlock();
+    cond.notify_one();
     return;
   }
   else
@@ -521,38 +1171,213 @@ void DiskSparseMatrix<SparseBMatrixCSR>::diskblock_builder(DiskSparseMatrix<Spar
     mtx.unlock();
   }
 
-  mat.save(dmat->get_block_filename(line, col), Utils::SNAPPY);
+  dmat->store_blocks(mat, line, col, mtx);
 
   dmat->props->alloc_memory -= alloc_needs;
   cond.notify_one();
 }
 
 template <typename MatrixT>
-std::string DiskSparseMatrix<MatrixT>::get_block_filename(uint64_t line, uint64_t col)
+std::string DiskSparseMatrix<MatrixT>::get_block_filename(uint64_t line, uint64_t col, int orientation)
 {
   std::ostringstream matrixname;
-  matrixname << props->name << "_" << name << "_dmatblk_" << line << "_" << col << ".gpe";
+  matrixname << props->name << "_" << name << (orientation == Utils::DIRECT ? "_dmatdirblk_" : "_dmatblk_")
+             << line << "_" << col << ".gpe";
   return matrixname.str();
 }
 
+/*! File of the block on its storage root, `bytes` is its expected size */
 template <typename MatrixT>
-void DiskSparseMatrix<MatrixT>::open_files(std::ios_base::openmode mode)
+std::string DiskSparseMatrix<MatrixT>::get_block_path(uint64_t line, uint64_t col, int orientation, size_t bytes)
 {
-  std::ostringstream blockname;
+  int kind = orientation == Utils::DIRECT ? StorageRoots::DIRECT_BLOCK : StorageRoots::BLOCK;
+  return storage_path(props, get_block_filename(line, col, orientation), kind, line + col, bytes);
+}
 
+template <typename MatrixT>
+std::string DiskSparseMatrix<MatrixT>::get_tmp_filename(uint64_t line, uint64_t col)
+{
+  std::ostringstream tmpname;
+  tmpname << props->name << "_" << name << "_tmpblk_" << line << "_" << col << ".gpe";
+  return tmpname.str();
+}
+
+template <typename MatrixT>
+std::string DiskSparseMatrix<MatrixT>::get_manifest_filename(int orientation)
+{
+  std::ostringstream manifestname;
+  manifestname << props->name << "_" << name
+               << (orientation == Utils::DIRECT ? "_dmatdirmanifest" : "_dmatmanifest") << ".gpe";
+  return manifestname.str();
+}
+
+/*! Size of the saved block, of its delta with a `BlockStore` */
+template <typename MatrixT>
+uint64_t DiskSparseMatrix<MatrixT>::get_block_bytes(uint64_t line, uint64_t col, int orientation)
+{
+  if (props->container != nullptr)
+    return props->container->size_of(get_block_filename(line, col, orientation));
+
+  struct stat st;
+  if (stat(get_block_path(line, col, orientation).c_str(), &st) != 0)
+    return 0;
+  return static_cast<uint64_t>(st.st_size);
+}
+
+/*! Writes the manifests of the blocks built by `load_edgelist`, the
+ * manifest of a matrix is on the first storage root
+ */
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::save_manifests()
+{
+  for (const auto &manifest : manifests)
+  {
+    std::string manifestname = get_manifest_filename(manifest.first);
+    if (props->container != nullptr)
+      manifest.second.save(*props->container, manifestname);
+    else
+      manifest.second.save(storage_path(props, manifestname, StorageRoots::BLOCK, 0));
+  }
+}
+
+/*! Writes a block to its file, or to the container of the graph */
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::save_block(MatrixT &mat, uint64_t line, uint64_t col, int orientation)
+{
+  if (props->container != nullptr)
+  {
+    mat.save(*props->container, get_block_filename(line, col, orientation), block_format);
+  }
+  else
+  {
+    std::string blockname = get_block_filename(line, col, orientation);
+    int kind = orientation == Utils::DIRECT ? StorageRoots::DIRECT_BLOCK : StorageRoots::BLOCK;
+
+    StorageStream stream(props->storage, storage_root(props, blockname, kind, line + col, mat.size()));
+    if (block_store != nullptr)
+    {
+      store_block(mat, line, col, orientation);
+    }
+    else
+    {
+      mat.save(get_block_path(line, col, orientation), block_format);
+    }
+  }
+}
+
+/*! Links the block to an identical object of the store, or saves it as
+ * a delta of the base snapshot, or adds it to the store
+ */
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::store_block(MatrixT &mat, uint64_t line, uint64_t col, int orientation)
+{
+  std::vector<char> image;
+  BlockWriter matfp(&image);
+  mat.save(matfp, block_format);
+  matfp.close();
+
+  std::string blockpath = get_block_path(line, col, orientation);
+  std::string key;
+  std::ostringstream log;
+  log << "Block [" << line << ";" << col << "] ";
+
+  if (block_store->find(image, key) && block_store->link(key, blockpath))
+  {
+    block_store->reused_bytes += image.size();
+    log << "linked to the object \'" << key << "\'";
+  }
+  else if (!base_graph.empty() && save_delta(mat, line, col, orientation))
+  {
+    log << "saved as a delta of \'" << base_graph << "\'";
+  }
+  else if (block_store->put(image, key) && block_store->link(key, blockpath))
+  {
+    log << "stored as the object \'" << key << "\'";
+  }
+  else
+  {
+    /* Key collision or other file system, the block is not shared */
+    mat.save(blockpath, block_format);
+    log << "saved outside of the store";
+  }
+  print_log(log.str());
+}
+
+/*! Only the `SparseBMatrixCSR` blocks have deltas */
+template <typename MatrixT>
+bool DiskSparseMatrix<MatrixT>::save_delta(MatrixT &, uint64_t, uint64_t, int)
+{
+  return false;
+}
+
+/*! Loads a block file, or rebuilds a block saved as a delta */
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::load_block(MatrixT &mat, const std::string &path)
+{
+  if (block_store != nullptr && BlockDelta::is_delta(path))
+  {
+    std::ostringstream err;
+    err << "\'" << path << "\' is a delta, only \'SparseBMatrixCSR\' blocks have deltas";
+    print_error(err.str());
+    exit(-1);
+  }
+  mat.load(path);
+}
+
+/*! Saves the built block [line, col] in the requested orientations,
+ * the `Utils::DIRECT` block [col, line] is its transposition
+ */
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::store_blocks(MatrixT &mat, uint64_t line, uint64_t col, std::mutex &mtx)
+{
+  /* Counted on the CSR block, before `prepare_block` */
+  BlockStats block_stats = mat.stats();
+
+  if (orientations & Utils::DIRECT)
+  {
+    MatrixT tmat = mat.transpose();
+    prepare_block(tmat, col, line, mtx);
+    save_block(tmat, col, line, Utils::DIRECT);
+
+    BlockStats tstats = block_stats.transposed();
+    tstats.bytes = get_block_bytes(col, line, Utils::DIRECT);
+
+    mtx.lock();
+    manifests.at(static_cast<int>(Utils::DIRECT)).set(col, line, tstats);
+    std::ostringstream log;
+    log << "Block [" << col << ";" << line << "] transposed";
+    print_log(log.str());
+    mtx.unlock();
+  }
+
+  if (orientations & Utils::TRANS)
+  {
+    prepare_block(mat, line, col, mtx);
+    save_block(mat, line, col, Utils::TRANS);
+
+    block_stats.bytes = get_block_bytes(line, col, Utils::TRANS);
+
+    mtx.lock();
+    manifests.at(static_cast<int>(Utils::TRANS)).set(line, col, block_stats);
+    mtx.unlock();
+  }
+}
+
+template <typename MatrixT>
+void DiskSparseMatrix<MatrixT>::open_files(std::ios_base::openmode mode)
+{
   for (uint64_t line = 0; line < props->nslices; line++)
   {
     for (uint64_t col = 0; col < props->nslices; col++)
     {
       uint64_t bid = line + col * props->nslices;
-      blockname.str("");
-      blockname << props->name << "_" << name << "_tmpblk_" << line << "_" << col << ".gpe";
-      tmpfp[bid].open(blockname.str(), mode);
+      std::string tmpname = storage_path(props, get_tmp_filename(line, col), StorageRoots::SPILL, line + col);
+      tmpfp[bid].open(tmpname, mode);
 
       if (!tmpfp[bid].is_open())
       {
         std::ostringstream err;
-        err << "Could not open file: " << blockname.str();
+        err << "Could not open file: " << tmpname;
         print_error(err.str());
         exit(-1);
       }
@@ -6,11 +6,27 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 
 #include <cstdio>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "disk_sparse_matrix.hpp"
 #include "vector.hpp"
+#include "storage_roots.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "prefetcher.hpp"
+#include "write_behind.hpp"
+#include "object_pool.hpp"
+#include "block_schedule.hpp"
 
 /* \brief Vector saved by slices within disk
  *
@@ -19,44 +35,164 @@
  * In such cases either sparse or dense vector could be written,
  * on the disk.
  *
+ * With the `Utils::MAPPED` format, the vector is a single file mapped in
+ * read-write, `<graph>_<vector>_dvecmap.gpe`: a header page (typename,
+ * format, `uint64_t` nslices and window) then the raw values, slice
+ * after slice. `view_slice()` then gives the values in place, without
+ * allocation nor copy, and `commit()` syncs the file once per operation.
+ *
+ * A new vector, or one reset by `fill()`, is a constant: its slices are
+ * only written by their first save. `swap()` exchanges the files of two
+ * vectors without touching them, `settle()` gives them back their own
+ * files, e.g. before they are read by another program.
+ *
+ * The products read the blocks, and the slices they multiply, on I/O
+ * threads `set_prefetch_depth()` blocks ahead of the block being
+ * multiplied, see `Prefetcher`.
+ *
+ * With `set_write_behind()` the slices are compressed and written by a
+ * `WriteBehind` queue while the operators compute the next ones. A slice
+ * read back waits for its own write, `barrier()` for all of them.
  */
 
 namespace graphee {
 
 template <typename VectorT> class DiskVector {
 public:
-  DiskVector() : props(nullptr) {}
+  DiskVector() : props(nullptr), slice_format(Utils::BIN), reference(nullptr),
+                 constant_value(0), mapped(false), prefetch_depth(1),
+        block_order(BlockSchedule::AUTO), schedule_budget(0), temporary(false) {
+    make_pools();
+  }
 
-  DiskVector(Properties *properties) : props(properties) {}
+  DiskVector(Properties *properties)
+      : props(properties), slice_format(Utils::BIN), reference(nullptr),
+        constant_value(0), mapped(false), prefetch_depth(1),
+        block_order(BlockSchedule::AUTO), schedule_budget(0), temporary(false) {
+    make_pools();
+  }
 
   DiskVector(Properties *properties, std::string vector_name,
-             typename VectorT::ValueType init_val = 0)
-      : props(properties), name(vector_name), m(properties->nvertices) {
+             typename VectorT::ValueType init_val = 0,
+             int fileformat = Utils::BIN)
+      : props(properties), name(vector_name), storage_name(vector_name),
+        m(properties->nvertices), slice_format(fileformat), reference(nullptr),
+        constant_value(init_val), mapped(fileformat == Utils::MAPPED),
+        prefetch_depth(1), block_order(BlockSchedule::AUTO), schedule_budget(0),
+        temporary(false) {
+    make_pools();
     if (props->window * sizeof(typename VectorT::ValueType) >
         props->ram_limit) {
       print_error("The \'graphee::vector\' size exceeds the \'ram_limit\'");
       exit(-1);
     }
 
-    VectorT tmp(props, props->window, init_val);
-    for (uint64_t slice_id = 0; slice_id < props->nslices; slice_id++) {
-      tmp.save(get_slice_filename(slice_id));
+    if (mapped) {
+      map_vector();
     }
+    fill(init_val);
   }
 
   DiskVector(DiskVector<VectorT> &&vec)
-      : props(vec.props), name(vec.name), m(vec.props->nvertices) {
+      : props(vec.props), name(vec.name), storage_name(vec.storage_name),
+        m(vec.props->nvertices), slice_format(vec.slice_format),
+        reference(vec.reference), constant_value(vec.constant_value),
+        constant_slices(std::move(vec.constant_slices)), mapped(vec.mapped),
+        mapping(std::move(vec.mapping)), prefetch_depth(vec.prefetch_depth),
+        writer(std::move(vec.writer)), slice_pool(std::move(vec.slice_pool)),
+        acc_pool(std::move(vec.acc_pool)), block_order(vec.block_order),
+        schedule_budget(vec.schedule_budget), schedule(std::move(vec.schedule)),
+        temporary(vec.temporary), contrib(std::move(vec.contrib)) {
     vec.props = nullptr;
+    vec.reference = nullptr;
     vec.name = "";
     vec.m = 0;
   }
 
-  ~DiskVector() {}
+  ~DiskVector() {
+    if (temporary && props != nullptr) {
+      remove_files();
+    }
+  }
 
   uint64_t get_nslices();
-  VectorT &get_slice(uint64_t slice_id);
+
+  /*! Accumulation type of the products, whatever the stored type is */
+  using AccumulatorType = Vector<double>;
+
+  /*! Owning handle of a slice, its buffer goes back to the pool of the
+   * vector once the last handle is released */
+  using SliceHandle = std::shared_ptr<VectorT>;
+  using AccumulatorHandle = std::shared_ptr<AccumulatorType>;
+
+  SliceHandle get_slice(uint64_t slice_id);
+
+  /*! Buffers of a slice taken from the pools of the vector */
+  SliceHandle acquire_slice() { return slice_pool->acquire(props->window); }
+  AccumulatorHandle acquire_accumulator() {
+    return acc_pool->acquire(props->window);
+  }
+
+  /*! Slices and accumulators made by the pools, constant once the
+   * products run in steady state */
+  uint64_t pool_allocations() const {
+    return slice_pool->allocations() + acc_pool->allocations();
+  }
+
+  /*! File format of the slices written from now on, any codec of
+   * `graphee::Codec` can be used; slices are always read whatever
+   * their format is. The `VectorFilter` flags can be added to the
+   * compressed formats. Ignored by a `Utils::MAPPED` vector.
+   */
+  void set_slice_format(int fileformat);
+
+  /*! Slices saved with `VectorFilter::XOR_DELTA` are stored against the
+   * same slice of `ref`, which is read back to load them: `ref` must not
+   * be rewritten nor swapped as long as this vector depends on it.
+   * `nullptr` stops the deltas for the next writes.
+   */
+  void set_slice_reference(DiskVector<VectorT> *ref);
 
   void swap(DiskVector<VectorT> &rvec);
+  void settle(DiskVector<VectorT> &rvec);
+
+  /*! Number of blocks read ahead by the products, 1 by default (double
+   * buffering), 0 reads each block when it is multiplied. The depth is
+   * lowered to keep the blocks in flight within `ram_limit`.
+   */
+  void set_prefetch_depth(uint64_t depth) { prefetch_depth = depth; }
+  PrefetchStats &get_prefetch_stats() { return prefetch_stats; }
+
+  /*! Order of the blocks in the products, see `BlockSchedule`. The
+   * accumulators of the lines held together by `BlockSchedule::COLUMNS`
+   * fit in `bytes`, a quarter of the `ram_limit` by default (0).
+   */
+  void set_block_order(BlockSchedule::Order order) { block_order = order; }
+  void set_schedule_budget(uint64_t bytes) { schedule_budget = bytes; }
+  const BlockSchedule &get_block_schedule() const { return schedule; }
+
+  uint64_t get_slice_bytes(uint64_t slice_id);
+
+  void set_write_behind(uint64_t max_dirty_bytes, bool durable = false);
+  void barrier();
+
+  void fill(typename VectorT::ValueType val);
+  void materialize();
+
+  bool is_mapped() const { return mapped; }
+
+  /*! Values of a slice, in place for a `Utils::MAPPED` vector, else
+   * loaded into `buffer`. A modified view is written by `save_view()`.
+   */
+  VectorView<typename VectorT::ValueType> view_slice(uint64_t slice_id,
+                                                     VectorT &buffer);
+  /*! Values of a slice about to be overwritten: in place for a mapped
+   * vector, else `buffer` resized to the window, the slice is not read */
+  VectorView<typename VectorT::ValueType> output_slice(uint64_t slice_id,
+                                                       VectorT &buffer);
+  void save_view(uint64_t slice_id, VectorT &buffer);
+  void read_slice(uint64_t slice_id, VectorT &vec);
+  void commit();
 
   template <typename DiskMatrixT> void dmat_columns_sum(DiskMatrixT &dmat);
 
@@ -65,17 +201,48 @@ public:
   DiskVector<VectorT> &operator=(DiskVector &&vec) {
     std::swap(props, vec.props);
     std::swap(name, vec.name);
+    std::swap(storage_name, vec.storage_name);
     std::swap(m, vec.m);
+    std::swap(slice_format, vec.slice_format);
+    std::swap(reference, vec.reference);
+    std::swap(constant_value, vec.constant_value);
+    std::swap(constant_slices, vec.constant_slices);
+    std::swap(mapped, vec.mapped);
+    std::swap(mapping, vec.mapping);
+    std::swap(prefetch_depth, vec.prefetch_depth);
+    std::swap(writer, vec.writer);
+    std::swap(slice_pool, vec.slice_pool);
+    std::swap(acc_pool, vec.acc_pool);
+    std::swap(block_order, vec.block_order);
+    std::swap(schedule_budget, vec.schedule_budget);
+    std::swap(schedule, vec.schedule);
+    std::swap(temporary, vec.temporary);
+    std::swap(contrib, vec.contrib);
+    return *this;
   }
 
   template <typename DiskMatrixT>
   void dmat_prod_dvec(typename VectorT::ValueType a, DiskMatrixT &dmat,
                       DiskVector<VectorT> &dvec);
 
-  template <typename DiskMatrixT>
-  void dmat_prod_dvec_over_dvec(typename VectorT::ValueType a,
-                                DiskMatrixT &dmat, DiskVector<VectorT> &ldvec,
-                                DiskVector<VectorT> &rdvec);
+  template <typename DiskMatrixT, typename LVectorT, typename RVectorT>
+  void dmat_prod_dvec_over_dvec(double a, DiskMatrixT &dmat,
+                                DiskVector<LVectorT> &ldvec,
+                                DiskVector<RVectorT> &rdvec);
+
+  template <typename DiskMatrixT, typename CVectorT>
+  void dmat_prod_contributions(DiskMatrixT &dmat, DiskVector<CVectorT> &cdvec);
+
+  template <typename RVectorT>
+  void reciprocal_of(DiskVector<RVectorT> &rdvec);
+
+  template <typename LVectorT, typename RVectorT>
+  void dvec_prod_dvec(double a, DiskVector<LVectorT> &ldvec,
+                      DiskVector<RVectorT> &rdvec);
+
+  template <typename LVectorT, typename RVectorT>
+  void dvec_over_dvec(double a, DiskVector<LVectorT> &ldvec,
+                      DiskVector<RVectorT> &rdvec);
 
   /* Divide each term of this by the term of ldvec with the same index and
    * accumulate values of this when the division is undefined : If ldvec[i] != 0
@@ -94,7 +261,69 @@ private:
   Properties *props;
   std::string name;
 
+  std::string storage_name; ///< Name of the files, exchanged by `swap()`
+  int slice_format;
+  DiskVector<VectorT> *reference;
+
+  /* Value of the slices never saved since `fill()` */
+  typename VectorT::ValueType constant_value;
+  std::vector<char> constant_slices;
+
+  bool mapped;
+  MappedFile mapping;
+
+  uint64_t prefetch_depth;
+  PrefetchStats prefetch_stats;
+
+  std::unique_ptr<WriteBehind> writer;
+
+  std::shared_ptr<ObjectPool<VectorT>> slice_pool;
+  std::shared_ptr<ObjectPool<AccumulatorType>> acc_pool;
+
+  BlockSchedule::Order block_order;
+  uint64_t schedule_budget;
+  BlockSchedule schedule; ///< Schedule of the last product
+
+  bool temporary; ///< Files removed with the vector
+  std::unique_ptr<DiskVector<AccumulatorType>>
+      contrib; ///< Contributions of `dmat_prod_dvec_over_dvec()`
+
+  template <typename> friend class DiskVector;
+
+  void make_pools();
+  void remove_files();
+
+  template <typename DiskMatrixT>
+  uint64_t prefetch_depth_for(DiskMatrixT &dmat, size_t slice_bytes);
+
+  template <typename DiskMatrixT>
+  void multiply_blocks(DiskMatrixT &dmat,
+                       std::function<void(uint64_t, AccumulatorType &)> read_col,
+                       const std::vector<uint64_t> &col_bytes);
+  template <typename BlocksT>
+  static std::vector<uint64_t> split_column(BlocksT &blocks, uint64_t nthreads);
+  template <typename CVectorT>
+  static void read_accumulator(DiskVector<CVectorT> &cdvec, uint64_t slice_id,
+                               AccumulatorType &slice);
+  static void read_accumulator(DiskVector<AccumulatorType> &cdvec,
+                               uint64_t slice_id, AccumulatorType &slice);
+  void fold_partial(AccumulatorHandle &partial, uint64_t line,
+                    std::vector<AccumulatorHandle> &accs,
+                    std::vector<std::mutex> &owners);
+
   std::string get_slice_filename(uint64_t slice_id);
+  std::string get_slice_path(uint64_t slice_id);
+  std::string get_mapping_path();
+
+  void map_vector();
+  void exchange_files(DiskVector<VectorT> &vec);
+  typename VectorT::ValueType *mapped_values(uint64_t slice_id);
+
+  void save_slice(VectorT &vec, uint64_t slice_id);
+  void queue_slice(VectorT &vec, uint64_t slice_id, VectorT &&ref_slice,
+                   bool delta);
+  void load_slice(VectorT &vec, uint64_t slice_id);
+  bool slice_is_delta(uint64_t slice_id);
 }; // class DiskVector
 
 template <typename VectorT> uint64_t DiskVector<VectorT>::get_nslices() {
@@ -102,24 +331,422 @@ template <typename VectorT> uint64_t DiskVector<VectorT>::get_nslices() {
 }
 
 template <typename VectorT>
-VectorT &DiskVector<VectorT>::get_slice(uint64_t slice_id) {
+typename DiskVector<VectorT>::SliceHandle
+DiskVector<VectorT>::get_slice(uint64_t slice_id) {
   std::ostringstream oss;
   oss << "Load slice [" << slice_id << "] of vector \'" << name << "\'";
   print_log(oss.str());
 
-  VectorT &res = *new VectorT(props);
-  res.load(get_slice_filename(slice_id));
+  SliceHandle res = acquire_slice();
+  load_slice(*res, slice_id);
 
   return res;
 }
 
+/*! Enough idle buffers for the slices in use by all the threads, and
+ * for the slices queued by the write-behind */
+template <typename VectorT> void DiskVector<VectorT>::make_pools() {
+  Properties *props = this->props;
+  size_t max_idle = 4 * std::max<size_t>(props != nullptr ? props->nthreads : 1,
+                                         std::thread::hardware_concurrency());
+  slice_pool = ObjectPool<VectorT>::create(
+      [props]() { return new VectorT(props); },
+      [](VectorT &vec) { return vec.size(); }, max_idle);
+  acc_pool = ObjectPool<AccumulatorType>::create(
+      [props]() { return new AccumulatorType(props); },
+      [](AccumulatorType &vec) { return vec.size(); }, max_idle);
+}
+
+template <typename VectorT>
+void DiskVector<VectorT>::set_slice_format(int fileformat) {
+  slice_format = fileformat;
+}
+
+template <typename VectorT>
+void DiskVector<VectorT>::set_slice_reference(DiskVector<VectorT> *ref) {
+  if (ref == this || (ref != nullptr && ref->reference == this)) {
+    print_error("A vector could not be stored as a delta of itself");
+    exit(-1);
+  }
+  reference = ref;
+}
+
 template <typename VectorT>
 std::string DiskVector<VectorT>::get_slice_filename(uint64_t slice_id) {
   std::ostringstream slicename;
-  slicename << props->name << "_" << name << "_dvecslc_" << slice_id << ".gpe";
+  slicename << props->name << "_" << storage_name << "_dvecslc_" << slice_id
+            << ".gpe";
   return slicename.str();
 }
 
+/*! File of the slice on its storage root, the slices with the same id
+ * of all the vectors are on the same drive
+ */
+template <typename VectorT>
+std::string DiskVector<VectorT>::get_slice_path(uint64_t slice_id) {
+  return storage_path(props, get_slice_filename(slice_id), StorageRoots::SLICE,
+                      slice_id);
+}
+
+template <typename VectorT>
+std::string DiskVector<VectorT>::get_mapping_path() {
+  std::ostringstream mapname;
+  mapname << props->name << "_" << storage_name << "_dvecmap.gpe";
+  return storage_path(props, mapname.str(), StorageRoots::SLICE, 0);
+}
+
+/*! Creates, or reuses, the file of a mapped vector */
+template <typename VectorT>
+void DiskVector<VectorT>::map_vector() {
+  if (props->container != nullptr) {
+    print_error("A \'Utils::MAPPED\' vector could not be stored in a container");
+    exit(-1);
+  }
+
+  using ValueT = typename VectorT::ValueType;
+  const uint64_t nvalues = props->nslices * props->window;
+  mapping = MappedFile::writable(get_mapping_path(),
+                                 MappedFile::alignment + nvalues * sizeof(ValueT));
+
+  std::string vector_typename = VectorT(props).vector_typename;
+  size_t typename_size = vector_typename.size();
+  int fileformat = Utils::MAPPED;
+  uint64_t dims[2] = {props->nslices, props->window};
+
+  char *header = mapping.mutable_data();
+  std::memcpy(header, &typename_size, sizeof(size_t));
+  header += sizeof(size_t);
+  std::memcpy(header, vector_typename.c_str(), typename_size);
+  header += typename_size;
+  std::memcpy(header, &fileformat, sizeof(int));
+  header += sizeof(int);
+  std::memcpy(header, dims, sizeof(dims));
+
+  /* The slices are read ahead one by one by `view_slice` */
+  mapping.advise(MADV_RANDOM);
+}
+
+/*! Sets all the values to `val`, only a mapped vector writes them */
+template <typename VectorT>
+void DiskVector<VectorT>::fill(typename VectorT::ValueType val) {
+  if (mapped) {
+    typename VectorT::ValueType *values = mapped_values(0);
+#pragma omp parallel for num_threads(props->nthreads)
+    for (uint64_t i = 0; i < props->nslices * props->window; i++) {
+      values[i] = val;
+    }
+    return;
+  }
+
+  constant_value = val;
+  constant_slices.assign(props->nslices, 1);
+}
+
+/*! Files of a temporary vector, the entries of a container are kept
+ * and rewritten by its next use */
+template <typename VectorT> void DiskVector<VectorT>::remove_files() {
+  if (writer != nullptr) {
+    writer->barrier();
+  }
+
+  if (mapped) {
+    mapping.unmap();
+    std::remove(get_mapping_path().c_str());
+    return;
+  }
+
+  if (props->container != nullptr) {
+    return;
+  }
+  for (uint64_t slice_id = 0; slice_id < props->nslices; slice_id++) {
+    std::remove(get_slice_path(slice_id).c_str());
+  }
+}
+
+/*! Writes the slices still constant */
+template <typename VectorT> void DiskVector<VectorT>::materialize() {
+  if (mapped ||
+      std::find(constant_slices.begin(), constant_slices.end(), 1) ==
+          constant_slices.end()) {
+    return;
+  }
+
+  VectorT tmp(props, props->window, constant_value);
+  for (uint64_t slice_id = 0; slice_id < props->nslices; slice_id++) {
+    if (constant_slices[slice_id]) {
+      save_slice(tmp, slice_id);
+    }
+  }
+  commit();
+}
+
+template <typename VectorT>
+typename VectorT::ValueType *
+DiskVector<VectorT>::mapped_values(uint64_t slice_id) {
+  return reinterpret_cast<typename VectorT::ValueType *>(
+             mapping.mutable_data() + MappedFile::alignment) +
+         slice_id * props->window;
+}
+
+template <typename VectorT>
+VectorView<typename VectorT::ValueType>
+DiskVector<VectorT>::view_slice(uint64_t slice_id, VectorT &buffer) {
+  if (mapped) {
+    mapping.advise(MappedFile::alignment + slice_id * props->window *
+                                               sizeof(typename VectorT::ValueType),
+                   props->window * sizeof(typename VectorT::ValueType),
+                   MADV_WILLNEED);
+    return VectorView<typename VectorT::ValueType>(mapped_values(slice_id),
+                                                   props->window);
+  }
+
+  load_slice(buffer, slice_id);
+  return VectorView<typename VectorT::ValueType>(buffer.data(), buffer.size());
+}
+
+template <typename VectorT>
+VectorView<typename VectorT::ValueType>
+DiskVector<VectorT>::output_slice(uint64_t slice_id, VectorT &buffer) {
+  if (mapped) {
+    return VectorView<typename VectorT::ValueType>(mapped_values(slice_id),
+                                                   props->window);
+  }
+
+  buffer.resize(props->window);
+  return VectorView<typename VectorT::ValueType>(buffer.data(), buffer.size());
+}
+
+/*! Bytes read to load a slice: its file, or its values for a mapped
+ * vector, none for a constant slice
+ */
+template <typename VectorT>
+uint64_t DiskVector<VectorT>::get_slice_bytes(uint64_t slice_id) {
+  if (mapped)
+    return props->window * sizeof(typename VectorT::ValueType);
+  if (constant_slices[slice_id])
+    return 0;
+
+  if (writer != nullptr)
+    writer->wait(get_slice_filename(slice_id));
+  if (props->container != nullptr)
+    return props->container->size_of(get_slice_filename(slice_id));
+
+  struct stat st;
+  if (stat(get_slice_path(slice_id).c_str(), &st) != 0)
+    return 0;
+  return static_cast<uint64_t>(st.st_size);
+}
+
+/*! Loads a slice into `vec`, without the log nor the allocation of
+ * `get_slice()`; a copy for a mapped vector
+ */
+template <typename VectorT>
+void DiskVector<VectorT>::read_slice(uint64_t slice_id, VectorT &vec) {
+  load_slice(vec, slice_id);
+}
+
+/*! The requested depth, lowered so that the blocks in flight, one being
+ * multiplied and `depth` read ahead by each line of the product, fit in
+ * `ram_limit`. A block is counted as the largest one of the manifest,
+ * or as a full window of elements without manifest.
+ */
+template <typename VectorT>
+template <typename DiskMatrixT>
+uint64_t DiskVector<VectorT>::prefetch_depth_for(DiskMatrixT &dmat,
+                                                 size_t slice_bytes) {
+  const BlockManifest &manifest = dmat.get_manifest();
+  uint64_t max_nnz = manifest.is_loaded() ? 0 : props->window;
+  if (manifest.is_loaded()) {
+    for (uint64_t line = 0; line < props->nslices; line++) {
+      for (uint64_t col = 0; col < props->nslices; col++) {
+        max_nnz = std::max(max_nnz, manifest.get(line, col).nnz);
+      }
+    }
+  }
+
+  const uint64_t item_bytes =
+      (props->window + 1 + max_nnz) * sizeof(uint64_t) + slice_bytes;
+  const uint64_t nlines = std::max<uint64_t>(
+      std::min<uint64_t>(props->nslices, props->nthreads), 1);
+  const uint64_t nitems = props->ram_limit / (item_bytes * nlines);
+
+  uint64_t depth = std::min(prefetch_depth, nitems > 0 ? nitems - 1 : 0);
+  if (depth < prefetch_depth) {
+    std::ostringstream oss;
+    oss << "Prefetch depth of vector \'" << name << "\' lowered to " << depth
+        << " by the \'ram_limit\'";
+    print_log(oss.str());
+  }
+  return depth;
+}
+
+/*! Nothing to write for a mapped vector, its view is the slice */
+template <typename VectorT>
+void DiskVector<VectorT>::save_view(uint64_t slice_id, VectorT &buffer) {
+  if (!mapped) {
+    save_slice(buffer, slice_id);
+  }
+}
+
+/*! Writes a slice to its file, or to the container of the graph */
+template <typename VectorT>
+void DiskVector<VectorT>::save_slice(VectorT &vec, uint64_t slice_id) {
+  if (mapped) {
+    std::copy(vec.begin(), vec.begin() + std::min<uint64_t>(vec.size(), props->window),
+              mapped_values(slice_id));
+    return;
+  }
+
+  VectorT ref_slice(props);
+  VectorT *ref = nullptr;
+  if (reference != nullptr &&
+      (VectorFilter::filters_of(slice_format) & VectorFilter::XOR_DELTA)) {
+    reference->load_slice(ref_slice, slice_id);
+    ref = &ref_slice;
+  }
+
+  constant_slices[slice_id] = 0;
+  if (writer != nullptr) {
+    queue_slice(vec, slice_id, std::move(ref_slice), ref != nullptr);
+    return;
+  }
+
+  if (props->container != nullptr) {
+    vec.save(*props->container, get_slice_filename(slice_id), slice_format,
+             ref);
+  } else {
+    StorageStream stream(props->storage,
+                         storage_root(props, get_slice_filename(slice_id),
+                                      StorageRoots::SLICE, slice_id));
+    vec.save(get_slice_path(slice_id), slice_format, ref);
+  }
+}
+
+/*! Copies the slice, and its reference, for the write-behind queue */
+template <typename VectorT>
+void DiskVector<VectorT>::queue_slice(VectorT &vec, uint64_t slice_id,
+                                      VectorT &&ref_slice, bool delta) {
+  SliceHandle data = acquire_slice();
+  data->assign(vec.begin(), vec.end());
+  SliceHandle ref =
+      delta ? std::make_shared<VectorT>(std::move(ref_slice)) : nullptr;
+
+  Properties *props = this->props;
+  int fileformat = slice_format;
+  std::string filename = get_slice_filename(slice_id);
+  std::string path = props->container != nullptr ? "" : get_slice_path(slice_id);
+  bool durable = writer->is_durable();
+
+  writer->push(filename, vec.size() * sizeof(typename VectorT::ValueType),
+               [=]() {
+                 if (props->container != nullptr) {
+                   data->save(*props->container, filename, fileformat,
+                              delta ? ref.get() : nullptr);
+                   return;
+                 }
+
+                 StorageStream stream(props->storage,
+                                      storage_root(props, filename,
+                                                   StorageRoots::SLICE, slice_id));
+                 data->save(path, fileformat, delta ? ref.get() : nullptr);
+                 if (durable) {
+                   WriteBehind::sync_file(path);
+                 }
+               });
+}
+
+/*! The slice of the reference is only read for a slice stored as a delta */
+template <typename VectorT>
+void DiskVector<VectorT>::load_slice(VectorT &vec, uint64_t slice_id) {
+  if (mapped) {
+    vec.assign(mapped_values(slice_id), mapped_values(slice_id) + props->window);
+    return;
+  }
+
+  if (constant_slices[slice_id]) {
+    vec.assign(props->window, constant_value);
+    return;
+  }
+
+  if (writer != nullptr) {
+    writer->wait(get_slice_filename(slice_id));
+  }
+
+  VectorT ref_slice(props);
+  VectorT *ref = nullptr;
+  if (reference != nullptr && slice_is_delta(slice_id)) {
+    reference->load_slice(ref_slice, slice_id);
+    ref = &ref_slice;
+  }
+
+  if (props->container != nullptr) {
+    vec.load(*props->container, get_slice_filename(slice_id), ref);
+  } else {
+    vec.load(get_slice_path(slice_id), ref);
+  }
+}
+
+/*! Reads the fileformat in the prefix of the slice file */
+template <typename VectorT>
+bool DiskVector<VectorT>::slice_is_delta(uint64_t slice_id) {
+  auto read_fileformat = [](std::istream &fp) {
+    size_t typename_size = 0;
+    int fileformat = 0;
+    fp.read(reinterpret_cast<char *>(&typename_size), sizeof(size_t));
+    fp.ignore(typename_size);
+    fp.read(reinterpret_cast<char *>(&fileformat), sizeof(int));
+    return fileformat;
+  };
+
+  int fileformat;
+  if (props->container != nullptr) {
+    MappedStream fp(props->container->map(get_slice_filename(slice_id)));
+    fileformat = read_fileformat(fp);
+  } else {
+    std::ifstream fp(get_slice_path(slice_id), std::ios_base::binary);
+    fileformat = read_fileformat(fp);
+  }
+
+  return VectorFilter::filters_of(fileformat) & VectorFilter::XOR_DELTA;
+}
+
+/*! Slices written by an operation are committed at once to the
+ * container, a crash never leaves a partially updated vector. A mapped
+ * vector is synced to its file.
+ */
+template <typename VectorT> void DiskVector<VectorT>::commit() {
+  if (mapped) {
+    mapping.sync();
+  } else if (props->container != nullptr) {
+    barrier();
+    props->container->commit();
+  }
+}
+
+/*! `max_dirty_bytes` bounds the slices queued and not yet written, 0
+ * writes the slices in the operators again. A durable queue syncs each
+ * slice file once written. Ignored by a `Utils::MAPPED` vector.
+ */
+template <typename VectorT>
+void DiskVector<VectorT>::set_write_behind(uint64_t max_dirty_bytes,
+                                           bool durable) {
+  barrier();
+  writer.reset();
+  if (max_dirty_bytes > 0 && !mapped) {
+    writer.reset(new WriteBehind(props->nthreads, max_dirty_bytes, durable));
+  }
+}
+
+/*! Waits for the slices queued by the write-behind, e.g. at the end of
+ * an iteration, and logs what was written
+ */
+template <typename VectorT> void DiskVector<VectorT>::barrier() {
+  if (writer != nullptr) {
+    writer->barrier();
+    print_log(writer->report());
+  }
+}
+
 template <typename VectorT>
 void DiskVector<VectorT>::swap(DiskVector<VectorT> &vec) {
   if (props->nvertices != vec.props->nvertices) {
@@ -129,39 +756,121 @@ void DiskVector<VectorT>::swap(DiskVector<VectorT> &vec) {
     print_error(oss.str());
   }
 
+  /* The deltas would follow their files, not their reference */
+  if (reference != nullptr || vec.reference != nullptr) {
+    std::ostringstream oss;
+    oss << "Could not swap vector \'" << name << "\' and \'";
+    oss << vec.name << "\' because one of them is stored as a delta";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  if (mapped != vec.mapped) {
+    std::ostringstream oss;
+    oss << "Could not swap vector \'" << name << "\' and \'";
+    oss << vec.name << "\' because only one of them is mapped";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  /* Each vector takes the files, the writes still queued for them and
+   * the constant of the other one */
+  std::swap(storage_name, vec.storage_name);
+  std::swap(constant_value, vec.constant_value);
+  std::swap(constant_slices, vec.constant_slices);
+  std::swap(mapping, vec.mapping);
+  std::swap(writer, vec.writer);
+}
+
+/*! Writes the constant slices of both vectors and, when they were swapped
+ * an odd number of times, exchanges their files so that each vector is
+ * back in the files of its own name
+ */
+template <typename VectorT>
+void DiskVector<VectorT>::settle(DiskVector<VectorT> &vec) {
+  materialize();
+  vec.materialize();
+
+  if (storage_name == name && vec.storage_name == vec.name) {
+    return;
+  }
+
+  if (storage_name != vec.name || vec.storage_name != name) {
+    std::ostringstream oss;
+    oss << "Could not settle vector \'" << name << "\' and \'";
+    oss << vec.name << "\', they were not swapped together";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  barrier();
+  vec.barrier();
+  exchange_files(vec);
+  std::swap(storage_name, vec.storage_name);
+  std::swap(writer, vec.writer);
+}
+
+/*! Each mapping follows its file */
+template <typename VectorT>
+void DiskVector<VectorT>::exchange_files(DiskVector<VectorT> &vec) {
+  if (mapped) {
+    std::string tmppath = get_mapping_path() + ".swap";
+    if (rename(get_mapping_path().c_str(), tmppath.c_str()) != 0 ||
+        rename(vec.get_mapping_path().c_str(), get_mapping_path().c_str()) != 0 ||
+        rename(tmppath.c_str(), vec.get_mapping_path().c_str()) != 0) {
+      std::ostringstream oss;
+      oss << "Could not swap the mapped vectors \'" << name << "\' and \'";
+      oss << vec.name << "\'";
+      print_error(oss.str());
+      exit(-1);
+    }
+    return;
+  }
+
+  if (props->container != nullptr) {
+    for (uint64_t slice_id = 0; slice_id < props->nslices; slice_id++) {
+      props->container->swap(get_slice_filename(slice_id),
+                             vec.get_slice_filename(slice_id));
+    }
+    commit();
+    return;
+  }
+
   int succed;
   std::ostringstream tmpname;
   tmpname << name << "_swap_file.gpe";
   for (uint64_t slice_id = 0; slice_id < props->nslices; slice_id++) {
-    succed =
-        rename(get_slice_filename(slice_id).c_str(), tmpname.str().c_str());
+    /* Renamed within the storage root of the slice */
+    std::string tmppath = storage_path(props, tmpname.str(),
+                                       StorageRoots::SLICE, slice_id);
+
+    succed = rename(get_slice_path(slice_id).c_str(), tmppath.c_str());
 
     if (succed != 0) {
       std::ostringstream oss;
-      oss << "Could not swap vector \'" << get_slice_filename(slice_id)
+      oss << "Could not swap vector \'" << get_slice_path(slice_id)
           << "\' to \'";
-      oss << tmpname.str() << "\'";
+      oss << tmppath << "\'";
       print_error(oss.str());
     }
 
-    succed = rename(vec.get_slice_filename(slice_id).c_str(),
-                    get_slice_filename(slice_id).c_str());
+    succed = rename(vec.get_slice_path(slice_id).c_str(),
+                    get_slice_path(slice_id).c_str());
 
     if (succed != 0) {
       std::ostringstream oss;
-      oss << "Could not swap vector \'" << vec.get_slice_filename(slice_id)
+      oss << "Could not swap vector \'" << vec.get_slice_path(slice_id)
           << "\' to \'";
-      oss << get_slice_filename(slice_id) << "\'";
+      oss << get_slice_path(slice_id) << "\'";
       print_error(oss.str());
     }
 
-    succed =
-        rename(tmpname.str().c_str(), vec.get_slice_filename(slice_id).c_str());
+    succed = rename(tmppath.c_str(), vec.get_slice_path(slice_id).c_str());
 
     if (succed != 0) {
       std::ostringstream oss;
-      oss << "Could not swap vector \'" << tmpname.str() << "\' to \'";
-      oss << vec.get_slice_filename(slice_id) << "\'";
+      oss << "Could not swap vector \'" << tmppath << "\' to \'";
+      oss << vec.get_slice_path(slice_id) << "\'";
       print_error(oss.str());
     }
   }
@@ -176,23 +885,53 @@ void DiskVector<VectorT>::dmat_columns_sum(DiskMatrixT &dmat) {
     print_error(oss.str());
     exit(-1);
   }
-#pragma omp parallel for
-  for (uint64_t col = 0; col < props->nslices; col++) {
-    VectorT res(std::move(this->get_slice(col)));
+  /* Empty blocks are skipped, the largest columns go first */
+  const BlockManifest &manifest = dmat.get_manifest();
+  std::vector<uint64_t> cols = manifest.columns_by_size();
+
+  using BlockT = std::shared_ptr<typename DiskMatrixT::MatrixType>;
+  const uint64_t depth = prefetch_depth_for(dmat, 0);
+  ThreadPool io_pool(props->nthreads);
+  prefetch_stats.reset();
+  dmat.get_block_cache().reset_stats();
+
+#pragma omp parallel for schedule(dynamic)
+  for (uint64_t k = 0; k < props->nslices; k++) {
+    uint64_t col = cols[k];
+    SliceHandle resbuf = acquire_slice();
+    VectorView<typename VectorT::ValueType> res = this->view_slice(col, *resbuf);
+    AccumulatorHandle acc = acquire_accumulator();
+    acc->convert_from(res);
+
+    std::vector<uint64_t> lines;
     for (uint64_t line = 0; line < props->nslices; line++) {
-      typename DiskMatrixT::MatrixType smat = std::move(dmat.get_block(line, col));
-      
-      res += smat.columns_sum(); 
+      if (!manifest.is_empty(line, col))
+        lines.push_back(line);
     }
-    res.save(this->get_slice_filename(col));
+
+    Prefetcher<BlockT> blocks(
+        io_pool,
+        [&](uint64_t b) -> BlockT { return dmat.fetch_block(lines[b], col); },
+        lines.size(), depth, prefetch_stats);
+
+    for (uint64_t b = 0; b < lines.size(); b++) {
+      BlockT smat = blocks.next();
+      *acc += smat->columns_sum();
+    }
+    res.convert_from(*acc);
+    save_view(col, *resbuf);
   }
+  commit();
+  print_log(prefetch_stats.report());
+  print_log(dmat.get_block_cache().report());
 }
 
 template <typename VectorT> uint64_t DiskVector<VectorT>::countZeros() {
   uint64_t res = 0;
 #pragma omp parallel for reduction(+ : res)
   for (uint64_t slice = 0; slice < props->nslices; slice++) {
-    VectorT vectSlice(std::move(this->get_slice(slice)));
+    SliceHandle buffer = acquire_slice();
+    VectorView<typename VectorT::ValueType> vectSlice = this->view_slice(slice, *buffer);
     for (uint64_t i = 0; i < props->window; i++) {
       if (!vectSlice[i]) {
         res += 1;
@@ -205,12 +944,13 @@ template <typename VectorT> uint64_t DiskVector<VectorT>::countZeros() {
 template <typename VectorT>
 DiskVector<VectorT> &DiskVector<VectorT>::
 operator+=(typename VectorT::ValueType val) {
-  VectorT vec(props);
+  SliceHandle vec = acquire_slice();
   for (uint64_t slice_id = 0; slice_id < props->nslices; slice_id++) {
-    vec.load(get_slice_filename(slice_id));
-    vec += val;
-    vec.save(get_slice_filename(slice_id));
+    load_slice(*vec, slice_id);
+    *vec += val;
+    save_slice(*vec, slice_id);
   }
+  commit();
 
   return (*this);
 }
@@ -227,19 +967,20 @@ void DiskVector<VectorT>::dmat_prod_dvec(typename VectorT::ValueType a,
     exit(-1);
   }
 
-#pragma omp parallel for
-  for (uint64_t line = 0; line < props->nslices; line++) {
-    VectorT res(std::move(this->get_slice(line)));
-    for (uint64_t col = 0; col < props->nslices; col++) {
-      typename DiskMatrixT::MatrixType smat =
-          std::move(dmat.get_block(line, col));
-      VectorT rvec(std::move(dvec.get_slice(col)));
-
-      rvec *= a;
-      res += smat * rvec;
-    }
-    res.save(this->get_slice_filename(line));
+  std::vector<uint64_t> col_bytes(props->nslices);
+  for (uint64_t slice = 0; slice < props->nslices; slice++) {
+    col_bytes[slice] = dvec.get_slice_bytes(slice);
   }
+
+  multiply_blocks(
+      dmat,
+      [&](uint64_t col, AccumulatorType &slice) {
+        SliceHandle buffer = dvec.acquire_slice();
+        dvec.load_slice(*buffer, col);
+        slice.convert_from(*buffer);
+        slice *= a;
+      },
+      col_bytes);
 }
 
 template <typename VectorT>
@@ -257,23 +998,31 @@ void DiskVector<VectorT>::divide_and_sum_Nan(DiskVector<VectorT> &ldvec,
 
 #pragma omp parallel for
   for (uint64_t slice = 0; slice < props->nslices; slice++) {
-    VectorT res(std::move(this->get_slice(slice)));
-    VectorT lvec(std::move(ldvec.get_slice(slice)));
+    SliceHandle res = this->get_slice(slice);
+    SliceHandle lvec = ldvec.get_slice(slice);
 
-    res.divide_and_sum_Nan(lvec, aggregator_array[slice]);
-    res.save(this->get_slice_filename(slice));
+    res->divide_and_sum_Nan(*lvec, aggregator_array[slice]);
+    save_slice(*res, slice);
   }
+  commit();
 
   // Final reduction
   for (uint64_t slice = 0; slice < props->nslices; slice++)
     aggregator += aggregator_array[slice];
 }
 
+/*! this += a * dmat * (ldvec / rdvec), with 0 where rdvec is 0. The
+ * vectors may store different types (e.g. `float` ranks over `uint32_t`
+ * degrees). `a * ldvec / rdvec` is computed once in `double` into a
+ * contribution vector `<name>_contrib`, then multiplied by the blocks.
+ * The contribution vector is kept for the next products, its files are
+ * removed with this vector.
+ */
 template <typename VectorT>
-template <typename DiskMatrixT>
+template <typename DiskMatrixT, typename LVectorT, typename RVectorT>
 void DiskVector<VectorT>::dmat_prod_dvec_over_dvec(
-    typename VectorT::ValueType a, DiskMatrixT &dmat,
-    DiskVector<VectorT> &ldvec, DiskVector<VectorT> &rdvec) {
+    double a, DiskMatrixT &dmat, DiskVector<LVectorT> &ldvec,
+    DiskVector<RVectorT> &rdvec) {
   if (dmat.n != ldvec.m && ldvec.m != rdvec.m) {
     std::ostringstream oss;
     oss << "Wrong dimensions in Matrix-Vector product";
@@ -281,21 +1030,363 @@ void DiskVector<VectorT>::dmat_prod_dvec_over_dvec(
     exit(-1);
   }
 
-#pragma omp parallel for
-  for (uint64_t line = 0; line < props->nslices; line++) {
-    VectorT res(std::move(this->get_slice(line)));
-    for (uint64_t col = 0; col < props->nslices; col++) {
-      typename DiskMatrixT::MatrixType smat =
-          std::move(dmat.get_block(line, col));
-      VectorT lvec(std::move(ldvec.get_slice(col)));
-      VectorT rvec(std::move(rdvec.get_slice(col)));
-
-      lvec /= rvec;
-      lvec *= a;
-      res += smat * lvec;
+  if (contrib == nullptr) {
+    contrib.reset(new DiskVector<AccumulatorType>(
+        props, name + "_contrib", 0., mapped ? Utils::MAPPED : Utils::BIN));
+    contrib->temporary = true;
+  }
+  contrib->dvec_over_dvec(a, ldvec, rdvec);
+  dmat_prod_contributions(dmat, *contrib);
+}
+
+/*! Adds `dmat * cdvec` to this vector, each block reads a single slice
+ * of the contributions. The slices are read in the stored type of
+ * `cdvec` (e.g. `float`) and multiplied in `double`.
+ */
+template <typename VectorT>
+template <typename DiskMatrixT, typename CVectorT>
+void DiskVector<VectorT>::dmat_prod_contributions(DiskMatrixT &dmat,
+                                                  DiskVector<CVectorT> &cdvec) {
+  if (dmat.n != cdvec.m) {
+    std::ostringstream oss;
+    oss << "Wrong dimensions in Matrix-Vector product";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  std::vector<uint64_t> col_bytes(props->nslices);
+  for (uint64_t slice = 0; slice < props->nslices; slice++) {
+    col_bytes[slice] = cdvec.get_slice_bytes(slice);
+  }
+
+  multiply_blocks(
+      dmat,
+      [&](uint64_t col, AccumulatorType &slice) {
+        read_accumulator(cdvec, col, slice);
+      },
+      col_bytes);
+}
+
+/*! Reads a slice of `cdvec` converted to `double`, on an I/O thread */
+template <typename VectorT>
+template <typename CVectorT>
+void DiskVector<VectorT>::read_accumulator(DiskVector<CVectorT> &cdvec,
+                                           uint64_t slice_id,
+                                           AccumulatorType &slice) {
+  typename DiskVector<CVectorT>::SliceHandle buf = cdvec.acquire_slice();
+  cdvec.read_slice(slice_id, *buf);
+  slice.assign(buf->begin(), buf->end());
+}
+
+template <typename VectorT>
+void DiskVector<VectorT>::read_accumulator(DiskVector<AccumulatorType> &cdvec,
+                                           uint64_t slice_id,
+                                           AccumulatorType &slice) {
+  cdvec.read_slice(slice_id, slice);
+}
+
+/*! Adds the products of the blocks of `dmat` to this vector, in the order
+ * of a `BlockSchedule`. `read_col(col, slice)` reads the slice which the
+ * blocks of a column multiply, of `col_bytes[col]` bytes.
+ *
+ * Empty blocks, and the slices they would multiply, are skipped, the
+ * lines with the most bytes to read go first. The slice of a column and
+ * its blocks in the group of lines are read ahead, and all the threads
+ * share them: each block is cut in parts after its share of the
+ * elements of the column (`split_column()`), and each thread takes the
+ * next part of the next block, whatever its line. The parallelism is
+ * thus not bounded by `nslices`, and the SpMV never opens a nested
+ * parallel region.
+ *
+ * A thread adds a part to the accumulator of its line when no other
+ * thread holds it, else to its own partial slice, which is added to the
+ * accumulator once the thread moves to another held line or the group
+ * is done. The `nthreads` partial slices are counted in the schedule
+ * budget.
+ */
+template <typename VectorT>
+template <typename DiskMatrixT>
+void DiskVector<VectorT>::multiply_blocks(
+    DiskMatrixT &dmat, std::function<void(uint64_t, AccumulatorType &)> read_col,
+    const std::vector<uint64_t> &col_bytes) {
+  const BlockManifest &manifest = dmat.get_manifest();
+  std::vector<uint64_t> lines = manifest.lines_by_size();
+
+  std::vector<uint64_t> line_bytes(props->nslices);
+  for (uint64_t slice = 0; slice < props->nslices; slice++) {
+    line_bytes[slice] = get_slice_bytes(slice);
+  }
+  /* The partial slices, one per thread, are taken from the budget */
+  const uint64_t nthreads = std::max<uint64_t>(props->nthreads, 1);
+  const uint64_t budget =
+      schedule_budget > 0 ? schedule_budget : props->ram_limit / 4;
+  const uint64_t partial_bytes = nthreads * props->window * sizeof(double);
+  const uint64_t line_buffer_bytes =
+      props->window * (sizeof(double) + sizeof(typename VectorT::ValueType));
+  schedule = BlockSchedule::plan(
+      block_order, manifest, lines,
+      budget > partial_bytes ? (budget - partial_bytes) / line_buffer_bytes : 1,
+      col_bytes, line_bytes);
+
+  /* The columns of all the groups in a single stream; a column of a
+   * single line is a single block, read as far ahead as the lines which
+   * were multiplied in parallel */
+  std::vector<std::pair<uint64_t, uint64_t>> items;
+  for (uint64_t g = 0; g < schedule.groups.size(); g++) {
+    for (uint64_t col : schedule.groups[g].cols) {
+      items.push_back(std::make_pair(g, col));
+    }
+  }
+
+  uint64_t depth = prefetch_depth_for(dmat, props->window * sizeof(double));
+  if (depth > 0 && schedule.order == BlockSchedule::LINES) {
+    depth = (depth + 1) * std::min<uint64_t>(nthreads, props->nslices) - 1;
+  }
+
+  using BlocksT = std::vector<typename DiskMatrixT::BlockHandle>;
+  using ColumnT = BlockSlice<BlocksT, AccumulatorHandle>;
+  ThreadPool io_pool(props->nthreads);
+  prefetch_stats.reset();
+  dmat.get_block_cache().reset_stats();
+  std::atomic<uint64_t> read_bytes(0);
+  std::vector<AccumulatorHandle> partials(nthreads);
+
+  Prefetcher<ColumnT> columns(
+      io_pool,
+      [&](uint64_t c) -> ColumnT {
+        const BlockSchedule::Group &group = schedule.groups[items[c].first];
+        uint64_t col = items[c].second;
+        ColumnT item{BlocksT(group.lines.size()), acquire_accumulator()};
+        read_col(col, *item.slice);
+        read_bytes += col_bytes[col];
+        for (uint64_t i = 0; i < group.lines.size(); i++) {
+          if (!manifest.is_empty(group.lines[i], col)) {
+            item.block[i] = dmat.fetch_block(group.lines[i], col);
+            item.block[i]->prepare_parts();
+          }
+        }
+        return item;
+      },
+      items.size(), depth, prefetch_stats);
+
+  for (const BlockSchedule::Group &group : schedule.groups) {
+    const uint64_t nlines = group.lines.size();
+    std::vector<SliceHandle> resbufs(nlines);
+    std::vector<AccumulatorHandle> accs(nlines);
+    std::vector<VectorView<typename VectorT::ValueType>> res(
+        nlines, VectorView<typename VectorT::ValueType>(nullptr, 0));
+
+#pragma omp parallel for schedule(dynamic)
+    for (uint64_t i = 0; i < nlines; i++) {
+      resbufs[i] = acquire_slice();
+      res[i] = this->view_slice(group.lines[i], *resbufs[i]);
+      accs[i] = acquire_accumulator();
+      accs[i]->convert_from(res[i]);
+      read_bytes += line_bytes[group.lines[i]];
+    }
+
+    /* Next part to multiply: part `next_part` of the block of the line
+     * `next_line` in the current column, cut in `nparts[next_line]` */
+    std::mutex cursor_mtx;
+    std::condition_variable fetched;
+    ColumnT column;
+    std::vector<uint64_t> nparts(nlines, 1);
+    uint64_t ntaken = 0;
+    uint64_t next_line = nlines, next_part = 0;
+    bool fetching = false;
+
+    std::vector<std::mutex> owners(nlines);
+
+#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+    for (uint64_t t = 0; t < nthreads; t++) {
+      AccumulatorHandle &partial = partials[t];
+      uint64_t partial_line = nlines;
+
+      while (true) {
+        typename DiskMatrixT::BlockHandle block;
+        AccumulatorHandle slice;
+        uint64_t i, part, np;
+        {
+          std::unique_lock<std::mutex> lock(cursor_mtx);
+          while (next_line < nlines && column.block[next_line] == nullptr) {
+            next_line++;
+          }
+          if (next_line == nlines) {
+            if (fetching) {
+              fetched.wait(lock);
+              continue;
+            }
+            if (ntaken == group.cols.size())
+              break;
+
+            /* The next column is taken, and split, out of the lock */
+            fetching = true;
+            ntaken++;
+            lock.unlock();
+            ColumnT taken = columns.next();
+            std::vector<uint64_t> taken_parts = split_column(taken.block, nthreads);
+            lock.lock();
+            column = std::move(taken);
+            nparts = std::move(taken_parts);
+            next_line = 0;
+            next_part = 0;
+            fetching = false;
+            fetched.notify_all();
+            continue;
+          }
+
+          i = next_line;
+          part = next_part;
+          np = nparts[i];
+          block = column.block[i];
+          slice = column.slice;
+          if (++next_part == np) {
+            next_line++;
+            next_part = 0;
+          }
+        }
+
+        /* The partial slice stays on its line until the thread moves to
+         * another line whose accumulator is held */
+        if (partial_line != i) {
+          if (owners[i].try_lock()) {
+            block->multiply_add(*slice, *accs[i], part, np);
+            owners[i].unlock();
+            continue;
+          }
+          fold_partial(partial, partial_line, accs, owners);
+          if (partial == nullptr) {
+            partial = acquire_accumulator();
+            partial->assign(props->window, 0.);
+          }
+          partial_line = i;
+        }
+        block->multiply_add(*slice, *partial, part, np);
+      }
+      fold_partial(partial, partial_line, accs, owners);
+    }
+    column = ColumnT();
+
+#pragma omp parallel for schedule(dynamic)
+    for (uint64_t i = 0; i < nlines; i++) {
+      res[i].convert_from(*accs[i]);
+      save_view(group.lines[i], *resbufs[i]);
+    }
+  }
+  commit();
+
+  schedule.read_block_bytes = dmat.get_block_cache().get_read_bytes();
+  schedule.read_slice_bytes = read_bytes;
+  print_log(prefetch_stats.report());
+  print_log(dmat.get_block_cache().report());
+  print_log(schedule.report());
+}
+
+/*! Number of parts of each block of a column: its share of the elements
+ * of the column times `nthreads`, at least 1. A block holding most of
+ * the column is shared by all the threads, blocks of even sizes stay
+ * whole.
+ */
+template <typename VectorT>
+template <typename BlocksT>
+std::vector<uint64_t> DiskVector<VectorT>::split_column(BlocksT &blocks,
+                                                        uint64_t nthreads) {
+  uint64_t column_nnz = 0;
+  for (auto &block : blocks) {
+    if (block != nullptr)
+      column_nnz += block->get_nonzeros();
+  }
+
+  std::vector<uint64_t> nparts(blocks.size(), 1);
+  for (uint64_t i = 0; i < blocks.size(); i++) {
+    if (blocks[i] != nullptr && column_nnz > 0) {
+      uint64_t share =
+          (blocks[i]->get_nonzeros() * nthreads + column_nnz - 1) / column_nnz;
+      nparts[i] = std::min(std::max<uint64_t>(share, 1), nthreads);
+    }
+  }
+  return nparts;
+}
+
+/*! Adds the partial slice of a thread to the accumulator of its line,
+ * and zeroes it for the next line */
+template <typename VectorT>
+void DiskVector<VectorT>::fold_partial(AccumulatorHandle &partial,
+                                       uint64_t line,
+                                       std::vector<AccumulatorHandle> &accs,
+                                       std::vector<std::mutex> &owners) {
+  if (partial == nullptr || line >= accs.size())
+    return;
+
+  std::lock_guard<std::mutex> lock(owners[line]);
+  AccumulatorType &acc = *accs[line];
+  for (uint64_t e = 0; e < props->window; e++) {
+    acc[e] += (*partial)[e];
+    (*partial)[e] = 0.;
+  }
+}
+
+/*! `1 / rdvec`, 0 where `rdvec` is 0 */
+template <typename VectorT>
+template <typename RVectorT>
+void DiskVector<VectorT>::reciprocal_of(DiskVector<RVectorT> &rdvec) {
+#pragma omp parallel for schedule(dynamic)
+  for (uint64_t slice = 0; slice < props->nslices; slice++) {
+    SliceHandle resbuf = acquire_slice();
+    typename DiskVector<RVectorT>::SliceHandle rbuf = rdvec.acquire_slice();
+    VectorView<typename VectorT::ValueType> res = this->output_slice(slice, *resbuf);
+    VectorView<typename RVectorT::ValueType> rvec = rdvec.view_slice(slice, *rbuf);
+
+    for (uint64_t i = 0; i < res.size(); i++) {
+      res[i] = rvec[i] != 0 ? 1. / static_cast<double>(rvec[i]) : 0.;
+    }
+    save_view(slice, *resbuf);
+  }
+  commit();
+}
+
+/*! Term by term `a * ldvec * rdvec` */
+template <typename VectorT>
+template <typename LVectorT, typename RVectorT>
+void DiskVector<VectorT>::dvec_prod_dvec(double a, DiskVector<LVectorT> &ldvec,
+                                         DiskVector<RVectorT> &rdvec) {
+#pragma omp parallel for schedule(dynamic)
+  for (uint64_t slice = 0; slice < props->nslices; slice++) {
+    SliceHandle resbuf = acquire_slice();
+    typename DiskVector<LVectorT>::SliceHandle lbuf = ldvec.acquire_slice();
+    typename DiskVector<RVectorT>::SliceHandle rbuf = rdvec.acquire_slice();
+    VectorView<typename VectorT::ValueType> res = this->output_slice(slice, *resbuf);
+    VectorView<typename LVectorT::ValueType> lvec = ldvec.view_slice(slice, *lbuf);
+    VectorView<typename RVectorT::ValueType> rvec = rdvec.view_slice(slice, *rbuf);
+
+    for (uint64_t i = 0; i < res.size(); i++) {
+      res[i] = a * static_cast<double>(lvec[i]) * rvec[i];
+    }
+    save_view(slice, *resbuf);
+  }
+  commit();
+}
+
+/*! Term by term `a * ldvec / rdvec`, 0 where `rdvec` is 0 */
+template <typename VectorT>
+template <typename LVectorT, typename RVectorT>
+void DiskVector<VectorT>::dvec_over_dvec(double a, DiskVector<LVectorT> &ldvec,
+                                         DiskVector<RVectorT> &rdvec) {
+#pragma omp parallel for schedule(dynamic)
+  for (uint64_t slice = 0; slice < props->nslices; slice++) {
+    SliceHandle resbuf = acquire_slice();
+    typename DiskVector<LVectorT>::SliceHandle lbuf = ldvec.acquire_slice();
+    typename DiskVector<RVectorT>::SliceHandle rbuf = rdvec.acquire_slice();
+    VectorView<typename VectorT::ValueType> res = this->output_slice(slice, *resbuf);
+    VectorView<typename LVectorT::ValueType> lvec = ldvec.view_slice(slice, *lbuf);
+    VectorView<typename RVectorT::ValueType> rvec = rdvec.view_slice(slice, *rbuf);
+
+    for (uint64_t i = 0; i < res.size(); i++) {
+      res[i] = rvec[i] != 0 ? a * (static_cast<double>(lvec[i]) / rvec[i]) : 0.;
     }
-    res.save(this->get_slice_filename(line));
+    save_view(slice, *resbuf);
   }
+  commit();
 }
 
 } // namespace graphee
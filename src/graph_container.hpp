@@ -0,0 +1,408 @@
+#ifndef GRAPHEE_GRAPH_CONTAINER_HPP__
+#define GRAPHEE_GRAPH_CONTAINER_HPP__
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "utils.hpp"
+#include "mapped_file.hpp"
+
+namespace graphee
+{
+
+/*! \brief Single file holding all the blocks and slices of a graph
+ *
+ * Each `.gpe` image is an extent of the container, named after the
+ * file it replaces (`<graph>_<matrix>_dmatblk_L_C.gpe`, ...). Layout:
+ * - a header page: `uint64_t` magic number `GraphContainer::magic`,
+ *   version, offset and size of the index,
+ * - extents starting on `MappedFile::alignment` boundaries, they are
+ *   mapped in place by `map()`,
+ * - the index, itself an extent: `uint64_t` number of entries, then
+ *   for each entry its offset, size and name size (`uint64_t`) and
+ *   its name.
+ *
+ * Writes never overwrite an extent of the committed index: `write()`
+ * and `swap()` only change the index in memory, `commit()` writes a new
+ * index and switches the header to it. A crash leaves the container at
+ * its last commit. Extents released by a commit are reused by the next
+ * writes, the file does not grow with the iterations.
+ */
+
+class GraphContainer
+{
+public:
+  GraphContainer(std::string filename);
+  ~GraphContainer();
+
+  GraphContainer(const GraphContainer &) = delete;
+  GraphContainer &operator=(const GraphContainer &) = delete;
+
+  void write(const std::string &key, const std::vector<char> &image);
+  MappedFile map(const std::string &key);
+  bool contains(const std::string &key);
+  uint64_t size_of(const std::string &key);
+
+  void swap(const std::string &lkey, const std::string &rkey);
+  void commit();
+
+  uint64_t get_nentries();
+
+  static const uint64_t magic{0x31544e4f43455047}; // "GPECONT1"
+  static const uint64_t current_version{1};
+
+private:
+  struct Extent
+  {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  std::string filename;
+  int fd;
+
+  std::map<std::string, Extent> index;
+  Extent index_extent;
+
+  /* Free space, reusable now or after the next commit */
+  std::map<uint64_t, uint64_t> free_extents;
+  std::vector<Extent> released;
+  uint64_t tail;
+
+  std::mutex mtx;
+
+  uint64_t allocate(uint64_t size);
+  void release(const Extent &extent);
+  void add_free(uint64_t offset, uint64_t length);
+  void read_index();
+
+  void pwrite_all(const char *data, size_t bytes, uint64_t offset);
+  void pread_all(char *data, size_t bytes, uint64_t offset);
+}; // class graphee::GraphContainer
+
+inline GraphContainer::GraphContainer(std::string filename)
+  : filename(filename), index_extent({0, 0}), tail(MappedFile::alignment)
+{
+  fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    std::ostringstream err;
+    err << "Could not open container \'" << filename << "\'";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+
+  if (st.st_size == 0)
+  {
+    commit();
+  }
+  else
+  {
+    read_index();
+  }
+}
+
+inline GraphContainer::~GraphContainer()
+{
+  if (fd >= 0)
+    close(fd);
+}
+
+/*! Stores `image` under `key`, it replaces the previous one for the
+ * readers of this process and becomes durable at the next `commit()`.
+ * Thread safe, the copy into the file is done without lock.
+ */
+inline void GraphContainer::write(const std::string &key, const std::vector<char> &image)
+{
+  Extent extent;
+  extent.size = image.size();
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    extent.offset = allocate(extent.size);
+  }
+
+  pwrite_all(image.data(), image.size(), extent.offset);
+
+  std::lock_guard<std::mutex> lock(mtx);
+  auto found = index.find(key);
+  if (found != index.end())
+  {
+    release(found->second);
+  }
+  index[key] = extent;
+}
+
+/*! Maps the extent of `key` in place, the mapping stays valid until
+ * the entry is replaced and the replacement committed
+ */
+inline MappedFile GraphContainer::map(const std::string &key)
+{
+  Extent extent;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto found = index.find(key);
+    if (found == index.end())
+    {
+      std::ostringstream err;
+      err << "No entry \'" << key << "\' in container \'" << filename << "\'";
+      print_error(err.str());
+      exit(-1);
+    }
+    extent = found->second;
+  }
+
+  return MappedFile(fd, extent.offset, extent.size);
+}
+
+inline bool GraphContainer::contains(const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  return index.find(key) != index.end();
+}
+
+/*! Size of the image `key`, 0 if there is none */
+inline uint64_t GraphContainer::size_of(const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  auto found = index.find(key);
+  return found == index.end() ? 0 : found->second.size;
+}
+
+/*! Exchanges the extents of two entries, nothing is copied */
+inline void GraphContainer::swap(const std::string &lkey, const std::string &rkey)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  auto lentry = index.find(lkey);
+  auto rentry = index.find(rkey);
+
+  if (lentry == index.end() || rentry == index.end())
+  {
+    std::ostringstream err;
+    err << "Could not swap \'" << lkey << "\' and \'" << rkey << "\' in container \'" << filename << "\'";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  std::swap(lentry->second, rentry->second);
+}
+
+/*! Makes every write since the previous commit durable at once: the
+ * new index is synced before the header points to it
+ */
+inline void GraphContainer::commit()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+
+  std::vector<char> image(sizeof(uint64_t));
+  uint64_t nentries = index.size();
+  std::memcpy(image.data(), &nentries, sizeof(uint64_t));
+
+  for (auto &entry : index)
+  {
+    uint64_t desc[3] = {entry.second.offset, entry.second.size, entry.first.size()};
+    const char *desc_bytes = reinterpret_cast<const char *>(desc);
+    image.insert(image.end(), desc_bytes, desc_bytes + sizeof(desc));
+    image.insert(image.end(), entry.first.begin(), entry.first.end());
+  }
+
+  Extent new_index;
+  new_index.size = image.size();
+  new_index.offset = allocate(new_index.size);
+  pwrite_all(image.data(), image.size(), new_index.offset);
+
+  if (fdatasync(fd) != 0)
+  {
+    print_warning("Could not sync container \'" + filename + "\'");
+  }
+
+  uint64_t header[4] = {magic, current_version, new_index.offset, new_index.size};
+  pwrite_all(reinterpret_cast<const char *>(header), sizeof(header), 0);
+
+  if (fdatasync(fd) != 0)
+  {
+    print_warning("Could not sync container \'" + filename + "\'");
+  }
+
+  /* Nothing refers to the released extents anymore */
+  if (index_extent.size != 0)
+  {
+    released.push_back(index_extent);
+  }
+  index_extent = new_index;
+
+  for (const Extent &extent : released)
+  {
+    add_free(extent.offset, MappedFile::align(std::max<uint64_t>(extent.size, 1)));
+  }
+  released.clear();
+}
+
+inline uint64_t GraphContainer::get_nentries()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  return index.size();
+}
+
+/*! First fit among the free extents, else at the end of the file */
+inline uint64_t GraphContainer::allocate(uint64_t size)
+{
+  uint64_t needed = MappedFile::align(std::max<uint64_t>(size, 1));
+
+  for (auto it = free_extents.begin(); it != free_extents.end(); ++it)
+  {
+    if (it->second >= needed)
+    {
+      uint64_t offset = it->first;
+      uint64_t remaining = it->second - needed;
+      free_extents.erase(it);
+
+      if (remaining > 0)
+      {
+        free_extents[offset + needed] = remaining;
+      }
+      return offset;
+    }
+  }
+
+  uint64_t offset = tail;
+  tail += needed;
+  return offset;
+}
+
+/*! Inserts a free extent, merged with its free neighbours */
+inline void GraphContainer::add_free(uint64_t offset, uint64_t length)
+{
+  auto next = free_extents.lower_bound(offset);
+  if (next != free_extents.end() && offset + length == next->first)
+  {
+    length += next->second;
+    free_extents.erase(next);
+  }
+
+  auto prev = free_extents.lower_bound(offset);
+  if (prev != free_extents.begin())
+  {
+    --prev;
+    if (prev->first + prev->second == offset)
+    {
+      prev->second += length;
+      return;
+    }
+  }
+
+  free_extents[offset] = length;
+}
+
+/*! The extent may still be in the committed index, it is only reused
+ * after the next commit
+ */
+inline void GraphContainer::release(const Extent &extent)
+{
+  released.push_back(extent);
+}
+
+/*! Loads the committed index, the gaps between extents are free */
+inline void GraphContainer::read_index()
+{
+  uint64_t header[4];
+  pread_all(reinterpret_cast<char *>(header), sizeof(header), 0);
+
+  if (header[0] != magic || header[1] != current_version)
+  {
+    std::ostringstream err;
+    err << "\'" << filename << "\' is not a graph container of version " << current_version;
+    print_error(err.str());
+    exit(-1);
+  }
+
+  index_extent.offset = header[2];
+  index_extent.size = header[3];
+
+  std::vector<char> image(index_extent.size);
+  pread_all(image.data(), image.size(), index_extent.offset);
+
+  uint64_t nentries;
+  size_t pos = 0;
+  std::memcpy(&nentries, image.data(), sizeof(uint64_t));
+  pos += sizeof(uint64_t);
+
+  std::map<uint64_t, uint64_t> used;
+  used[index_extent.offset] = MappedFile::align(index_extent.size);
+
+  for (uint64_t i = 0; i < nentries; i++)
+  {
+    uint64_t desc[3];
+    std::memcpy(desc, image.data() + pos, sizeof(desc));
+    pos += sizeof(desc);
+
+    Extent extent = {desc[0], desc[1]};
+    index[std::string(image.data() + pos, desc[2])] = extent;
+    pos += desc[2];
+
+    used[extent.offset] = MappedFile::align(std::max<uint64_t>(extent.size, 1));
+  }
+
+  tail = MappedFile::alignment;
+  for (auto &extent : used)
+  {
+    if (extent.first > tail)
+    {
+      add_free(tail, extent.first - tail);
+    }
+    tail = std::max(tail, extent.first + extent.second);
+  }
+}
+
+inline void GraphContainer::pwrite_all(const char *data, size_t bytes, uint64_t offset)
+{
+  while (bytes > 0)
+  {
+    ssize_t ret = pwrite(fd, data, bytes, offset);
+    if (ret < 0)
+    {
+      std::ostringstream err;
+      err << "Write to container \'" << filename << "\' failed";
+      print_error(err.str());
+      exit(-1);
+    }
+    data += ret;
+    bytes -= ret;
+    offset += ret;
+  }
+}
+
+inline void GraphContainer::pread_all(char *data, size_t bytes, uint64_t offset)
+{
+  while (bytes > 0)
+  {
+    ssize_t ret = pread(fd, data, bytes, offset);
+    if (ret <= 0)
+    {
+      std::ostringstream err;
+      err << "Truncated container \'" << filename << "\'";
+      print_error(err.str());
+      exit(-1);
+    }
+    data += ret;
+    bytes -= ret;
+    offset += ret;
+  }
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_GRAPH_CONTAINER_HPP__
@@ -3,6 +3,21 @@
 
 #include "properties.hpp"
 #include "utils.hpp"
+#include "mapped_file.hpp"
+#include "codec.hpp"
+#include "block_header.hpp"
+#include "graph_container.hpp"
+#include "storage_roots.hpp"
+#include "block_store.hpp"
+#include "block_manifest.hpp"
+#include "block_cache.hpp"
+#include "block_schedule.hpp"
+#include "object_pool.hpp"
+#include "block_layout.hpp"
+#include "vector_filter.hpp"
+#include "spmv_kernel.hpp"
+#include "prefetcher.hpp"
+#include "write_behind.hpp"
 #include "sparse_matrix_csr.hpp"
 #include "sparse_bmatrix_csr.hpp"
 #include "disk_sparse_matrix.hpp"
@@ -10,5 +25,6 @@
 #include "vector.hpp"
 #include "pagerank.hpp"
 #include "edgelist.hpp"
+#include "bvgraph.hpp"
 
 #endif // GRAPHEE_H
@@ -0,0 +1,328 @@
+#ifndef GRAPHEE_MAPPED_FILE_HPP__
+#define GRAPHEE_MAPPED_FILE_HPP__
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.hpp"
+
+namespace graphee
+{
+
+/*! \brief Read-only memory mapping of a whole file
+ *
+ * The mapping is shared (`MAP_SHARED`), thus the pages are the ones of
+ * the OS page cache: they are reused between iterations and between
+ * processes reading the same `.gpe` file.
+ * `MappedFile::writable()` maps a file in read-write, its changes reach
+ * the file at the latest on `sync()`.
+ * The object is move-only, the mapping is released by the destructor.
+ */
+
+class MappedFile
+{
+public:
+  MappedFile() : addr(nullptr), length(0) {}
+
+  MappedFile(std::string filename);
+  MappedFile(int fd, uint64_t offset, size_t length);
+
+  static MappedFile writable(std::string filename, size_t length);
+
+  MappedFile(MappedFile &&mfile) : addr(mfile.addr), length(mfile.length)
+  {
+    mfile.addr = nullptr;
+    mfile.length = 0;
+  }
+
+  MappedFile &operator=(MappedFile &&mfile);
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile()
+  {
+    unmap();
+  }
+
+  const char *data() const;
+  char *mutable_data();
+  size_t size() const;
+  bool is_mapped() const;
+
+  template <typename T>
+  T get(size_t offset) const;
+
+  void advise(int advice);
+  void advise(size_t offset, size_t bytes, int advice);
+  void sync();
+  void unmap();
+
+  /*! Sections of in-place layouts start on page boundaries */
+  static const size_t alignment{1UL << 12};
+
+  static size_t align(size_t offset);
+
+private:
+  void *addr;
+  size_t length;
+}; // class graphee::MappedFile
+
+/*! \brief Section table of the `Utils::ALIGNED` layout
+ *
+ * It is written right after the common header (typename, fileformat
+ * and dimensions), each offset is counted from the beginning of the
+ * file and is a multiple of `MappedFile::alignment`.
+ */
+struct AlignedLayout
+{
+  static const uint32_t current_version{1};
+
+  uint32_t version;
+  uint32_t alignment;
+  uint64_t ia_offset;
+  uint64_t ja_offset;
+  uint64_t a_offset;
+};
+
+/*! \brief Read-only stream buffer over bytes owned by someone else */
+class MemoryBuffer : public std::streambuf
+{
+public:
+  MemoryBuffer(const char *data, size_t size)
+  {
+    char *begin = const_cast<char *>(data);
+    setg(begin, begin, begin + size);
+  }
+
+protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode)
+  {
+    char *base = dir == std::ios_base::beg ? eback() : (dir == std::ios_base::cur ? gptr() : egptr());
+    if (off < eback() - base || off > egptr() - base)
+      return pos_type(off_type(-1));
+
+    setg(eback(), base + off, egptr());
+    return pos_type(gptr() - eback());
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+  {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+}; // class graphee::MemoryBuffer
+
+/*! \brief Input stream over a mapping it owns, read like a `std::ifstream`
+ *
+ * Positions are counted from the beginning of the mapping, the `.gpe`
+ * readers thus work on a file as on an extent of a `GraphContainer`.
+ */
+class MappedStream : public std::istream
+{
+public:
+  MappedStream(MappedFile &&mfile) : std::istream(nullptr), file(std::move(mfile)), buf(file.data(), file.size())
+  {
+    rdbuf(&buf);
+  }
+
+  /*! The mapping, it can be moved out to be used in place */
+  MappedFile &mapping()
+  {
+    return file;
+  }
+
+private:
+  MappedFile file;
+  MemoryBuffer buf;
+}; // class graphee::MappedStream
+
+/*! \brief Input stream over an image in memory, e.g. a block kept
+ *         compressed by the `BlockCache`; the bytes must outlive it
+ */
+class MemoryStream : public std::istream
+{
+public:
+  MemoryStream(const char *data, size_t size) : std::istream(nullptr), buf(data, size)
+  {
+    rdbuf(&buf);
+  }
+
+private:
+  MemoryBuffer buf;
+}; // class graphee::MemoryStream
+
+inline MappedFile::MappedFile(std::string filename) : addr(nullptr), length(0)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::ostringstream err;
+    err << "Could not open file \'" << filename << "\' for mapping";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    std::ostringstream err;
+    err << "Could not stat file \'" << filename << "\' for mapping";
+    print_error(err.str());
+    close(fd);
+    exit(-1);
+  }
+
+  length = static_cast<size_t>(st.st_size);
+  addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps its own reference to the file
+
+  if (addr == MAP_FAILED)
+  {
+    std::ostringstream err;
+    err << "Could not map file \'" << filename << "\'";
+    print_error(err.str());
+    addr = nullptr;
+    length = 0;
+    exit(-1);
+  }
+}
+
+/*! Maps `length` bytes of an open file from `offset`, which must be a
+ * multiple of `MappedFile::alignment`
+ */
+inline MappedFile::MappedFile(int fd, uint64_t offset, size_t length) : addr(nullptr), length(length)
+{
+  addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(offset));
+
+  if (addr == MAP_FAILED)
+  {
+    std::ostringstream err;
+    err << "Could not map " << length << " bytes at offset " << offset;
+    print_error(err.str());
+    addr = nullptr;
+    this->length = 0;
+    exit(-1);
+  }
+}
+
+/*! Maps `filename` in read-write, the file is created or resized to
+ * `length` bytes
+ */
+inline MappedFile MappedFile::writable(std::string filename, size_t length)
+{
+  int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0 || ftruncate(fd, static_cast<off_t>(length)) != 0)
+  {
+    std::ostringstream err;
+    err << "Could not open file \'" << filename << "\' for a writable mapping";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  MappedFile mfile;
+  mfile.addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mfile.addr == MAP_FAILED)
+  {
+    std::ostringstream err;
+    err << "Could not map file \'" << filename << "\' in read-write";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  mfile.length = length;
+  return mfile;
+}
+
+inline MappedFile &MappedFile::operator=(MappedFile &&mfile)
+{
+  std::swap(addr, mfile.addr);
+  std::swap(length, mfile.length);
+  return *this;
+}
+
+inline const char *MappedFile::data() const
+{
+  return static_cast<const char *>(addr);
+}
+
+/*! Only for a mapping made by `writable()` */
+inline char *MappedFile::mutable_data()
+{
+  return static_cast<char *>(addr);
+}
+
+inline size_t MappedFile::size() const
+{
+  return length;
+}
+
+inline bool MappedFile::is_mapped() const
+{
+  return addr != nullptr;
+}
+
+/*! Reads a value stored at `offset`, unaligned accesses are allowed */
+template <typename T>
+T MappedFile::get(size_t offset) const
+{
+  T val;
+  std::memcpy(&val, data() + offset, sizeof(T));
+  return val;
+}
+
+/*! Forwards an access pattern hint (`MADV_*`) to the kernel */
+inline void MappedFile::advise(int advice)
+{
+  if (addr != nullptr)
+  {
+    madvise(addr, length, advice);
+  }
+}
+
+/*! Hint for the pages holding [offset; offset + bytes) */
+inline void MappedFile::advise(size_t offset, size_t bytes, int advice)
+{
+  if (addr != nullptr && bytes > 0)
+  {
+    size_t first = offset / alignment * alignment;
+    madvise(static_cast<char *>(addr) + first, std::min(align(offset + bytes), length) - first, advice);
+  }
+}
+
+/*! Writes the modified pages of a writable mapping to the file */
+inline void MappedFile::sync()
+{
+  if (addr != nullptr)
+  {
+    msync(addr, length, MS_SYNC);
+  }
+}
+
+inline void MappedFile::unmap()
+{
+  if (addr != nullptr)
+  {
+    munmap(addr, length);
+    addr = nullptr;
+    length = 0;
+  }
+}
+
+inline size_t MappedFile::align(size_t offset)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_MAPPED_FILE_HPP__
@@ -0,0 +1,142 @@
+#ifndef GRAPHEE_MERGE_PATH_HPP__
+#define GRAPHEE_MERGE_PATH_HPP__
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace graphee
+{
+
+/*! \brief Split of a CSR product in parts of equal work, rows plus
+ *         non-zero elements, along the merge path of `ia`
+ *
+ * The ends of the lines and the elements are merged into a single path
+ * which is cut in `nparts` equal segments, thus a part holds as many
+ * elements as lines it leaves out. A line longer than a segment, e.g. a
+ * hub of a web graph, is shared by several parts: each part sums its
+ * own elements of the line and the sums of the line it ends within are
+ * added by `run()` once all the parts are done. `run_part()` computes a
+ * single part in the calling thread, into a result of its own.
+ */
+
+class MergePath
+{
+public:
+  /*! Start of a part: its first line and its first element */
+  struct Coord
+  {
+    uint64_t row;
+    uint64_t nz;
+  };
+
+  static std::vector<Coord> split(const uint64_t *ia, uint64_t m, uint64_t nparts);
+
+  template <typename ValueT, typename RowsT, typename SumT>
+  static void run(const std::vector<Coord> &parts, const uint64_t *ia, uint64_t m, ValueT *res,
+                  uint64_t nthreads, RowsT rows, SumT sum);
+
+  template <typename ValueT, typename RowsT, typename SumT>
+  static void run_part(const std::vector<Coord> &parts, uint64_t p, const uint64_t *ia, uint64_t m, ValueT *res,
+                       RowsT rows, SumT sum);
+}; // class graphee::MergePath
+
+/*! `nparts + 1` coordinates, the last one is the end of the matrix */
+inline std::vector<MergePath::Coord> MergePath::split(const uint64_t *ia, uint64_t m, uint64_t nparts)
+{
+  const uint64_t nz_first = ia[0];
+  const uint64_t nnz = ia[m] - nz_first;
+  const uint64_t length = m + nnz;
+
+  std::vector<Coord> parts(nparts + 1);
+  for (uint64_t p = 0; p <= nparts; p++)
+  {
+    uint64_t diagonal = length * p / nparts;
+
+    /* Number of lines ended before the diagonal */
+    uint64_t lo = diagonal > nnz ? diagonal - nnz : 0;
+    uint64_t hi = std::min(diagonal, m);
+    while (lo < hi)
+    {
+      uint64_t pivot = (lo + hi) / 2;
+      if (ia[pivot + 1] - nz_first <= diagonal - pivot - 1)
+        lo = pivot + 1;
+      else
+        hi = pivot;
+    }
+
+    parts[p].row = lo;
+    parts[p].nz = nz_first + diagonal - lo;
+  }
+  return parts;
+}
+
+/*! `rows(first, last)` adds the whole lines [first; last) to `res`,
+ * `sum(begin, end)` returns the sum of the elements [begin; end)
+ */
+template <typename ValueT, typename RowsT, typename SumT>
+void MergePath::run(const std::vector<Coord> &parts, const uint64_t *ia, uint64_t m, ValueT *res,
+                    uint64_t nthreads, RowsT rows, SumT sum)
+{
+  const uint64_t nparts = parts.size() - 1;
+  std::vector<ValueT> carry(nparts, 0);
+
+#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+  for (uint64_t p = 0; p < nparts; p++)
+  {
+    const Coord &start = parts[p];
+    const Coord &end = parts[p + 1];
+
+    uint64_t row = start.row;
+    if (row < end.row && start.nz > ia[row])
+    {
+      res[row] += sum(start.nz, ia[row + 1]);
+      row++;
+    }
+
+    rows(row, end.row);
+
+    if (end.row < m)
+    {
+      carry[p] = sum(std::max(start.nz, ia[end.row]), end.nz);
+    }
+  }
+
+  for (uint64_t p = 0; p < nparts; p++)
+  {
+    if (parts[p + 1].row < m)
+    {
+      res[parts[p + 1].row] += carry[p];
+    }
+  }
+}
+
+/*! The part `p`, the sums of the lines it shares with its neighbours
+ * are added to `res` at once: `res` must not be written by the other
+ * parts meanwhile
+ */
+template <typename ValueT, typename RowsT, typename SumT>
+void MergePath::run_part(const std::vector<Coord> &parts, uint64_t p, const uint64_t *ia, uint64_t m, ValueT *res,
+                         RowsT rows, SumT sum)
+{
+  const Coord &start = parts[p];
+  const Coord &end = parts[p + 1];
+
+  uint64_t row = start.row;
+  if (row < end.row && start.nz > ia[row])
+  {
+    res[row] += sum(start.nz, ia[row + 1]);
+    row++;
+  }
+
+  rows(row, end.row);
+
+  if (end.row < m)
+  {
+    res[end.row] += sum(std::max(start.nz, ia[end.row]), end.nz);
+  }
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_MERGE_PATH_HPP__
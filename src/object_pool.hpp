@@ -0,0 +1,125 @@
+#ifndef GRAPHEE_OBJECT_POOL_HPP__
+#define GRAPHEE_OBJECT_POOL_HPP__
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <iterator>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+namespace graphee
+{
+
+/*! \brief Objects handed back by their handles and handed again by
+ *         `acquire()`, their buffers are reused without any allocation
+ *         nor page fault
+ *
+ * The idle objects are sorted by size class, the power of two below
+ * the number of elements they held (`measure`). `acquire(size)` takes
+ * an idle object of the smallest class of at least `size` elements,
+ * else the largest idle object, and makes a new one only when none is
+ * idle.
+ * At most `max_idle` objects are kept, the others are deleted.
+ *
+ * A handle is a `std::shared_ptr` which keeps its pool alive.
+ */
+
+template <typename T>
+class ObjectPool : public std::enable_shared_from_this<ObjectPool<T>>
+{
+public:
+  using Handle = std::shared_ptr<T>;
+
+  static std::shared_ptr<ObjectPool<T>> create(std::function<T *()> make, std::function<uint64_t(T &)> measure,
+                                               size_t max_idle)
+  {
+    return std::shared_ptr<ObjectPool<T>>(new ObjectPool<T>(make, measure, max_idle));
+  }
+
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  Handle acquire(uint64_t size = 0);
+
+  /*! Objects made since the pool was created */
+  uint64_t allocations() const
+  {
+    return nmade;
+  }
+
+  static uint64_t size_class(uint64_t size);
+
+private:
+  ObjectPool(std::function<T *()> make, std::function<uint64_t(T &)> measure, size_t max_idle)
+    : make(make), measure(measure), max_idle(max_idle), nmade(0)
+  {
+  }
+
+  std::function<T *()> make;
+  std::function<uint64_t(T &)> measure;
+  const size_t max_idle;
+
+  std::mutex mtx;
+  std::multimap<uint64_t, std::unique_ptr<T>> idle;
+  std::atomic<uint64_t> nmade;
+
+  void release(T *obj);
+}; // class graphee::ObjectPool
+
+template <typename T>
+typename ObjectPool<T>::Handle ObjectPool<T>::acquire(uint64_t size)
+{
+  std::shared_ptr<ObjectPool<T>> self = this->shared_from_this();
+  T *obj = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!idle.empty())
+    {
+      auto found = idle.lower_bound(size);
+      if (found == idle.end())
+        found = std::prev(idle.end());
+
+      obj = found->second.release();
+      idle.erase(found);
+    }
+  }
+
+  if (obj == nullptr)
+  {
+    obj = make();
+    nmade++;
+  }
+
+  return Handle(obj, [self](T *released)
+  {
+    self->release(released);
+  });
+}
+
+template <typename T>
+uint64_t ObjectPool<T>::size_class(uint64_t size)
+{
+  uint64_t size_class = 1;
+  while (size_class <= size / 2)
+  {
+    size_class <<= 1;
+  }
+  return size == 0 ? 0 : size_class;
+}
+
+template <typename T>
+void ObjectPool<T>::release(T *obj)
+{
+  std::unique_ptr<T> owned(obj);
+  uint64_t obj_class = size_class(measure(*obj));
+
+  std::lock_guard<std::mutex> lock(mtx);
+  if (idle.size() < max_idle)
+    idle.insert(std::make_pair(obj_class, std::move(owned)));
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_OBJECT_POOL_HPP__
@@ -12,7 +12,17 @@
 
 namespace graphee {
 
-template <typename DiskSparseMatrixT> class Pagerank {
+/*! \brief Pagerank over a `DiskSparseMatrix`
+ *
+ * `RankT` is the type of the stored scores, and of the contributions
+ * read by each block of the product, `DegreeT` the one of the stored
+ * out-degrees, e.g. `float` and `uint32_t` halve the size of the slices
+ * read at each iteration. Sums are always done in `double`, with a
+ * compensated summation for the statistics over all the vertices.
+ */
+template <typename DiskSparseMatrixT, typename RankT = double,
+          typename DegreeT = double>
+class Pagerank {
 public:
   /** Constructor of the Pagerank object
    *
@@ -26,7 +36,26 @@ public:
    */
   Pagerank(Properties *properties, DiskSparseMatrixT *adjency_matrix,
            double damp = 0.85)
-      : props(properties), adj_mat(adjency_matrix), damp(damp) {}
+      : props(properties), adj_mat(adjency_matrix), damp(damp),
+        vector_format(Utils::BIN),
+        write_behind_bytes(properties->nthreads * properties->window *
+                           sizeof(double)) {}
+
+  /** File format of the pagerank vectors
+   *
+   * @param fileformat `Utils::MAPPED` keeps each vector in a single mapped
+   * file, other formats write them slice by slice
+   */
+  void set_vector_format(int fileformat) { vector_format = fileformat; }
+
+  /** Slices of the products written behind the iterations
+   *
+   * @param max_dirty_bytes Bound of the slices queued and not yet written,
+   * one slice per thread by default, 0 writes them in the products
+   */
+  void set_write_behind(uint64_t max_dirty_bytes) {
+    write_behind_bytes = max_dirty_bytes;
+  }
 
   /** Compute the Pagerank
    *
@@ -45,21 +74,28 @@ private:
   const double damp;           ///< The pagerank damping factor
   Properties *props;          ///< Pointer to the graph properties
   DiskSparseMatrixT *adj_mat; ///< Pointer to the ajacency matrix
+  int vector_format;          ///< File format of the disk vectors
+  uint64_t write_behind_bytes; ///< Bound of the slices written behind
 
-  DiskVector<Vector<double>> pagerank; ///< Disk vector to save pagerank
-  DiskVector<Vector<double>>
+  DiskVector<Vector<RankT>> pagerank; ///< Disk vector to save pagerank
+  DiskVector<Vector<RankT>>
       pagerank_itp1; ///< Temporary disk vector to save pagerank at iteration+1
-  DiskVector<Vector<double>>
+  DiskVector<Vector<DegreeT>>
       out_bounds; ///< Disk vector to save the number of out links
+  DiskVector<Vector<RankT>>
+      inv_out_bounds; ///< Reciprocal of out_bounds, 0 for the sink nodes
+  DiskVector<Vector<RankT>>
+      contributions; ///< damp * pagerank / out_bounds, given by each node
   
-  void pagerankStatistic(DiskVector<Vector<double>> &pagerank_itp1,
-                       DiskVector<Vector<double>> &pagerank,
-                       DiskVector<Vector<double>> &out_bounds, double &sinkScore,
+  void pagerankStatistic(DiskVector<Vector<RankT>> &pagerank_itp1,
+                       DiskVector<Vector<RankT>> &pagerank,
+                       DiskVector<Vector<DegreeT>> &out_bounds, double &sinkScore,
                        double &sumScore, double &scoreVariation);
 };
 
-template <typename DiskSparseMatrixT>
-void Pagerank<DiskSparseMatrixT>::compute_pagerank(uint64_t niters) {
+template <typename DiskSparseMatrixT, typename RankT, typename DegreeT>
+void Pagerank<DiskSparseMatrixT, RankT, DegreeT>::compute_pagerank(
+    uint64_t niters) {
   // One verifies that the ajacency matrix is not empty
   if (adj_mat->empty()) {
     print_error("Cannot compute PageRank, the \'adjency_matrix\' is empty");
@@ -67,12 +103,19 @@ void Pagerank<DiskSparseMatrixT>::compute_pagerank(uint64_t niters) {
   }
 
   // number of outlinks of each node
-  out_bounds = std::move(DiskVector<Vector<double>>(props, "ob", 0));
+  out_bounds = std::move(DiskVector<Vector<DegreeT>>(props, "ob", 0, vector_format));
   out_bounds.dmat_columns_sum(*adj_mat);
 
+  // out_bounds do not change with the iterations, their reciprocal is kept
+  inv_out_bounds = std::move(DiskVector<Vector<RankT>>(props, "iob", 0., vector_format));
+  inv_out_bounds.reciprocal_of(out_bounds);
+  contributions = std::move(DiskVector<Vector<RankT>>(props, "contrib", 0., vector_format));
+  contributions.set_write_behind(write_behind_bytes);
+
   // pagerank is initiated to 1/N.
   pagerank = std::move(
-      DiskVector<Vector<double>>(props, "pr", 1. / ((double)props->nvertices)));
+      DiskVector<Vector<RankT>>(props, "pr", 1. / ((double)props->nvertices),
+                                vector_format));
 
   // count the number of nodes without outlinks
   uint64_t n_sink_nodes = out_bounds.countZeros();
@@ -84,6 +127,12 @@ void Pagerank<DiskSparseMatrixT>::compute_pagerank(uint64_t niters) {
   // sum of all pagerank score
   double sumScore = 1.;
 
+  // the vector at iteration T+1 is only reset by each loop, its slices are
+  // written by the product
+  pagerank_itp1 = std::move(DiskVector<Vector<RankT>>(props, "prp1", 0, vector_format));
+  pagerank.set_write_behind(write_behind_bytes);
+  pagerank_itp1.set_write_behind(write_behind_bytes);
+
   for (uint64_t loop_id = 0; loop_id < niters; loop_id++) {
     std::ostringstream oss;
     oss << "Start Pagerank loop #" << loop_id;
@@ -91,14 +140,13 @@ void Pagerank<DiskSparseMatrixT>::compute_pagerank(uint64_t niters) {
 
     // One inits the pagerank vector at iteration T+1 with the score received by
     // random jump plus the redistribution from sink node.
-    pagerank_itp1 = std::move(DiskVector<Vector<double>>(
-        props, "prp1",
-        (1 - sinkScore) * (1. - damp) / ((double)props->nvertices) +
-            sinkScore / ((double)props->nvertices)));
+    pagerank_itp1.fill((1 - sinkScore) * (1. - damp) / ((double)props->nvertices) +
+                       sinkScore / ((double)props->nvertices));
 
-    // We compute \f$ PR_{t+1} \f$
-    pagerank_itp1.dmat_prod_dvec_over_dvec(damp, *adj_mat, pagerank,
-                                           out_bounds);
+    // We compute \f$ PR_{t+1} \f$, the contribution of each node is computed
+    // once, the product reads a single slice per block
+    contributions.dvec_prod_dvec(damp, pagerank, inv_out_bounds);
+    pagerank_itp1.dmat_prod_contributions(*adj_mat, contributions);
 
     // We compute statistics
     pagerankStatistic(pagerank_itp1, pagerank, out_bounds, sinkScore, sumScore,
@@ -110,8 +158,14 @@ void Pagerank<DiskSparseMatrixT>::compute_pagerank(uint64_t niters) {
     print_strong_log("Sink score: " + std::to_string(sinkScore));
     print_strong_log("End of PR iter. #" + std::to_string(loop_id));
 
+    // The slices of this iteration are all written before the next one
+    pagerank_itp1.barrier();
+    contributions.barrier();
     pagerank_itp1.swap(pagerank);
   }
+
+  // the scores are read back from the files of 'pr'
+  pagerank.settle(pagerank_itp1);
 }
 
 /** Compute Pagerank statistics
@@ -123,11 +177,12 @@ void Pagerank<DiskSparseMatrixT>::compute_pagerank(uint64_t niters) {
  * @param sumScore : sum of each node's score. value far from
  * one indicate a bug or numericale error.
  */
-template <typename DiskSparseMatrixT>
-void Pagerank<DiskSparseMatrixT>::pagerankStatistic(DiskVector<Vector<double>> &pagerank_itp1,
-                       DiskVector<Vector<double>> &pagerank,
-                       DiskVector<Vector<double>> &out_bounds, double &sinkScore,
-                       double &sumScore, double &scoreVariation) {
+template <typename DiskSparseMatrixT, typename RankT, typename DegreeT>
+void Pagerank<DiskSparseMatrixT, RankT, DegreeT>::pagerankStatistic(
+    DiskVector<Vector<RankT>> &pagerank_itp1,
+    DiskVector<Vector<RankT>> &pagerank,
+    DiskVector<Vector<DegreeT>> &out_bounds, double &sinkScore,
+    double &sumScore, double &scoreVariation) {
 
   sinkScore = 0;
   sumScore = 0;
@@ -135,19 +190,31 @@ void Pagerank<DiskSparseMatrixT>::pagerankStatistic(DiskVector<Vector<double>> &
 
 #pragma omp parallel for reduction(+ : sinkScore, sumScore, scoreVariation)
   for (uint64_t slice = 0; slice < pagerank.get_nslices(); slice++) {
-    Vector<double> out_bounds_vec(std::move(out_bounds.get_slice(slice)));
-    Vector<double> pagerank_vec(std::move(pagerank.get_slice(slice)));
-    Vector<double> pagerank_itp1_vec(std::move(pagerank_itp1.get_slice(slice)));
+    auto out_bounds_buf = out_bounds.acquire_slice();
+    auto pagerank_buf = pagerank.acquire_slice();
+    auto pagerank_itp1_buf = pagerank_itp1.acquire_slice();
+    VectorView<DegreeT> out_bounds_vec = out_bounds.view_slice(slice, *out_bounds_buf);
+    VectorView<RankT> pagerank_vec = pagerank.view_slice(slice, *pagerank_buf);
+    VectorView<RankT> pagerank_itp1_vec =
+        pagerank_itp1.view_slice(slice, *pagerank_itp1_buf);
 
-    for (int i = 0; i < pagerank_vec.get_lines(); i++) {
-      sumScore += pagerank_itp1_vec[i];
-      scoreVariation += (pagerank_vec[i] - pagerank_itp1_vec[i]) *
-                        (pagerank_vec[i] - pagerank_itp1_vec[i]);
+    KahanSum slice_sum, slice_variation, slice_sink;
+
+    for (uint64_t i = 0; i < pagerank_vec.get_lines(); i++) {
+      double score = pagerank_itp1_vec[i];
+      double delta = static_cast<double>(pagerank_vec[i]) - score;
+
+      slice_sum.add(score);
+      slice_variation.add(delta * delta);
 
       if (out_bounds_vec[i] == 0) {
-        sinkScore += pagerank_itp1_vec[i];
+        slice_sink.add(score);
       }
     }
+
+    sumScore += slice_sum.get();
+    scoreVariation += slice_variation.get();
+    sinkScore += slice_sink.get();
   }
 }
 
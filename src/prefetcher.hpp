@@ -0,0 +1,143 @@
+#ifndef GRAPHEE_PREFETCHER_HPP__
+#define GRAPHEE_PREFETCHER_HPP__
+
+#include <deque>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include "utils.hpp"
+#include "thread_pool.hpp"
+
+namespace graphee
+{
+
+/*! \brief Time spent by the products waiting for their blocks and slices,
+ *         and by the I/O threads loading them
+ */
+struct PrefetchStats
+{
+  std::atomic<uint64_t> nloads;
+  std::atomic<uint64_t> load_ns;
+  std::atomic<uint64_t> stall_ns;
+
+  PrefetchStats() : nloads(0), load_ns(0), stall_ns(0) {}
+
+  void reset()
+  {
+    nloads = 0;
+    load_ns = 0;
+    stall_ns = 0;
+  }
+
+  std::string report() const
+  {
+    std::ostringstream oss;
+    oss << "Prefetch: " << nloads << " loads in " << load_ns * 1e-9 << " s, stalled "
+        << stall_ns * 1e-9 << " s";
+    return oss.str();
+  }
+}; // struct graphee::PrefetchStats
+
+/*! \brief Block of a product with the slice it multiplies */
+template <typename MatrixT, typename VectorT>
+struct BlockSlice
+{
+  MatrixT block;
+  VectorT slice;
+}; // struct graphee::BlockSlice
+
+/*! \brief Loads the items `0 .. nitems-1` of a known order on the I/O
+ *         threads of a `ThreadPool`, `depth` items ahead of the one
+ *         being used
+ *
+ * With a depth of 1 the product of a block overlaps with the read and
+ * decoding of the next block: double buffering. A depth of 0 loads each
+ * item in the calling thread, when it is asked for.
+ */
+
+template <typename ItemT>
+class Prefetcher
+{
+public:
+  Prefetcher(ThreadPool &pool, std::function<ItemT(uint64_t)> load, uint64_t nitems, uint64_t depth,
+             PrefetchStats &stats)
+    : pool(pool), load(load), nitems(nitems), depth(depth), issued(0), stats(stats)
+  {
+  }
+
+  Prefetcher(const Prefetcher &) = delete;
+  Prefetcher &operator=(const Prefetcher &) = delete;
+
+  /*! The loads still running reference the caller, they are waited for */
+  ~Prefetcher()
+  {
+    for (auto &pending : queue)
+    {
+      pending.wait();
+    }
+  }
+
+  ItemT next();
+
+private:
+  ThreadPool &pool;
+  std::function<ItemT(uint64_t)> load;
+  const uint64_t nitems;
+  const uint64_t depth;
+  uint64_t issued;
+  PrefetchStats &stats;
+
+  std::deque<std::future<ItemT>> queue;
+
+  ItemT timed_load(uint64_t item);
+}; // class graphee::Prefetcher
+
+template <typename ItemT>
+ItemT Prefetcher<ItemT>::next()
+{
+  if (depth == 0)
+  {
+    auto start = std::chrono::steady_clock::now();
+    ItemT item = timed_load(issued++);
+    stats.stall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+    return item;
+  }
+
+  /* The next item, and `depth` items after it, are asked for */
+  uint64_t consumed = issued - queue.size();
+  while (issued < nitems && issued <= consumed + depth)
+  {
+    uint64_t item = issued++;
+    queue.push_back(pool.submit([this, item]()
+    {
+      return timed_load(item);
+    }));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  ItemT item = queue.front().get();
+  queue.pop_front();
+  stats.stall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start).count();
+  return item;
+}
+
+template <typename ItemT>
+ItemT Prefetcher<ItemT>::timed_load(uint64_t item)
+{
+  auto start = std::chrono::steady_clock::now();
+  ItemT res = load(item);
+  stats.load_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start).count();
+  stats.nloads++;
+  return res;
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_PREFETCHER_HPP__
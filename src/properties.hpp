@@ -8,11 +8,15 @@
 
 namespace graphee {
 
+class GraphContainer;
+class StorageRoots;
+
 class Properties {
 public:
   Properties()
       : name(""), nvertices(0), declared_nvertices(0), nslices(0), nthreads(0),
-        ram_limit(0), sort_limit(0), nblocks(0), window(0) {}
+        ram_limit(0), sort_limit(0), nblocks(0), window(0),
+        container(nullptr), storage(nullptr) {}
 
   Properties(std::string name, uint64_t declared_nvertices, uint64_t nslices,
              uint64_t nthreads, size_t ram_limit, size_t sort_limit)
@@ -23,7 +27,7 @@ public:
         declared_nvertices(declared_nvertices), nslices(nslices),
         nthreads(nthreads), ram_limit(ram_limit), sort_limit(sort_limit),
         nblocks(nslices * nslices), window(nvertices / nslices),
-        alloc_memory(0) {}
+        container(nullptr), storage(nullptr), alloc_memory(0) {}
 
   ~Properties() {}
 
@@ -45,6 +49,14 @@ public:
   const uint64_t nblocks;
   const uint64_t window;
 
+  // when set, blocks and slices are extents of this single file
+  // instead of one `.gpe` file each
+  GraphContainer *container;
+
+  // when set, the `.gpe` files are spread among these directories
+  // instead of the working directory
+  StorageRoots *storage;
+
   std::atomic<size_t> alloc_memory;
 }; // class graphee::Properties
 
@@ -1,6 +1,7 @@
 #ifndef GRAPHEE_SPARSE_BMATRIX_CSR_HPP__
 #define GRAPHEE_SPARSE_BMATRIX_CSR_HPP__
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -13,6 +14,15 @@
 #include "properties.hpp"
 #include "utils.hpp"
 #include "vector.hpp"
+#include "mapped_file.hpp"
+#include "codec.hpp"
+#include "block_writer.hpp"
+#include "block_header.hpp"
+#include "graph_container.hpp"
+#include "block_layout.hpp"
+#include "block_manifest.hpp"
+#include "spmv_kernel.hpp"
+#include "merge_path.hpp"
 
 namespace graphee {
 
@@ -21,16 +31,20 @@ namespace graphee {
  *
  * The matrix only saves position of non-zero elements.
  * This is straightforward in non-weighted-edge graphs.
+ * A filled matrix can be converted to another `BlockLayout`
+ * (hypersparse, bitmap or Hilbert ordered) before being saved.
  */
 
 class SparseBMatrixCSR {
 public:
   SparseBMatrixCSR(Properties *properties)
-      : props(properties), m(0), n(0), nnz(0) {}
+      : props(properties), m(0), n(0), nnz(0), ia_view(nullptr),
+        ja_view(nullptr), layout(BlockLayout::CSR) {}
 
   SparseBMatrixCSR(Properties *properties, uint64_t nlines, uint64_t ncols,
                    uint64_t nonzero_elems)
-      : props(properties), m(nlines), n(ncols), nnz(nonzero_elems) {
+      : props(properties), m(nlines), n(ncols), nnz(nonzero_elems),
+        ia_view(nullptr), ja_view(nullptr), layout(BlockLayout::CSR) {
     if ((nnz + m + 1) * sizeof(uint64_t) < props->ram_limit) {
       ia.resize(m + 1, 0);
       ja.resize(nnz, 0);
@@ -42,11 +56,19 @@ public:
 
   SparseBMatrixCSR(SparseBMatrixCSR &&mat)
       : props(mat.props), m(mat.m), n(mat.n), nnz(mat.nnz),
-        ia(std::move(mat.ia)), ja(std::move(mat.ja)) {
-    mat.props = nullptr;
+        ia(std::move(mat.ia)), ja(std::move(mat.ja)),
+        mapping(std::move(mat.mapping)), ia_view(mat.ia_view),
+        ja_view(mat.ja_view), layout(mat.layout), rows(std::move(mat.rows)),
+        bits(std::move(mat.bits)), tiles(std::move(mat.tiles)),
+        coords(std::move(mat.coords)), ja32(std::move(mat.ja32)),
+        row_parts(std::move(mat.row_parts)) {
+    /* `mat` keeps its properties, a pooled block is loaded again */
     mat.m = 0;
     mat.n = 0;
     mat.nnz = 0;
+    mat.ia_view = nullptr;
+    mat.ja_view = nullptr;
+    mat.layout = BlockLayout::CSR;
   }
 
   SparseBMatrixCSR &operator=(SparseBMatrixCSR &&rmat);
@@ -61,17 +83,49 @@ public:
   void remove(uint64_t i, uint64_t j);
 
   void save(std::string filename, int file_format = Utils::BIN);
+  void save(GraphContainer &container, std::string key,
+            int file_format = Utils::BIN);
+  void save(BlockWriter &matfp, int file_format);
+
   void load(std::string filename);
+  void load(GraphContainer &container, std::string key);
+  bool load(std::istream &matfp, std::string name);
+  void load_rows(std::string filename, uint64_t first, uint64_t last);
+  void load_rows(std::istream &matfp, std::string name, uint64_t first,
+                 uint64_t last);
+  void map(std::string filename);
+
+  bool is_mapped() const;
+  bool check_integrity(std::string filename);
+  bool check_integrity(std::istream &matfp, std::string name);
 
   size_t size();
   bool verify();
 
+  void convert(int target_layout);
+  int get_layout() const;
+
+  bool compact_indices();
+
+  SparseBMatrixCSR transpose() const;
+
+  std::vector<uint64_t> element_keys() const;
+  void assign_keys(const std::vector<uint64_t> &keys);
+
+  BlockStats stats() const;
+
   bool empty();
 
   void clear();
 
   template <typename vecValueT>
   Vector<vecValueT> operator*(const Vector<vecValueT> &rvec);
+  template <typename vecValueT>
+  void multiply_add(const Vector<vecValueT> &rvec, Vector<vecValueT> &res);
+  template <typename vecValueT>
+  void multiply_add(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+                    uint64_t part, uint64_t nparts) const;
+  void prepare_parts() const;
 
   Vector<double> columns_sum();
 
@@ -81,7 +135,7 @@ public:
   uint64_t get_columns();
   uint64_t get_nonzeros();
 
-private:
+protected:
   std::vector<uint64_t> ia;
   std::vector<uint64_t> ja;
 
@@ -91,6 +145,79 @@ private:
   uint64_t n;
   uint64_t nnz;
   uint64_t fill_id;
+
+  /* In-place view of an `Utils::ALIGNED` file, the SpMV kernels
+   * read `ia` and `ja` through `ia_data()` and `ja_data()` */
+  MappedFile mapping;
+  const uint64_t *ia_view;
+  const uint64_t *ja_view;
+
+  const uint64_t *ia_data() const;
+  const uint64_t *ja_data() const;
+
+  AlignedLayout map_aligned(MappedFile &&file, std::string name,
+                            const std::string &expected_typename);
+
+  int read_prefix(std::istream &matfp, const std::string &expected_typename);
+  bool read(std::istream &matfp, std::string name);
+
+  template <typename MoveT>
+  void transpose_into(SparseBMatrixCSR &tmat, MoveT move_value) const;
+
+  /* Arrays of the non-CSR layouts, see `BlockLayout`. The hypersparse
+   * and Hilbert layouts keep in `ia` the offsets of their lines or tiles */
+  int layout;
+  std::vector<uint64_t> rows;
+  std::vector<uint64_t> bits;
+  std::vector<uint64_t> tiles;
+  std::vector<uint32_t> coords;
+
+  /* 32-bit copy of `ja` made by `compact_indices()`, dropped by any change */
+  std::vector<uint32_t> ja32;
+
+  /* `MergePath` of the CSR products, made by their first call and
+   * dropped with `ja32` */
+  mutable std::vector<MergePath::Coord> row_parts;
+  const std::vector<MergePath::Coord> &row_partition() const;
+
+  struct LayoutSection {
+    char *data;
+    size_t elem_size;
+    uint64_t nelems;
+  };
+
+  std::vector<LayoutSection> layout_sections();
+  uint64_t layout_aux() const;
+  void convert_hilbert();
+  void save_layout(BlockWriter &matfp, int fileformat);
+  void read_layout(std::istream &matfp, std::string name, int fileformat);
+
+  template <typename vecValueT>
+  void spmv(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+            BlockLayout::CsrTag) const;
+  template <typename vecValueT>
+  void spmv(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+            BlockLayout::HypersparseTag) const;
+  template <typename vecValueT>
+  void spmv(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+            BlockLayout::BitmapTag) const;
+  template <typename vecValueT>
+  void spmv(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+            BlockLayout::HilbertTag) const;
+
+  template <typename vecValueT>
+  void spmv_part(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+                 uint64_t part, uint64_t nparts, BlockLayout::CsrTag) const;
+  template <typename vecValueT>
+  void spmv_part(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+                 uint64_t part, uint64_t nparts,
+                 BlockLayout::HypersparseTag) const;
+  template <typename vecValueT>
+  void spmv_part(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+                 uint64_t part, uint64_t nparts, BlockLayout::BitmapTag) const;
+  template <typename vecValueT>
+  void spmv_part(const Vector<vecValueT> &rvec, Vector<vecValueT> &res,
+                 uint64_t part, uint64_t nparts, BlockLayout::HilbertTag) const;
 }; // class SparseBMatrixCSR
 
 /*! Filling the sparse matrix with sorted entries by
@@ -114,8 +241,23 @@ void SparseBMatrixCSR::insert(uint64_t i, uint64_t j) {}
 void SparseBMatrixCSR::remove(uint64_t i, uint64_t j) {}
 
 void SparseBMatrixCSR::save(std::string name, int fileformat) {
-  std::ofstream matfp(name, std::ios_base::binary);
+  BlockWriter matfp(name);
+  save(matfp, fileformat);
+  matfp.close();
+}
+
+/*! Stores the matrix as the extent `key` of a `GraphContainer` */
+void SparseBMatrixCSR::save(GraphContainer &container, std::string key,
+                            int fileformat) {
+  std::vector<char> image;
+  BlockWriter matfp(&image);
+  save(matfp, fileformat);
+  matfp.close();
 
+  container.write(key, image);
+}
+
+void SparseBMatrixCSR::save(BlockWriter &matfp, int fileformat) {
   size_t matrix_typename_size = matrix_typename.size();
 
   /* Save explicitly matrix properties */
@@ -124,36 +266,44 @@ void SparseBMatrixCSR::save(std::string name, int fileformat) {
   matfp.write(reinterpret_cast<const char *>(matrix_typename.c_str()),
               matrix_typename_size);
 
-  /* Save fileformat {BIN, SNAPPY} */
-  matfp.write(reinterpret_cast<const char *>(&fileformat), sizeof(int));
+  /* Save fileformat {BIN, SNAPPY, ALIGNED, SNAPPY_CHUNKS, ZSTD, LZ4}
+   * and the layout in the bits 8 to 15 */
+  int packed_format = BlockLayout::pack(fileformat, layout);
+  matfp.write(reinterpret_cast<const char *>(&packed_format), sizeof(int));
 
   /* Matrix dimension */
   matfp.write(reinterpret_cast<const char *>(&m), sizeof(uint64_t));
   matfp.write(reinterpret_cast<const char *>(&nnz), sizeof(uint64_t));
 
+  if (layout != BlockLayout::CSR) {
+    save_layout(matfp, fileformat);
+    return;
+  }
+
   if (fileformat == Utils::BIN) {
-    matfp.write(reinterpret_cast<const char *>(ia.data()),
-                ia.size() * sizeof(uint64_t));
-    matfp.write(reinterpret_cast<const char *>(ja.data()),
-                ja.size() * sizeof(uint64_t));
+    matfp.write_array(reinterpret_cast<const char *>(ia_data()),
+                      (m + 1) * sizeof(uint64_t));
+    matfp.write_array(reinterpret_cast<const char *>(ja_data()),
+                      nnz * sizeof(uint64_t));
   } else if (fileformat == Utils::SNAPPY) {
+    /* The arrays are read through their views, a mapped matrix has no copy */
     size_t ia_snappy_size =
-        snappy::MaxCompressedLength64(ia.size() * sizeof(uint64_t));
+        snappy::MaxCompressedLength64((m + 1) * sizeof(uint64_t));
     char *ia_snappy = new char[ia_snappy_size];
-    snappy::RawCompress64(reinterpret_cast<char *>(ia.data()),
-                          ia.size() * sizeof(uint64_t), ia_snappy,
+    snappy::RawCompress64(reinterpret_cast<const char *>(ia_data()),
+                          (m + 1) * sizeof(uint64_t), ia_snappy,
                           &ia_snappy_size);
 
     matfp.write(reinterpret_cast<const char *>(&ia_snappy_size),
                 sizeof(size_t));
     matfp.write(reinterpret_cast<const char *>(ia_snappy), ia_snappy_size);
     delete[] ia_snappy;
-    if (ja.size() != 0) {
+    if (nnz != 0) {
       size_t ja_snappy_size =
-          snappy::MaxCompressedLength64(ja.size() * sizeof(uint64_t));
+          snappy::MaxCompressedLength64(nnz * sizeof(uint64_t));
       char *ja_snappy = new char[ja_snappy_size];
-      snappy::RawCompress64(reinterpret_cast<char *>(ja.data()),
-                            ja.size() * sizeof(uint64_t), ja_snappy,
+      snappy::RawCompress64(reinterpret_cast<const char *>(ja_data()),
+                            nnz * sizeof(uint64_t), ja_snappy,
                             &ja_snappy_size);
 
       matfp.write(reinterpret_cast<const char *>(&ja_snappy_size),
@@ -161,14 +311,43 @@ void SparseBMatrixCSR::save(std::string name, int fileformat) {
       matfp.write(reinterpret_cast<const char *>(ja_snappy), ja_snappy_size);
       delete[] ja_snappy;
     }
+  } else if (Codec::is_chunked(fileformat)) {
+    /* Version 2 layout, `ia` and `ja` are cut at the same rows */
+    std::vector<uint64_t> row_cuts =
+        BlockHeader::csr_row_cuts(ia_data(), m, sizeof(uint64_t));
+    BlockHeader::write(
+        matfp, fileformat, row_cuts,
+        {BlockHeader::row_section(ia_data(), sizeof(uint64_t), m + 1, row_cuts),
+         BlockHeader::nz_section(ja_data(), sizeof(uint64_t), ia_data(),
+                                 row_cuts)});
+  } else if (fileformat == Utils::ALIGNED) {
+    AlignedLayout layout;
+    layout.version = AlignedLayout::current_version;
+    layout.alignment = MappedFile::alignment;
+    layout.ia_offset =
+        MappedFile::align(matfp.tellp() + sizeof(AlignedLayout));
+    layout.ja_offset =
+        MappedFile::align(layout.ia_offset + (m + 1) * sizeof(uint64_t));
+    layout.a_offset =
+        MappedFile::align(layout.ja_offset + nnz * sizeof(uint64_t));
+
+    matfp.write(reinterpret_cast<const char *>(&layout), sizeof(AlignedLayout));
+
+    /* seek() pads the sections with zeros */
+    matfp.seek(layout.ia_offset);
+    matfp.write_array(reinterpret_cast<const char *>(ia_data()),
+                      (m + 1) * sizeof(uint64_t));
+    matfp.seek(layout.ja_offset);
+    matfp.write_array(reinterpret_cast<const char *>(ja_data()),
+                      nnz * sizeof(uint64_t));
   }
-
-  matfp.close();
 }
 
-void SparseBMatrixCSR::load(std::string name) {
-  std::ifstream matfp(name, std::ios_base::binary);
-
+/*! Reads the matrix typename, which must be `expected_typename` when
+ * not empty, and returns the fileformat
+ */
+int SparseBMatrixCSR::read_prefix(std::istream &matfp,
+                                  const std::string &expected_typename) {
   /* Save explicitly matrix properties */
   size_t matrix_typename_size;
   matfp.read(reinterpret_cast<char *>(&matrix_typename_size), sizeof(size_t));
@@ -178,29 +357,86 @@ void SparseBMatrixCSR::load(std::string name) {
              matrix_typename_size);
   read_matrix_typename[matrix_typename_size] = '\0';
 
-  if (std::strcmp(read_matrix_typename, matrix_typename.c_str()) != 0) {
+  if (!expected_typename.empty() &&
+      std::strcmp(read_matrix_typename, expected_typename.c_str()) != 0) {
     std::ostringstream oss;
     oss << "Wrong matrix format, found \'" << read_matrix_typename
-        << "\' while expecting \'" << matrix_typename << "\'";
+        << "\' while expecting \'" << expected_typename << "\'";
     print_error(oss.str());
     exit(-1);
   }
 
-  /* Read fileformat {BIN, SNAPPY} */
+  /* Read fileformat {BIN, SNAPPY, ALIGNED, SNAPPY_CHUNKS, ZSTD, LZ4} */
   int fileformat;
   matfp.read(reinterpret_cast<char *>(&fileformat), sizeof(int));
 
+  return fileformat;
+}
+
+void SparseBMatrixCSR::load(std::string name) {
+  std::ifstream matfp(name, std::ios_base::binary);
+
+  if (!read(matfp, name)) {
+    matfp.close();
+    map(name);
+  }
+}
+
+/*! Reads an extent of a `GraphContainer`, `Utils::ALIGNED` extents are
+ * used in place
+ */
+void SparseBMatrixCSR::load(GraphContainer &container, std::string key) {
+  MappedStream matfp(container.map(key));
+
+  if (!read(matfp, key)) {
+    map_aligned(std::move(matfp.mapping()), key, matrix_typename);
+  }
+}
+
+/*! Reads an image from a stream, e.g. one kept in memory, returns false
+ * for an `Utils::ALIGNED` image which can only be mapped
+ */
+bool SparseBMatrixCSR::load(std::istream &matfp, std::string name) {
+  return read(matfp, name);
+}
+
+/*! Reads the matrix, returns false for `Utils::ALIGNED` images which
+ * are mapped instead
+ */
+bool SparseBMatrixCSR::read(std::istream &matfp, std::string name) {
+  int packed_format = read_prefix(matfp, matrix_typename);
+  int fileformat = BlockLayout::format_of(packed_format);
+
+  if (fileformat == Utils::ALIGNED) {
+    return false;
+  }
+
+  mapping.unmap();
+
   /* Matrix dimension */
   matfp.read(reinterpret_cast<char *>(&m), sizeof(uint64_t));
   matfp.read(reinterpret_cast<char *>(&nnz), sizeof(uint64_t));
   n = m;
 
+  layout = BlockLayout::layout_of(packed_format);
+  rows.clear();
+  bits.clear();
+  tiles.clear();
+  coords.clear();
+  ja32.clear();
+  row_parts.clear();
+
+  if (layout != BlockLayout::CSR) {
+    read_layout(matfp, name, fileformat);
+    fill_id = m - 1;
+    return true;
+  }
+
   if ((nnz + m + 1) * sizeof(uint64_t) < props->ram_limit) {
     ia.resize(m + 1, 0);
     ja.resize(nnz, 0);
   } else {
     print_error("Requested size is beyond \'ram_limit\'");
-    matfp.close();
     exit(-1);
   }
 
@@ -212,20 +448,20 @@ void SparseBMatrixCSR::load(std::string name) {
   } else if (fileformat == Utils::SNAPPY) {
     bool uncomp_succeed;
 
+    /* Compressed arrays of the blocks read by this thread */
+    static thread_local std::vector<char> scratch;
+
     size_t ia_snappy_size;
     matfp.read(reinterpret_cast<char *>(&ia_snappy_size), sizeof(size_t));
 
-    char *ia_snappy = new char[ia_snappy_size];
-    matfp.read(reinterpret_cast<char *>(ia_snappy), ia_snappy_size);
+    scratch.resize(ia_snappy_size);
+    matfp.read(scratch.data(), ia_snappy_size);
 
     uncomp_succeed = snappy::RawUncompress64(
-        ia_snappy, ia_snappy_size, reinterpret_cast<char *>(ia.data()));
-    delete[] ia_snappy;
+        scratch.data(), ia_snappy_size, reinterpret_cast<char *>(ia.data()));
 
     if (!uncomp_succeed) {
       print_error("SNAPPY uncompression of IA failed");
-
-      matfp.close();
       exit(-1);
     }
 
@@ -233,28 +469,703 @@ void SparseBMatrixCSR::load(std::string name) {
       size_t ja_snappy_size;
       matfp.read(reinterpret_cast<char *>(&ja_snappy_size), sizeof(size_t));
 
-      char *ja_snappy = new char[ja_snappy_size];
-      matfp.read(reinterpret_cast<char *>(ja_snappy), ja_snappy_size);
+      scratch.resize(ja_snappy_size);
+      matfp.read(scratch.data(), ja_snappy_size);
 
       uncomp_succeed = snappy::RawUncompress64(
-          ja_snappy, ja_snappy_size, reinterpret_cast<char *>(ja.data()));
-      delete[] ja_snappy;
+          scratch.data(), ja_snappy_size, reinterpret_cast<char *>(ja.data()));
 
       if (!uncomp_succeed) {
         print_error("SNAPPY uncompression of JA failed");
-
-        matfp.close();
         exit(-1);
       }
     }
+  } else if (Codec::is_chunked(fileformat)) {
+    BlockHeader header;
+    bool succeed = header.read(matfp, fileformat) &&
+                   header.read_elements(matfp, 0, 0, m + 1,
+                                        reinterpret_cast<char *>(ia.data()),
+                                        props->nthreads) &&
+                   header.read_elements(matfp, 1, 0, nnz,
+                                        reinterpret_cast<char *>(ja.data()),
+                                        props->nthreads);
+
+    if (!succeed) {
+      std::ostringstream oss;
+      oss << "Chunked uncompression of \'" << name << "\' failed";
+      print_error(oss.str());
+      exit(-1);
+    }
   }
 
   fill_id = m - 1;
 
+  return true;
+}
+
+/*! Loads the rows [first, last) of a block saved with a chunked
+ * format, only the chunks holding these rows are read and uncompressed.
+ * The result has `last - first` lines and the columns of the block.
+ */
+void SparseBMatrixCSR::load_rows(std::string name, uint64_t first,
+                                 uint64_t last) {
+  std::ifstream matfp(name, std::ios_base::binary);
+  load_rows(matfp, name, first, last);
   matfp.close();
 }
 
-size_t SparseBMatrixCSR::size() { return (nnz + m + 1) * sizeof(uint64_t); }
+void SparseBMatrixCSR::load_rows(std::istream &matfp, std::string name,
+                                 uint64_t first, uint64_t last) {
+  int packed_format = read_prefix(matfp, matrix_typename);
+  int fileformat = BlockLayout::format_of(packed_format);
+
+  uint64_t block_m, block_nnz;
+  matfp.read(reinterpret_cast<char *>(&block_m), sizeof(uint64_t));
+  matfp.read(reinterpret_cast<char *>(&block_nnz), sizeof(uint64_t));
+
+  if (!Codec::is_chunked(fileformat) ||
+      BlockLayout::layout_of(packed_format) != BlockLayout::CSR) {
+    std::ostringstream oss;
+    oss << "Partial load of \'" << name << "\' requires a CSR chunked file";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  if (first > last || last > block_m) {
+    std::ostringstream oss;
+    oss << "Rows [" << first << ";" << last << ") are out of \'" << name
+        << "\' with " << block_m << " lines";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  BlockHeader header;
+  if (!header.read(matfp, fileformat)) {
+    exit(-1);
+  }
+
+  mapping.unmap();
+  ja32.clear();
+  row_parts.clear();
+
+  m = last - first;
+  n = block_m;
+  ia.resize(m + 1, 0);
+
+  if (!header.read_elements(matfp, 0, first, last + 1,
+                            reinterpret_cast<char *>(ia.data()),
+                            props->nthreads)) {
+    exit(-1);
+  }
+
+  uint64_t nz_first = ia[0];
+  nnz = ia[m] - nz_first;
+
+  if ((nnz + m + 1) * sizeof(uint64_t) < props->ram_limit) {
+    ja.resize(nnz, 0);
+  } else {
+    print_error("Requested size is beyond \'ram_limit\'");
+    exit(-1);
+  }
+
+  if (!header.read_elements(matfp, 1, nz_first, nz_first + nnz,
+                            reinterpret_cast<char *>(ja.data()),
+                            props->nthreads)) {
+    exit(-1);
+  }
+
+  for (uint64_t &row : ia) {
+    row -= nz_first;
+  }
+
+  fill_id = m - 1;
+}
+
+/*! Verifies the checksums of a block without uncompressing it, files
+ * without version 2 header have no checksum and are always valid
+ */
+bool SparseBMatrixCSR::check_integrity(std::string name) {
+  std::ifstream matfp(name, std::ios_base::binary);
+  if (!matfp.is_open()) {
+    std::ostringstream oss;
+    oss << "Could not open \'" << name << "\'";
+    print_error(oss.str());
+    return false;
+  }
+
+  return check_integrity(matfp, name);
+}
+
+bool SparseBMatrixCSR::check_integrity(std::istream &matfp, std::string name) {
+  int packed_format = read_prefix(matfp, "");
+  int fileformat = BlockLayout::format_of(packed_format);
+
+  /* Dimensions, plus the line count of the non-CSR layouts */
+  int ndims = BlockLayout::layout_of(packed_format) == BlockLayout::CSR ? 2 : 3;
+  matfp.seekg(ndims * sizeof(uint64_t), std::ios_base::cur);
+
+  if (!Codec::is_chunked(fileformat)) {
+    return true;
+  }
+
+  BlockHeader header;
+  bool valid = header.read(matfp, fileformat) && header.verify(matfp);
+
+  if (!valid) {
+    std::ostringstream oss;
+    oss << "Integrity check of \'" << name << "\' failed";
+    print_error(oss.str());
+  }
+
+  return valid;
+}
+
+/*! Maps an `Utils::ALIGNED` file and uses `ia` and `ja` in place:
+ * nothing is allocated nor copied, pages are read on demand.
+ */
+void SparseBMatrixCSR::map(std::string name) {
+  map_aligned(MappedFile(name), name, matrix_typename);
+}
+
+AlignedLayout SparseBMatrixCSR::map_aligned(MappedFile &&file, std::string name,
+                                            const std::string &expected_typename) {
+  mapping = std::move(file);
+  this->layout = BlockLayout::CSR;
+  rows.clear();
+  bits.clear();
+  tiles.clear();
+  coords.clear();
+  ja32.clear();
+  row_parts.clear();
+
+  size_t offset = 0;
+  size_t matrix_typename_size = mapping.get<size_t>(offset);
+  offset += sizeof(size_t);
+
+  if (matrix_typename_size != expected_typename.size() ||
+      std::strncmp(mapping.data() + offset, expected_typename.c_str(),
+                   matrix_typename_size) != 0) {
+    std::ostringstream oss;
+    oss << "Wrong matrix format in \'" << name << "\' while expecting \'"
+        << expected_typename << "\'";
+    print_error(oss.str());
+    exit(-1);
+  }
+  offset += matrix_typename_size;
+
+  if (mapping.get<int>(offset) != Utils::ALIGNED) {
+    print_error("Only \'Utils::ALIGNED\' matrices can be mapped");
+    exit(-1);
+  }
+  offset += sizeof(int);
+
+  m = mapping.get<uint64_t>(offset);
+  nnz = mapping.get<uint64_t>(offset + sizeof(uint64_t));
+  n = m;
+  offset += 2 * sizeof(uint64_t);
+
+  AlignedLayout layout = mapping.get<AlignedLayout>(offset);
+  if (layout.version != AlignedLayout::current_version ||
+      layout.ia_offset + (m + 1) * sizeof(uint64_t) > mapping.size() ||
+      (nnz != 0 &&
+       layout.ja_offset + nnz * sizeof(uint64_t) > mapping.size())) {
+    std::ostringstream oss;
+    oss << "Unsupported or truncated aligned layout (version "
+        << layout.version << ") in \'" << name << "\'";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  ia.clear();
+  ja.clear();
+  ia_view = reinterpret_cast<const uint64_t *>(mapping.data() + layout.ia_offset);
+  ja_view = reinterpret_cast<const uint64_t *>(mapping.data() + layout.ja_offset);
+
+  /* Rows are scanned once and in order by the SpMV */
+  mapping.advise(MADV_SEQUENTIAL);
+
+  fill_id = m - 1;
+
+  return layout;
+}
+
+bool SparseBMatrixCSR::is_mapped() const { return mapping.is_mapped(); }
+
+const uint64_t *SparseBMatrixCSR::ia_data() const {
+  return mapping.is_mapped() ? ia_view : ia.data();
+}
+
+const uint64_t *SparseBMatrixCSR::ja_data() const {
+  return mapping.is_mapped() ? ja_view : ja.data();
+}
+
+size_t SparseBMatrixCSR::size() {
+  return BlockLayout::bytes(layout, m, n, nnz, layout_aux());
+}
+
+/*! Converts a filled CSR matrix to `target_layout`, `BlockLayout::AUTO`
+ * picks the smallest one among CSR, hypersparse and bitmap. A bitmap
+ * would keep a single copy of repeated elements (multi-edges), such a
+ * block takes the smallest of CSR and hypersparse instead, every copy
+ * stays counted in `nnz`.
+ */
+void SparseBMatrixCSR::convert(int target_layout) {
+  if (layout != BlockLayout::CSR || is_mapped()) {
+    print_error("Only in-memory CSR matrices can be converted");
+    exit(-1);
+  }
+  ja32.clear();
+  row_parts.clear();
+
+  uint64_t nrows = 0;
+  for (uint64_t i = 0; i < m; i++) {
+    if (ia[i + 1] != ia[i])
+      nrows++;
+  }
+
+  if (target_layout == BlockLayout::AUTO)
+    target_layout = BlockLayout::choose(m, n, nnz, nrows);
+
+  if (target_layout == BlockLayout::BITMAP) {
+    uint64_t wpr = BlockLayout::words_per_row(n);
+    bits.assign(m * wpr, 0);
+
+    uint64_t repeated = 0;
+#pragma omp parallel for num_threads(props->nthreads) reduction(+ : repeated)
+    for (uint64_t i = 0; i < m; i++) {
+      for (uint64_t ja_idx = ia[i]; ja_idx < ia[i + 1]; ja_idx++) {
+        uint64_t &word = bits[i * wpr + ja[ja_idx] / 64];
+        uint64_t bit = uint64_t(1) << (ja[ja_idx] % 64);
+        if (word & bit)
+          repeated++;
+        word |= bit;
+      }
+    }
+
+    if (repeated > 0) {
+      std::vector<uint64_t>().swap(bits);
+      target_layout = BlockLayout::choose(m, n, nnz, nrows, true);
+    } else {
+      std::vector<uint64_t>().swap(ia);
+      std::vector<uint64_t>().swap(ja);
+    }
+  }
+
+  if (target_layout == BlockLayout::HYPERSPARSE) {
+    rows.resize(nrows);
+    uint64_t r = 0;
+    for (uint64_t i = 0; i < m; i++) {
+      if (ia[i + 1] != ia[i]) {
+        rows[r] = i;
+        ia[r + 1] = ia[i + 1];
+        r++;
+      }
+    }
+    ia.resize(nrows + 1);
+  } else if (target_layout == BlockLayout::HILBERT) {
+    convert_hilbert();
+  }
+
+  layout = target_layout;
+}
+
+/*! Sorts the elements along the Hilbert curve. Every tile is a
+ * sub-square of the curve, its elements are contiguous: `tiles` holds
+ * the tile ids (`tile_line << 32 | tile_column`) in the curve order,
+ * `ia` their offsets in `coords`.
+ */
+void SparseBMatrixCSR::convert_hilbert() {
+  if (std::max(m, n) > (uint64_t(1) << 32)) {
+    print_error("Hilbert blocks are limited to 2^32 lines and columns");
+    exit(-1);
+  }
+
+  uint64_t order = BlockLayout::hilbert_order(m, n);
+  const uint64_t tile_bits = BlockLayout::tile_bits;
+  const uint64_t tile_mask = BlockLayout::tile_side - 1;
+
+  /* `ja` is reused for the distances along the curve */
+  for (uint64_t i = 0; i < m; i++) {
+    for (uint64_t ja_idx = ia[i]; ja_idx < ia[i + 1]; ja_idx++) {
+      ja[ja_idx] = BlockLayout::hilbert_index(order, i, ja[ja_idx]);
+    }
+  }
+  std::sort(ja.begin(), ja.end());
+
+  ia.clear();
+  coords.resize(nnz);
+  tiles.clear();
+
+  for (uint64_t idx = 0; idx < nnz; idx++) {
+    uint64_t i, j;
+    BlockLayout::hilbert_coords(order, ja[idx], i, j);
+
+    uint64_t tile = (i >> tile_bits) << 32 | (j >> tile_bits);
+    if (tiles.empty() || tiles.back() != tile) {
+      tiles.push_back(tile);
+      ia.push_back(idx);
+    }
+    coords[idx] = uint32_t((i & tile_mask) << tile_bits | (j & tile_mask));
+  }
+  ia.push_back(nnz);
+
+  std::vector<uint64_t>().swap(ja);
+}
+
+int SparseBMatrixCSR::get_layout() const { return layout; }
+
+/*! Split of the CSR lines between the threads, kept for the next
+ * products of the block
+ */
+const std::vector<MergePath::Coord> &SparseBMatrixCSR::row_partition() const {
+  uint64_t nparts = std::max<uint64_t>(props->nthreads, 1);
+  if (row_parts.size() != nparts + 1) {
+    row_parts = MergePath::split(ia_data(), m, nparts);
+  }
+  return row_parts;
+}
+
+/*! Keeps a 32-bit copy of the column ids, read by the CSR SpMV instead
+ * of `ja`: half the index bytes for each product, worth it for a block
+ * multiplied several times. False when the block is not CSR or has
+ * more than 2^32 columns.
+ */
+bool SparseBMatrixCSR::compact_indices() {
+  if (layout != BlockLayout::CSR || n > (uint64_t(1) << 32)) {
+    return false;
+  }
+
+  const uint64_t *ja_ptr = ja_data();
+  ja32.resize(nnz);
+  row_parts.clear();
+
+#pragma omp parallel for num_threads(props->nthreads)
+  for (uint64_t k = 0; k < nnz; k++) {
+    ja32[k] = static_cast<uint32_t>(ja_ptr[k]);
+  }
+  return true;
+}
+
+/*! Returns the transposed matrix, that is the CSC of this one, the
+ * lines of the result are sorted
+ */
+SparseBMatrixCSR SparseBMatrixCSR::transpose() const {
+  SparseBMatrixCSR tmat(props, n, m, nnz);
+  transpose_into(tmat, [](uint64_t, uint64_t) {});
+  return tmat;
+}
+
+/*! Counting sort of the elements by column into `tmat`, allocated with
+ * `n` lines, `move_value(src, dst)` moves the value of the element `src`
+ * to the position `dst` in the weighted matrices
+ */
+template <typename MoveT>
+void SparseBMatrixCSR::transpose_into(SparseBMatrixCSR &tmat,
+                                      MoveT move_value) const {
+  if (layout != BlockLayout::CSR) {
+    print_error("Only CSR matrices can be transposed");
+    exit(-1);
+  }
+
+  const uint64_t *ia_ptr = ia_data();
+  const uint64_t *ja_ptr = ja_data();
+
+  for (uint64_t k = 0; k < nnz; k++) {
+    tmat.ia[ja_ptr[k] + 1]++;
+  }
+  for (uint64_t j = 0; j < n; j++) {
+    tmat.ia[j + 1] += tmat.ia[j];
+  }
+
+  std::vector<uint64_t> next(tmat.ia.begin(), tmat.ia.end() - 1);
+  for (uint64_t i = 0; i < m; i++) {
+    for (uint64_t k = ia_ptr[i]; k < ia_ptr[i + 1]; k++) {
+      uint64_t dst = next[ja_ptr[k]]++;
+      tmat.ja[dst] = i;
+      move_value(k, dst);
+    }
+  }
+
+  tmat.fill_id = n - 1;
+}
+
+/*! Sorted keys `i * n + j` of the elements, whatever the layout is,
+ * repeated elements keep one key each
+ */
+std::vector<uint64_t> SparseBMatrixCSR::element_keys() const {
+  std::vector<uint64_t> keys;
+  keys.reserve(nnz);
+
+  if (layout == BlockLayout::CSR) {
+    const uint64_t *ia_ptr = ia_data();
+    const uint64_t *ja_ptr = ja_data();
+    for (uint64_t i = 0; i < m; i++) {
+      for (uint64_t k = ia_ptr[i]; k < ia_ptr[i + 1]; k++)
+        keys.push_back(i * n + ja_ptr[k]);
+    }
+  } else if (layout == BlockLayout::HYPERSPARSE) {
+    for (uint64_t r = 0; r < rows.size(); r++) {
+      for (uint64_t k = ia[r]; k < ia[r + 1]; k++)
+        keys.push_back(rows[r] * n + ja[k]);
+    }
+  } else if (layout == BlockLayout::BITMAP) {
+    const uint64_t wpr = BlockLayout::words_per_row(n);
+    for (uint64_t i = 0; i < m; i++) {
+      for (uint64_t w = 0; w < wpr; w++) {
+        uint64_t word = bits[i * wpr + w];
+        while (word != 0) {
+          keys.push_back(i * n + w * 64 + __builtin_ctzll(word));
+          word &= word - 1;
+        }
+      }
+    }
+  } else if (layout == BlockLayout::HILBERT) {
+    const uint64_t tile_bits = BlockLayout::tile_bits;
+    const uint64_t tile_mask = BlockLayout::tile_side - 1;
+    for (uint64_t t = 0; t < tiles.size(); t++) {
+      const uint64_t line0 = (tiles[t] >> 32) << tile_bits;
+      const uint64_t col0 = (tiles[t] & 0xffffffff) << tile_bits;
+      for (uint64_t idx = ia[t]; idx < ia[t + 1]; idx++) {
+        keys.push_back((line0 + (coords[idx] >> tile_bits)) * n + col0 +
+                       (coords[idx] & tile_mask));
+      }
+    }
+  }
+
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+/*! Replaces the elements by sorted `keys` of `element_keys()`, the
+ * matrix keeps its dimensions and becomes CSR
+ */
+void SparseBMatrixCSR::assign_keys(const std::vector<uint64_t> &keys) {
+  uint64_t nlines = m, ncols = n;
+  clear();
+  ia_view = nullptr;
+  ja_view = nullptr;
+
+  m = nlines;
+  n = ncols;
+  nnz = keys.size();
+  ia.assign(m + 1, 0);
+  ja.resize(nnz);
+
+  for (uint64_t k = 0; k < nnz; k++) {
+    ia[keys[k] / n + 1]++;
+    ja[k] = keys[k] % n;
+  }
+  for (uint64_t i = 0; i < m; i++) {
+    ia[i + 1] += ia[i];
+  }
+  fill_id = m - 1;
+}
+
+/*! Statistics of the block for the `BlockManifest`, but its size on disk */
+BlockStats SparseBMatrixCSR::stats() const {
+  BlockStats block_stats;
+  block_stats.nnz = nnz;
+  if (nnz == 0)
+    return block_stats;
+
+  std::vector<bool> cols(n, false);
+  block_stats.min_line = m;
+  block_stats.min_col = n;
+
+  auto count = [&block_stats, &cols](uint64_t i, uint64_t j) {
+    if (block_stats.min_line > i)
+      block_stats.min_line = i;
+    if (block_stats.max_line < i)
+      block_stats.max_line = i;
+    if (block_stats.min_col > j)
+      block_stats.min_col = j;
+    if (block_stats.max_col < j)
+      block_stats.max_col = j;
+    if (!cols[j]) {
+      cols[j] = true;
+      block_stats.ncols++;
+    }
+  };
+
+  if (layout == BlockLayout::CSR) {
+    const uint64_t *ia_ptr = ia_data();
+    const uint64_t *ja_ptr = ja_data();
+    for (uint64_t i = 0; i < m; i++) {
+      for (uint64_t k = ia_ptr[i]; k < ia_ptr[i + 1]; k++)
+        count(i, ja_ptr[k]);
+      if (ia_ptr[i + 1] > ia_ptr[i])
+        block_stats.nrows++;
+    }
+  } else {
+    uint64_t last_line = m;
+    for (uint64_t key : element_keys()) {
+      count(key / n, key % n);
+      if (key / n != last_line) {
+        last_line = key / n;
+        block_stats.nrows++;
+      }
+    }
+  }
+
+  return block_stats;
+}
+
+/*! Arrays saved by a non-CSR layout */
+std::vector<SparseBMatrixCSR::LayoutSection>
+SparseBMatrixCSR::layout_sections() {
+  auto section = [](void *data, size_t elem_size, uint64_t nelems) {
+    return LayoutSection{reinterpret_cast<char *>(data), elem_size, nelems};
+  };
+
+  if (layout == BlockLayout::HYPERSPARSE) {
+    return {section(rows.data(), sizeof(uint64_t), rows.size()),
+            section(ia.data(), sizeof(uint64_t), ia.size()),
+            section(ja.data(), sizeof(uint64_t), ja.size())};
+  } else if (layout == BlockLayout::HILBERT) {
+    return {section(tiles.data(), sizeof(uint64_t), tiles.size()),
+            section(ia.data(), sizeof(uint64_t), ia.size()),
+            section(coords.data(), sizeof(uint32_t), coords.size())};
+  }
+  return {section(bits.data(), sizeof(uint64_t), bits.size())};
+}
+
+/*! Number of non-empty lines (hypersparse), of words per line (bitmap)
+ * or of tiles (Hilbert)
+ */
+uint64_t SparseBMatrixCSR::layout_aux() const {
+  switch (layout) {
+  case BlockLayout::HYPERSPARSE:
+    return rows.size();
+  case BlockLayout::BITMAP:
+    return BlockLayout::words_per_row(n);
+  case BlockLayout::HILBERT:
+    return tiles.size();
+  default:
+    return 0;
+  }
+}
+
+/*! Writes the arrays of a non-CSR layout after the dimensions:
+ * `layout_aux()`, then the arrays of `layout_sections()` in `fileformat`
+ */
+void SparseBMatrixCSR::save_layout(BlockWriter &matfp, int fileformat) {
+  uint64_t aux = layout_aux();
+  matfp.write(reinterpret_cast<const char *>(&aux), sizeof(uint64_t));
+
+  std::vector<LayoutSection> sections = layout_sections();
+
+  if (fileformat == Utils::BIN) {
+    for (auto &section : sections) {
+      matfp.write_array(section.data, section.nelems * section.elem_size);
+    }
+  } else if (fileformat == Utils::SNAPPY) {
+    for (auto &section : sections) {
+      size_t snappy_size =
+          snappy::MaxCompressedLength64(section.nelems * section.elem_size);
+      char *snappy_data = new char[snappy_size];
+      snappy::RawCompress64(section.data, section.nelems * section.elem_size,
+                            snappy_data, &snappy_size);
+
+      matfp.write(reinterpret_cast<const char *>(&snappy_size),
+                  sizeof(size_t));
+      matfp.write(reinterpret_cast<const char *>(snappy_data), snappy_size);
+      delete[] snappy_data;
+    }
+  } else if (Codec::is_chunked(fileformat) && layout != BlockLayout::BITMAP) {
+    /* Chunks cut at the same lines, or tiles, in the three sections */
+    std::vector<uint64_t> row_cuts =
+        BlockHeader::csr_row_cuts(ia.data(), aux, sections[2].elem_size);
+    BlockHeader::write(
+        matfp, fileformat, row_cuts,
+        {BlockHeader::row_section(sections[0].data, sections[0].elem_size, aux,
+                                  row_cuts),
+         BlockHeader::row_section(ia.data(), sizeof(uint64_t), aux + 1,
+                                  row_cuts),
+         BlockHeader::nz_section(sections[2].data, sections[2].elem_size,
+                                 ia.data(), row_cuts)});
+  } else if (Codec::is_chunked(fileformat)) {
+    uint64_t wpr = aux;
+    std::vector<uint64_t> row_cuts =
+        BlockHeader::dense_row_cuts(m, wpr * sizeof(uint64_t));
+    BlockHeader::SectionSpec spec = BlockHeader::row_section(
+        bits.data(), sizeof(uint64_t), m * wpr, row_cuts);
+    for (uint64_t &cut : spec.elem_cuts)
+      cut = std::min(cut * wpr, m * wpr);
+    BlockHeader::write(matfp, fileformat, row_cuts, {spec});
+  } else {
+    std::ostringstream oss;
+    oss << BlockLayout::name(layout) << " blocks can not be saved with format "
+        << fileformat;
+    print_error(oss.str());
+    exit(-1);
+  }
+}
+
+/*! Counterpart of `save_layout()` */
+void SparseBMatrixCSR::read_layout(std::istream &matfp, std::string name,
+                                   int fileformat) {
+  uint64_t aux;
+  matfp.read(reinterpret_cast<char *>(&aux), sizeof(uint64_t));
+
+  if (BlockLayout::bytes(layout, m, n, nnz, aux) >= props->ram_limit) {
+    print_error("Requested size is beyond \'ram_limit\'");
+    exit(-1);
+  }
+
+  if (layout == BlockLayout::HYPERSPARSE) {
+    rows.resize(aux);
+    ia.resize(aux + 1);
+    ja.resize(nnz);
+  } else if (layout == BlockLayout::HILBERT) {
+    tiles.resize(aux);
+    ia.resize(aux + 1);
+    std::vector<uint64_t>().swap(ja);
+    coords.resize(nnz);
+  } else {
+    std::vector<uint64_t>().swap(ia);
+    std::vector<uint64_t>().swap(ja);
+    bits.resize(m * aux);
+  }
+
+  bool succeed = true;
+
+  if (fileformat == Utils::BIN) {
+    for (auto &section : layout_sections()) {
+      matfp.read(section.data, section.nelems * section.elem_size);
+    }
+  } else if (fileformat == Utils::SNAPPY) {
+    for (auto &section : layout_sections()) {
+      size_t snappy_size;
+      matfp.read(reinterpret_cast<char *>(&snappy_size), sizeof(size_t));
+
+      char *snappy_data = new char[snappy_size];
+      matfp.read(reinterpret_cast<char *>(snappy_data), snappy_size);
+
+      succeed = succeed && snappy::RawUncompress64(snappy_data, snappy_size,
+                                                   section.data);
+      delete[] snappy_data;
+    }
+  } else if (Codec::is_chunked(fileformat)) {
+    BlockHeader header;
+    succeed = header.read(matfp, fileformat);
+
+    std::vector<LayoutSection> sections = layout_sections();
+    for (size_t s = 0; succeed && s < sections.size(); s++) {
+      succeed = header.read_elements(matfp, s, 0, sections[s].nelems,
+                                     sections[s].data, props->nthreads);
+    }
+  } else {
+    succeed = false;
+  }
+
+  if (!succeed) {
+    std::ostringstream oss;
+    oss << "Reading the " << BlockLayout::name(layout) << " block \'" << name
+        << "\' failed";
+    print_error(oss.str());
+    exit(-1);
+  }
+}
 
 bool SparseBMatrixCSR::verify() {
   if (fill_id < m - 1) {
@@ -277,6 +1188,14 @@ bool SparseBMatrixCSR::verify() {
 void SparseBMatrixCSR::clear() {
   ia.clear();
   ja.clear();
+  rows.clear();
+  bits.clear();
+  tiles.clear();
+  coords.clear();
+  ja32.clear();
+  row_parts.clear();
+  mapping.unmap();
+  layout = BlockLayout::CSR;
 
   m = 0;
   n = 0;
@@ -289,13 +1208,32 @@ SparseBMatrixCSR &SparseBMatrixCSR::operator=(SparseBMatrixCSR &&rmat) {
   std::swap(m, rmat.m);
   std::swap(n, rmat.n);
   std::swap(nnz, rmat.nnz);
+  std::swap(mapping, rmat.mapping);
+  std::swap(ia_view, rmat.ia_view);
+  std::swap(ja_view, rmat.ja_view);
+  std::swap(layout, rmat.layout);
+  std::swap(rows, rmat.rows);
+  std::swap(bits, rmat.bits);
+  std::swap(tiles, rmat.tiles);
+  std::swap(coords, rmat.coords);
+  std::swap(ja32, rmat.ja32);
+  std::swap(row_parts, rmat.row_parts);
 
   return *this;
 }
 
 template <typename vecValueT>
 Vector<vecValueT> SparseBMatrixCSR::operator*(const Vector<vecValueT> &rvec) {
-  if (n != rvec.get_lines()) {
+  Vector<vecValueT> res(props, m, 0.);
+  multiply_add(rvec, res);
+  return res;
+}
+
+/*! `res += this * rvec`, without a temporary result */
+template <typename vecValueT>
+void SparseBMatrixCSR::multiply_add(const Vector<vecValueT> &rvec,
+                                    Vector<vecValueT> &res) {
+  if (n != rvec.get_lines() || m != res.get_lines()) {
     std::ostringstream oss;
     oss << "Error SpBMat[" << m << "x" << n << "] with Vec[" << rvec.get_lines()
         << "]";
@@ -303,24 +1241,342 @@ Vector<vecValueT> SparseBMatrixCSR::operator*(const Vector<vecValueT> &rvec) {
     exit(-1);
   }
 
-  Vector<vecValueT> res(props, m, 0.);
+  switch (layout) {
+  case BlockLayout::HYPERSPARSE:
+    spmv(rvec, res, BlockLayout::HypersparseTag());
+    break;
+  case BlockLayout::BITMAP:
+    spmv(rvec, res, BlockLayout::BitmapTag());
+    break;
+  case BlockLayout::HILBERT:
+    spmv(rvec, res, BlockLayout::HilbertTag());
+    break;
+  default:
+    spmv(rvec, res, BlockLayout::CsrTag());
+  }
+}
+
+/*! `res += ` the part `part` of `nparts` of `this * rvec`, computed by
+ * the calling thread alone: the parts of a block may be run at the same
+ * time by several threads, each into its own `res`. `prepare_parts()`
+ * must be called once before.
+ */
+template <typename vecValueT>
+void SparseBMatrixCSR::multiply_add(const Vector<vecValueT> &rvec,
+                                    Vector<vecValueT> &res, uint64_t part,
+                                    uint64_t nparts) const {
+  if (n != rvec.get_lines() || m != res.get_lines()) {
+    std::ostringstream oss;
+    oss << "Error SpBMat[" << m << "x" << n << "] with Vec[" << rvec.get_lines()
+        << "]";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  switch (layout) {
+  case BlockLayout::HYPERSPARSE:
+    spmv_part(rvec, res, part, nparts, BlockLayout::HypersparseTag());
+    break;
+  case BlockLayout::BITMAP:
+    spmv_part(rvec, res, part, nparts, BlockLayout::BitmapTag());
+    break;
+  case BlockLayout::HILBERT:
+    spmv_part(rvec, res, part, nparts, BlockLayout::HilbertTag());
+    break;
+  default:
+    spmv_part(rvec, res, part, nparts, BlockLayout::CsrTag());
+  }
+}
+
+/*! Splits the CSR lines ahead of the products by parts, the threads
+ * then share the split without writing it
+ */
+void SparseBMatrixCSR::prepare_parts() const {
+  if (layout == BlockLayout::CSR && m > 0) {
+    row_partition();
+  }
+}
+
+/*! The `MergePath` parts [nsplit * part / nparts; nsplit * (part + 1) / nparts)
+ * of the split made for the threads
+ */
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv_part(const Vector<vecValueT> &rvec,
+                                 Vector<vecValueT> &res, uint64_t part,
+                                 uint64_t nparts, BlockLayout::CsrTag) const {
+  if (m == 0) {
+    return;
+  }
+
+  const uint64_t *ia_ptr = ia_data();
+  const uint64_t *ja_ptr = ja_data();
+  const vecValueT *x = rvec.data();
+
+  /* Not split: the lines are shared out whole */
+  if (row_parts.empty()) {
+    if (!ja32.empty()) {
+      SpmvKernel::csr_rows(ia_ptr, ja32.data(), x, res.data(),
+                           m * part / nparts, m * (part + 1) / nparts);
+    } else {
+      SpmvKernel::csr_rows(ia_ptr, ja_ptr, x, res.data(), m * part / nparts,
+                           m * (part + 1) / nparts);
+    }
+    return;
+  }
+
+  const std::vector<MergePath::Coord> &parts = row_parts;
+  const uint64_t nsplit = parts.size() - 1;
+
+  for (uint64_t p = nsplit * part / nparts; p < nsplit * (part + 1) / nparts;
+       p++) {
+    MergePath::run_part(
+        parts, p, ia_ptr, m, res.data(),
+        [&](uint64_t first, uint64_t last) {
+          if (!ja32.empty()) {
+            SpmvKernel::csr_rows(ia_ptr, ja32.data(), x, res.data(), first,
+                                 last);
+          } else {
+            SpmvKernel::csr_rows(ia_ptr, ja_ptr, x, res.data(), first, last);
+          }
+        },
+        [&](uint64_t begin, uint64_t end) {
+          vecValueT sum = 0;
+          for (uint64_t k = begin; k < end; k++) {
+            sum += x[ja_ptr[k]];
+          }
+          return sum;
+        });
+  }
+}
+
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv_part(const Vector<vecValueT> &rvec,
+                                 Vector<vecValueT> &res, uint64_t part,
+                                 uint64_t nparts,
+                                 BlockLayout::HypersparseTag) const {
+  const uint64_t nrows = rows.size();
+
+  for (uint64_t r = nrows * part / nparts; r < nrows * (part + 1) / nparts;
+       r++) {
+    vecValueT sum = 0;
+    for (uint64_t ja_idx = ia[r]; ja_idx < ia[r + 1]; ja_idx++) {
+      sum += rvec[ja[ja_idx]];
+    }
+    res[rows[r]] += sum;
+  }
+}
+
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv_part(const Vector<vecValueT> &rvec,
+                                 Vector<vecValueT> &res, uint64_t part,
+                                 uint64_t nparts,
+                                 BlockLayout::BitmapTag) const {
+  const uint64_t wpr = BlockLayout::words_per_row(n);
+
+  for (uint64_t i = m * part / nparts; i < m * (part + 1) / nparts; i++) {
+    vecValueT sum = 0;
+    for (uint64_t w = 0; w < wpr; w++) {
+      uint64_t word = bits[i * wpr + w];
+      while (word != 0) {
+        sum += rvec[w * 64 + __builtin_ctzll(word)];
+        word &= word - 1;
+      }
+    }
+    res[i] += sum;
+  }
+}
+
+/*! An equal share of the curve, summed straight into `res` */
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv_part(const Vector<vecValueT> &rvec,
+                                 Vector<vecValueT> &res, uint64_t part,
+                                 uint64_t nparts,
+                                 BlockLayout::HilbertTag) const {
+  const uint64_t tile_bits = BlockLayout::tile_bits;
+  const uint64_t tile_mask = BlockLayout::tile_side - 1;
+
+  uint64_t elem_begin = nnz * part / nparts;
+  uint64_t elem_end = nnz * (part + 1) / nparts;
+  if (elem_begin == elem_end)
+    return;
+
+  uint64_t tile_begin =
+      std::upper_bound(ia.begin(), ia.end(), elem_begin) - ia.begin() - 1;
+  uint64_t tile_end =
+      std::upper_bound(ia.begin(), ia.end(), elem_end - 1) - ia.begin();
+
+  for (uint64_t t = tile_begin; t < tile_end; t++) {
+    const uint64_t line0 = (tiles[t] >> 32) << tile_bits;
+    const uint64_t col0 = (tiles[t] & 0xffffffff) << tile_bits;
+    const uint64_t end = std::min(ia[t + 1], elem_end);
+
+    for (uint64_t idx = std::max(ia[t], elem_begin); idx < end; idx++) {
+      res[line0 + (coords[idx] >> tile_bits)] +=
+          rvec[col0 + (coords[idx] & tile_mask)];
+    }
+  }
+}
+
+/*! One part of the `MergePath` per thread, lines summed with the
+ * `SpmvKernel` of the CPU
+ */
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv(const Vector<vecValueT> &rvec,
+                            Vector<vecValueT> &res, BlockLayout::CsrTag) const {
+  if (m == 0) {
+    return;
+  }
+
+  const uint64_t *ia_ptr = ia_data();
+  const uint64_t *ja_ptr = ja_data();
+  const vecValueT *x = rvec.data();
+
+  MergePath::run(
+      row_partition(), ia_ptr, m, res.data(), props->nthreads,
+      [&](uint64_t first, uint64_t last) {
+        if (!ja32.empty()) {
+          SpmvKernel::csr_rows(ia_ptr, ja32.data(), x, res.data(), first, last);
+        } else {
+          SpmvKernel::csr_rows(ia_ptr, ja_ptr, x, res.data(), first, last);
+        }
+      },
+      [&](uint64_t begin, uint64_t end) {
+        vecValueT sum = 0;
+        for (uint64_t k = begin; k < end; k++) {
+          sum += x[ja_ptr[k]];
+        }
+        return sum;
+      });
+}
+
+/*! Only the non-empty lines are visited */
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv(const Vector<vecValueT> &rvec,
+                            Vector<vecValueT> &res,
+                            BlockLayout::HypersparseTag) const {
+  const uint64_t nrows = rows.size();
+
+#pragma omp parallel for num_threads(props->nthreads)
+  for (uint64_t r = 0; r < nrows; r++) {
+    vecValueT sum = 0;
+    for (uint64_t ja_idx = ia[r]; ja_idx < ia[r + 1]; ja_idx++) {
+      sum += rvec[ja[ja_idx]];
+    }
+    res[rows[r]] += sum;
+  }
+}
+
+/*! Walks the set bits of each line word by word */
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv(const Vector<vecValueT> &rvec,
+                            Vector<vecValueT> &res,
+                            BlockLayout::BitmapTag) const {
+  const uint64_t wpr = BlockLayout::words_per_row(n);
 
 #pragma omp parallel for num_threads(props->nthreads)
   for (uint64_t i = 0; i < m; i++) {
-    for (uint64_t ja_idx = ia[i]; ja_idx < ia[i + 1]; ja_idx++) {
-      res[i] += rvec[ja[ja_idx]];
+    vecValueT sum = 0;
+    for (uint64_t w = 0; w < wpr; w++) {
+      uint64_t word = bits[i * wpr + w];
+      while (word != 0) {
+        sum += rvec[w * 64 + __builtin_ctzll(word)];
+        word &= word - 1;
+      }
     }
+    res[i] += sum;
   }
+}
 
-  return res;
+/*! Each thread takes an equal share of the curve and sums its lines in
+ * a private buffer covering the tiles of its share, the buffers are then
+ * added to the result line by line
+ */
+template <typename vecValueT>
+void SparseBMatrixCSR::spmv(const Vector<vecValueT> &rvec,
+                            Vector<vecValueT> &res,
+                            BlockLayout::HilbertTag) const {
+  const uint64_t nparts = std::max<uint64_t>(props->nthreads, 1);
+  const uint64_t tile_bits = BlockLayout::tile_bits;
+  const uint64_t tile_side = BlockLayout::tile_side;
+  const uint64_t tile_mask = tile_side - 1;
+
+  std::vector<std::vector<vecValueT>> partial(nparts);
+  std::vector<uint64_t> first_line(nparts, 0);
+
+#pragma omp parallel for num_threads(props->nthreads) schedule(static, 1)
+  for (uint64_t p = 0; p < nparts; p++) {
+    uint64_t elem_begin = nnz * p / nparts;
+    uint64_t elem_end = nnz * (p + 1) / nparts;
+    if (elem_begin == elem_end)
+      continue;
+
+    uint64_t tile_begin =
+        std::upper_bound(ia.begin(), ia.end(), elem_begin) - ia.begin() - 1;
+    uint64_t tile_end =
+        std::upper_bound(ia.begin(), ia.end(), elem_end - 1) - ia.begin();
+
+    uint64_t line_min = m, line_max = 0;
+    for (uint64_t t = tile_begin; t < tile_end; t++) {
+      line_min = std::min(line_min, (tiles[t] >> 32) << tile_bits);
+      line_max = std::max(line_max, ((tiles[t] >> 32) << tile_bits) + tile_side);
+    }
+    line_max = std::min(line_max, m);
+
+    first_line[p] = line_min;
+    partial[p].assign(line_max - line_min, 0);
+    vecValueT *acc = partial[p].data() - line_min;
+
+    for (uint64_t t = tile_begin; t < tile_end; t++) {
+      const uint64_t line0 = (tiles[t] >> 32) << tile_bits;
+      const uint64_t col0 = (tiles[t] & 0xffffffff) << tile_bits;
+      const uint64_t end = std::min(ia[t + 1], elem_end);
+
+      for (uint64_t idx = std::max(ia[t], elem_begin); idx < end; idx++) {
+        acc[line0 + (coords[idx] >> tile_bits)] +=
+            rvec[col0 + (coords[idx] & tile_mask)];
+      }
+    }
+  }
+
+#pragma omp parallel for num_threads(props->nthreads)
+  for (uint64_t i = 0; i < m; i++) {
+    for (uint64_t p = 0; p < nparts; p++) {
+      if (i >= first_line[p] && i - first_line[p] < partial[p].size())
+        res[i] += partial[p][i - first_line[p]];
+    }
+  }
 }
 
 Vector<double> SparseBMatrixCSR::columns_sum() {
 
   Vector<double> res(props, m, 0.);
 
-  for (uint64_t i = 0; i < ja.size(); i++) {
-    res[ja[i]] += 1;
+  if (layout == BlockLayout::HILBERT) {
+    const uint64_t tile_bits = BlockLayout::tile_bits;
+    const uint64_t tile_mask = BlockLayout::tile_side - 1;
+    for (uint64_t t = 0; t < tiles.size(); t++) {
+      const uint64_t col0 = (tiles[t] & 0xffffffff) << tile_bits;
+      for (uint64_t idx = ia[t]; idx < ia[t + 1]; idx++) {
+        res[col0 + (coords[idx] & tile_mask)] += 1;
+      }
+    }
+    return res;
+  }
+
+  if (layout == BlockLayout::BITMAP) {
+    const uint64_t wpr = BlockLayout::words_per_row(n);
+    for (uint64_t i = 0; i < bits.size(); i++) {
+      for (uint64_t word = bits[i]; word != 0; word &= word - 1) {
+        res[(i % wpr) * 64 + __builtin_ctzll(word)] += 1;
+      }
+    }
+    return res;
+  }
+
+  const uint64_t *ja_ptr = ja_data();
+
+  for (uint64_t i = 0; i < nnz; i++) {
+    res[ja_ptr[i]] += 1;
   }
 
   return res;
@@ -15,6 +15,9 @@
 #include "properties.hpp"
 
 #include "sparse_bmatrix_csr.hpp"
+#include "codec.hpp"
+#include "block_writer.hpp"
+#include "block_header.hpp"
 
 namespace graphee
 {
@@ -30,7 +33,7 @@ template <typename ValueT>
 class SparseMatrixCSR : public SparseBMatrixCSR
 {
 public:
-  SparseMatrixCSR(Properties *properties) : SparseBMatrixCSR(properties)
+  SparseMatrixCSR(Properties *properties) : SparseBMatrixCSR(properties), a_view(nullptr)
   {
     if (typeid(ValueT) == typeid(bool))
     {
@@ -41,7 +44,7 @@ public:
 
   SparseMatrixCSR(Properties *properties, uint64_t nlines, uint64_t ncols,
                   uint64_t nonzero_elems, ValueT init_val = 0.) :
-    SparseBMatrixCSR(properties, nlines, ncols, nonzero_elems)
+    SparseBMatrixCSR(properties, nlines, ncols, nonzero_elems), a_view(nullptr)
   {
     if (typeid(ValueT) == typeid(bool))
     {
@@ -60,7 +63,11 @@ public:
     }
   }
 
-  SparseMatrixCSR(SparseMatrixCSR<ValueT> &&mat) : SparseBMatrixCSR(std::move(mat)), a(std::move(mat.a)) {}
+  SparseMatrixCSR(SparseMatrixCSR<ValueT> &&mat) : SparseBMatrixCSR(std::move(mat)), a(std::move(mat.a)),
+    a_view(mat.a_view)
+  {
+    mat.a_view = nullptr;
+  }
 
   ~SparseMatrixCSR()
   {
@@ -72,7 +79,13 @@ public:
   void remove(uint64_t i, uint64_t j, ValueT val);
 
   void save(std::string filename, int file_format = Utils::BIN);
+  void save(GraphContainer &container, std::string key, int file_format = Utils::BIN);
+  void save(BlockWriter &matfp, int file_format);
+
   void load(std::string filename);
+  void load(GraphContainer &container, std::string key);
+  bool load(std::istream &matfp, std::string name);
+  void map(std::string filename);
 
   size_t size();
 
@@ -81,15 +94,27 @@ public:
   void clear();
 
   template <typename vecValueT>
-  Vector<vecValueT> &operator*(Vector<vecValueT> &rvec);
+  Vector<vecValueT> operator*(Vector<vecValueT> &rvec);
+  template <typename vecValueT>
+  void multiply_add(const Vector<vecValueT> &rvec, Vector<vecValueT> &res);
+  template <typename vecValueT>
+  void multiply_add(const Vector<vecValueT> &rvec, Vector<vecValueT> &res, uint64_t part, uint64_t nparts) const;
   SparseMatrixCSR<ValueT> &operator*(ValueT rval);
 
+  SparseMatrixCSR<ValueT> transpose() const;
+
   const std::string matrix_typename{"SparseMatrixCSR"};
 
   using ValueType = ValueT;
 
 private:
   std::vector<ValueT> a;
+  const ValueT *a_view;
+
+  const ValueT *a_data() const;
+
+  bool read(std::istream &matfp, std::string name);
+  void map_image(MappedFile &&file, std::string name);
 }; // class SparseMatrixCSR
 
 /*! Filling the sparse matrix with sorted entries by
@@ -99,7 +124,22 @@ template <typename ValueT>
 void SparseMatrixCSR<ValueT>::fill(uint64_t i, uint64_t j, ValueT val)
 {
   SparseBMatrixCSR::fill(i, j);
-  a[ia[i + 1]] = val;
+  a[ia[i + 1] - 1] = val;
+}
+
+/*! Returns the transposed matrix, with its values */
+template <typename ValueT>
+SparseMatrixCSR<ValueT> SparseMatrixCSR<ValueT>::transpose() const
+{
+  SparseMatrixCSR<ValueT> tmat(props, n, m, nnz);
+  const ValueT *a_ptr = a_data();
+
+  transpose_into(tmat, [&](uint64_t src, uint64_t dst)
+  {
+    tmat.a[dst] = a_ptr[src];
+  });
+
+  return tmat;
 }
 
 /*! Inserting element in a CSR matrix */
@@ -117,15 +157,33 @@ void SparseMatrixCSR<ValueT>::remove(uint64_t i, uint64_t j, ValueT val)
 template <typename ValueT>
 void SparseMatrixCSR<ValueT>::save(std::string name, int fileformat)
 {
-  std::ofstream matfp(name, std::ios_base::binary);
+  BlockWriter matfp(name);
+  save(matfp, fileformat);
+  matfp.close();
+}
+
+/*! Stores the matrix as the extent `key` of a `GraphContainer` */
+template <typename ValueT>
+void SparseMatrixCSR<ValueT>::save(GraphContainer &container, std::string key, int fileformat)
+{
+  std::vector<char> image;
+  BlockWriter matfp(&image);
+  save(matfp, fileformat);
+  matfp.close();
+
+  container.write(key, image);
+}
 
+template <typename ValueT>
+void SparseMatrixCSR<ValueT>::save(BlockWriter &matfp, int fileformat)
+{
   size_t matrix_typename_size = matrix_typename.size();
 
   /* Save explicitly matrix properties */
   matfp.write(reinterpret_cast<const char *>(&matrix_typename_size), sizeof(size_t));
   matfp.write(reinterpret_cast<const char *>(matrix_typename.c_str()), matrix_typename_size);
 
-  /* Save fileformat {BIN, SNAPPY} */
+  /* Save fileformat {BIN, SNAPPY, ALIGNED, SNAPPY_CHUNKS, ZSTD, LZ4} */
   matfp.write(reinterpret_cast<const char *>(&fileformat), sizeof(int));
 
   /* Matrix dimension */
@@ -134,46 +192,112 @@ void SparseMatrixCSR<ValueT>::save(std::string name, int fileformat)
 
   if (fileformat == Utils::BIN)
   {
-    matfp.write(reinterpret_cast<const char *>(a.data()), a.size() * sizeof(ValueT));
-    matfp.write(reinterpret_cast<const char *>(ia.data()), ia.size() * sizeof(uint64_t));
-    matfp.write(reinterpret_cast<const char *>(ja.data()), ja.size() * sizeof(uint64_t));
+    matfp.write_array(reinterpret_cast<const char *>(a_data()), nnz * sizeof(ValueT));
+    matfp.write_array(reinterpret_cast<const char *>(ia_data()), (m + 1) * sizeof(uint64_t));
+    matfp.write_array(reinterpret_cast<const char *>(ja_data()), nnz * sizeof(uint64_t));
   }
   else if (fileformat == Utils::SNAPPY)
   {
-    size_t a_snappy_size = snappy::MaxCompressedLength64(a.size() * sizeof(ValueT));
+    /* The arrays are read through their views, a mapped matrix has no copy */
+    size_t a_snappy_size = snappy::MaxCompressedLength64(nnz * sizeof(ValueT));
     char *a_snappy = new char[a_snappy_size];
-    snappy::RawCompress64(reinterpret_cast<char *>(a.data()), a.size() * sizeof(ValueT), a_snappy, &a_snappy_size);
+    snappy::RawCompress64(reinterpret_cast<const char *>(a_data()), nnz * sizeof(ValueT), a_snappy, &a_snappy_size);
 
     matfp.write(reinterpret_cast<const char *>(&a_snappy_size), sizeof(size_t));
     matfp.write(reinterpret_cast<const char *>(a_snappy), a_snappy_size);
     delete[] a_snappy;
 
-    size_t ia_snappy_size = snappy::MaxCompressedLength64(ia.size() * sizeof(uint64_t));
+    size_t ia_snappy_size = snappy::MaxCompressedLength64((m + 1) * sizeof(uint64_t));
     char *ia_snappy = new char[ia_snappy_size];
-    snappy::RawCompress64(reinterpret_cast<char *>(ia.data()), ia.size() * sizeof(uint64_t), ia_snappy, &ia_snappy_size);
+    snappy::RawCompress64(reinterpret_cast<const char *>(ia_data()), (m + 1) * sizeof(uint64_t), ia_snappy, &ia_snappy_size);
 
     matfp.write(reinterpret_cast<const char *>(&ia_snappy_size), sizeof(size_t));
     matfp.write(reinterpret_cast<const char *>(ia_snappy), ia_snappy_size);
     delete[] ia_snappy;
 
-    size_t ja_snappy_size = snappy::MaxCompressedLength64(ja.size() * sizeof(uint64_t));
+    size_t ja_snappy_size = snappy::MaxCompressedLength64(nnz * sizeof(uint64_t));
     char *ja_snappy = new char[ja_snappy_size];
-    snappy::RawCompress64(reinterpret_cast<char *>(ja.data()), ja.size() * sizeof(uint64_t), ja_snappy, &ja_snappy_size);
+    snappy::RawCompress64(reinterpret_cast<const char *>(ja_data()), nnz * sizeof(uint64_t), ja_snappy, &ja_snappy_size);
 
     matfp.write(reinterpret_cast<const char *>(&ja_snappy_size), sizeof(size_t));
     matfp.write(reinterpret_cast<const char *>(ja_snappy), ja_snappy_size);
     delete[] ja_snappy;
   }
-
-  matfp.close();
+  else if (Codec::is_chunked(fileformat))
+  {
+    /* Version 2 layout, sections `ia`, `ja` then `a` cut at the same rows */
+    std::vector<uint64_t> row_cuts = BlockHeader::csr_row_cuts(ia_data(), m, sizeof(uint64_t) + sizeof(ValueT));
+    BlockHeader::write(matfp, fileformat, row_cuts,
+    {
+      BlockHeader::row_section(ia_data(), sizeof(uint64_t), m + 1, row_cuts),
+      BlockHeader::nz_section(ja_data(), sizeof(uint64_t), ia_data(), row_cuts),
+      BlockHeader::nz_section(a_data(), sizeof(ValueT), ia_data(), row_cuts)
+    });
+  }
+  else if (fileformat == Utils::ALIGNED)
+  {
+    AlignedLayout layout;
+    layout.version = AlignedLayout::current_version;
+    layout.alignment = MappedFile::alignment;
+    layout.ia_offset = MappedFile::align(matfp.tellp() + sizeof(AlignedLayout));
+    layout.ja_offset = MappedFile::align(layout.ia_offset + (m + 1) * sizeof(uint64_t));
+    layout.a_offset = MappedFile::align(layout.ja_offset + nnz * sizeof(uint64_t));
+
+    matfp.write(reinterpret_cast<const char *>(&layout), sizeof(AlignedLayout));
+
+    /* seek() pads the sections with zeros */
+    matfp.seek(layout.ia_offset);
+    matfp.write_array(reinterpret_cast<const char *>(ia_data()), (m + 1) * sizeof(uint64_t));
+    matfp.seek(layout.ja_offset);
+    matfp.write_array(reinterpret_cast<const char *>(ja_data()), nnz * sizeof(uint64_t));
+    matfp.seek(layout.a_offset);
+    matfp.write_array(reinterpret_cast<const char *>(a_data()), nnz * sizeof(ValueT));
+  }
 }
 
 template <typename ValueT>
 void SparseMatrixCSR<ValueT>::load(std::string name)
 {
-  this->clear();
   std::ifstream matfp(name, std::ios_base::binary);
 
+  if (!read(matfp, name))
+  {
+    matfp.close();
+    map(name);
+  }
+}
+
+/*! Reads an extent of a `GraphContainer`, `Utils::ALIGNED` extents are
+ * used in place
+ */
+template <typename ValueT>
+void SparseMatrixCSR<ValueT>::load(GraphContainer &container, std::string key)
+{
+  MappedStream matfp(container.map(key));
+
+  if (!read(matfp, key))
+  {
+    map_image(std::move(matfp.mapping()), key);
+  }
+}
+
+/*! Reads an image from a stream, e.g. one kept in memory, returns false
+ * for an `Utils::ALIGNED` image which can only be mapped
+ */
+template <typename ValueT>
+bool SparseMatrixCSR<ValueT>::load(std::istream &matfp, std::string name)
+{
+  return read(matfp, name);
+}
+
+/*! Reads the matrix, returns false for `Utils::ALIGNED` images which
+ * are mapped instead
+ */
+template <typename ValueT>
+bool SparseMatrixCSR<ValueT>::read(std::istream &matfp, std::string name)
+{
+  this->clear();
+
   /* Save explicitly matrix properties */
   size_t matrix_typename_size;
   matfp.read(reinterpret_cast<char *>(&matrix_typename_size), sizeof(size_t));
@@ -191,13 +315,21 @@ void SparseMatrixCSR<ValueT>::load(std::string name)
     exit(-1);
   }
 
-  /* Read fileformat {BIN, SNAPPY} */
+  /* Read fileformat {BIN, SNAPPY, ALIGNED, SNAPPY_CHUNKS, ZSTD, LZ4} */
   int fileformat;
   matfp.read(reinterpret_cast<char *>(&fileformat), sizeof(int));
 
+  if (fileformat == Utils::ALIGNED)
+  {
+    return false;
+  }
+
   /* Matrix dimension */
   matfp.read(reinterpret_cast<char *>(&m), sizeof(uint64_t));
   matfp.read(reinterpret_cast<char *>(&nnz), sizeof(uint64_t));
+  n = m;
+  ja32.clear();
+  row_parts.clear();
 
   if ((nnz + m + 1) * sizeof(uint64_t) + nnz * sizeof(ValueT) < props->ram_limit)
   {
@@ -208,7 +340,6 @@ void SparseMatrixCSR<ValueT>::load(std::string name)
   else
   {
     print_error("Requested size is beyond \'ram_limit\'");
-    matfp.close();
     exit(-1);
   }
 
@@ -234,8 +365,6 @@ void SparseMatrixCSR<ValueT>::load(std::string name)
     if (!uncomp_succeed)
     {
       print_error("SNAPPY uncompression of A failed");
-
-      matfp.close();
       exit(-1);
     }
 
@@ -251,8 +380,6 @@ void SparseMatrixCSR<ValueT>::load(std::string name)
     if (!uncomp_succeed)
     {
       print_error("SNAPPY uncompression of IA failed");
-
-      matfp.close();
       exit(-1);
     }
 
@@ -268,15 +395,59 @@ void SparseMatrixCSR<ValueT>::load(std::string name)
     if (!uncomp_succeed)
     {
       print_error("SNAPPY uncompression of JA failed");
+      exit(-1);
+    }
+  }
+  else if (Codec::is_chunked(fileformat))
+  {
+    BlockHeader header;
+    bool succeed = header.read(matfp, fileformat)
+                   && header.read_elements(matfp, 0, 0, m + 1, reinterpret_cast<char *>(ia.data()), props->nthreads)
+                   && header.read_elements(matfp, 1, 0, nnz, reinterpret_cast<char *>(ja.data()), props->nthreads)
+                   && header.read_elements(matfp, 2, 0, nnz, reinterpret_cast<char *>(a.data()), props->nthreads);
 
-      matfp.close();
+    if (!succeed)
+    {
+      std::ostringstream oss;
+      oss << "Chunked uncompression of \'" << name << "\' failed";
+      print_error(oss.str());
       exit(-1);
     }
   }
 
   fill_id = m - 1;
 
-  matfp.close();
+  return true;
+}
+
+/*! Maps an `Utils::ALIGNED` file, `ia`, `ja` and `a` are used in place */
+template <typename ValueT>
+void SparseMatrixCSR<ValueT>::map(std::string name)
+{
+  map_image(MappedFile(name), name);
+}
+
+template <typename ValueT>
+void SparseMatrixCSR<ValueT>::map_image(MappedFile &&file, std::string name)
+{
+  a.clear();
+  AlignedLayout layout = map_aligned(std::move(file), name, matrix_typename);
+
+  if (nnz != 0 && layout.a_offset + nnz * sizeof(ValueT) > mapping.size())
+  {
+    std::ostringstream oss;
+    oss << "Truncated values section in \'" << name << "\'";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  a_view = reinterpret_cast<const ValueT *>(mapping.data() + layout.a_offset);
+}
+
+template <typename ValueT>
+const ValueT *SparseMatrixCSR<ValueT>::a_data() const
+{
+  return mapping.is_mapped() ? a_view : a.data();
 }
 
 template <typename ValueT>
@@ -295,9 +466,19 @@ void SparseMatrixCSR<ValueT>::clear()
 
 template <typename ValueT>
 template <typename vecValueT>
-Vector<vecValueT> &SparseMatrixCSR<ValueT>::operator*(Vector<vecValueT> &rvec)
+Vector<vecValueT> SparseMatrixCSR<ValueT>::operator*(Vector<vecValueT> &rvec)
+{
+  Vector<vecValueT> res(rvec.get_properties(), m, 0.);
+  multiply_add(rvec, res);
+  return res;
+}
+
+/*! `res += this * rvec`, without a temporary result */
+template <typename ValueT>
+template <typename vecValueT>
+void SparseMatrixCSR<ValueT>::multiply_add(const Vector<vecValueT> &rvec, Vector<vecValueT> &res)
 {
-  if (n != rvec.get_lines())
+  if (n != rvec.get_lines() || m != res.get_lines())
   {
     std::ostringstream oss;
     oss << "Error SpMat[" << m << "x" << n << "] with Vec[" << rvec.get_lines() << "]";
@@ -305,15 +486,87 @@ Vector<vecValueT> &SparseMatrixCSR<ValueT>::operator*(Vector<vecValueT> &rvec)
     exit(-1);
   }
 
-  Vector<vecValueT> res(rvec.get_properties(), m, 0.);
+  if (m == 0)
+    return;
 
-#pragma omp parallel for num_threads(props->nthreads)
-  for (uint64_t i = 0; i < m; i++)
+  const uint64_t *ia_ptr = ia_data();
+  const uint64_t *ja_ptr = ja_data();
+  const ValueT *a_ptr = a_data();
+
+  auto sum = [&](uint64_t begin, uint64_t end)
+  {
+    vecValueT line_sum = 0;
+    for (uint64_t ja_idx = begin; ja_idx < end; ja_idx++)
+    {
+      line_sum += a_ptr[ja_idx] * rvec[ja_ptr[ja_idx]];
+    }
+    return line_sum;
+  };
+
+  /* Same split as the boolean blocks, a hub line is shared by threads */
+  MergePath::run(row_partition(), ia_ptr, m, res.data(), props->nthreads,
+                 [&](uint64_t first, uint64_t last)
   {
-    for (uint64_t ja_idx = ia[i]; ja_idx < ia[i + 1]; ja_idx++)
+    for (uint64_t i = first; i < last; i++)
     {
-      res[i] += a[ja[ja_idx]] * rvec[ja[ja_idx]];
+      res[i] += sum(ia_ptr[i], ia_ptr[i + 1]);
     }
+  }, sum);
+}
+
+/*! The part `part` of `nparts` of the product, in the calling thread,
+ * see `SparseBMatrixCSR::multiply_add()`
+ */
+template <typename ValueT>
+template <typename vecValueT>
+void SparseMatrixCSR<ValueT>::multiply_add(const Vector<vecValueT> &rvec, Vector<vecValueT> &res, uint64_t part,
+                                           uint64_t nparts) const
+{
+  if (n != rvec.get_lines() || m != res.get_lines())
+  {
+    std::ostringstream oss;
+    oss << "Error SpMat[" << m << "x" << n << "] with Vec[" << rvec.get_lines() << "]";
+    print_error(oss.str());
+    exit(-1);
+  }
+
+  if (m == 0)
+    return;
+
+  const uint64_t *ia_ptr = ia_data();
+  const uint64_t *ja_ptr = ja_data();
+  const ValueT *a_ptr = a_data();
+
+  auto sum = [&](uint64_t begin, uint64_t end)
+  {
+    vecValueT line_sum = 0;
+    for (uint64_t ja_idx = begin; ja_idx < end; ja_idx++)
+    {
+      line_sum += a_ptr[ja_idx] * rvec[ja_ptr[ja_idx]];
+    }
+    return line_sum;
+  };
+
+  /* Not split: the lines are shared out whole */
+  if (row_parts.empty())
+  {
+    for (uint64_t i = m * part / nparts; i < m * (part + 1) / nparts; i++)
+    {
+      res[i] += sum(ia_ptr[i], ia_ptr[i + 1]);
+    }
+    return;
+  }
+
+  const uint64_t nsplit = row_parts.size() - 1;
+  for (uint64_t p = nsplit * part / nparts; p < nsplit * (part + 1) / nparts; p++)
+  {
+    MergePath::run_part(row_parts, p, ia_ptr, m, res.data(), [&](uint64_t first, uint64_t last)
+    {
+      for (uint64_t i = first; i < last; i++)
+      {
+        res[i] += sum(ia_ptr[i], ia_ptr[i + 1]);
+      }
+    }, sum);
   }
 }
 
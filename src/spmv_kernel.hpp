@@ -0,0 +1,309 @@
+#ifndef GRAPHEE_SPMV_KERNEL_HPP__
+#define GRAPHEE_SPMV_KERNEL_HPP__
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "utils.hpp"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GRAPHEE_SPMV_X86
+#include <immintrin.h>
+#endif
+
+namespace graphee
+{
+
+/*! \brief Row sums of a boolean CSR block, `res[i] += sum x[ja[k]]` over
+ *         the elements `k` of the line `i`
+ *
+ * The values of the `double` vectors are loaded with hardware gathers,
+ * four by four with AVX2, eight by eight with AVX-512 (F and VL) and a
+ * masked tail.
+ * The widest level supported by the CPU is read once with CPUID, the
+ * environment variable `GRAPHEE_SPMV_ISA` (`scalar`, `avx2`, `avx512`)
+ * or `set_level()` can lower it, other values are reported and ignored. Other vector types, and other CPUs,
+ * use the scalar loop.
+ *
+ * The columns are read as 64-bit or as 32-bit ids, see
+ * `SparseBMatrixCSR::compact_indices()`.
+ */
+
+class SpmvKernel
+{
+public:
+  enum
+  {
+    SCALAR = 0,
+    AVX2,
+    AVX512
+  };
+
+  static int supported_level();
+  static int level();
+  static void set_level(int isa_level);
+  static std::string level_name(int isa_level);
+
+  template <typename IndexT, typename ValueT>
+  static void csr_rows(const uint64_t *ia, const IndexT *ja, const ValueT *x, ValueT *res,
+                       uint64_t first, uint64_t last);
+
+  template <typename IndexT>
+  static void csr_rows(const uint64_t *ia, const IndexT *ja, const double *x, double *res,
+                       uint64_t first, uint64_t last);
+
+private:
+  static int &current_level();
+
+#ifdef GRAPHEE_SPMV_X86
+  static void csr_rows_avx2(const uint64_t *ia, const uint64_t *ja, const double *x, double *res,
+                            uint64_t first, uint64_t last);
+  static void csr_rows_avx2(const uint64_t *ia, const uint32_t *ja, const double *x, double *res,
+                            uint64_t first, uint64_t last);
+  static void csr_rows_avx512(const uint64_t *ia, const uint64_t *ja, const double *x, double *res,
+                              uint64_t first, uint64_t last);
+  static void csr_rows_avx512(const uint64_t *ia, const uint32_t *ja, const double *x, double *res,
+                              uint64_t first, uint64_t last);
+#endif
+}; // class graphee::SpmvKernel
+
+inline int SpmvKernel::supported_level()
+{
+#ifdef GRAPHEE_SPMV_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl"))
+    return AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return AVX2;
+#endif
+  return SCALAR;
+}
+
+/*! The supported level, lowered by `GRAPHEE_SPMV_ISA` */
+inline int &SpmvKernel::current_level()
+{
+  static int isa_level = []()
+  {
+    int supported = supported_level();
+    const char *env = std::getenv("GRAPHEE_SPMV_ISA");
+    if (env == nullptr)
+      return supported;
+
+    std::string name(env);
+    int requested;
+    if (name == "scalar")
+      requested = SCALAR;
+    else if (name == "avx2")
+      requested = AVX2;
+    else if (name == "avx512")
+      requested = AVX512;
+    else
+    {
+      print_error("Unknown \'GRAPHEE_SPMV_ISA\' value \'" + name + "\' (scalar, avx2 or avx512), " +
+                  level_name(supported) + " is used");
+      return supported;
+    }
+    return requested < supported ? requested : supported;
+  }();
+  return isa_level;
+}
+
+inline int SpmvKernel::level()
+{
+  return current_level();
+}
+
+/*! Never above the supported level */
+inline void SpmvKernel::set_level(int isa_level)
+{
+  int supported = supported_level();
+  current_level() = isa_level < supported ? isa_level : supported;
+}
+
+inline std::string SpmvKernel::level_name(int isa_level)
+{
+  switch (isa_level)
+  {
+  case AVX2:
+    return "AVX2";
+  case AVX512:
+    return "AVX-512";
+  default:
+    return "scalar";
+  }
+}
+
+template <typename IndexT, typename ValueT>
+void SpmvKernel::csr_rows(const uint64_t *ia, const IndexT *ja, const ValueT *x, ValueT *res,
+                          uint64_t first, uint64_t last)
+{
+  for (uint64_t i = first; i < last; i++)
+  {
+    for (uint64_t k = ia[i]; k < ia[i + 1]; k++)
+    {
+      res[i] += x[ja[k]];
+    }
+  }
+}
+
+template <typename IndexT>
+void SpmvKernel::csr_rows(const uint64_t *ia, const IndexT *ja, const double *x, double *res,
+                          uint64_t first, uint64_t last)
+{
+#ifdef GRAPHEE_SPMV_X86
+  switch (level())
+  {
+  case AVX512:
+    csr_rows_avx512(ia, ja, x, res, first, last);
+    return;
+  case AVX2:
+    csr_rows_avx2(ia, ja, x, res, first, last);
+    return;
+  }
+#endif
+
+  for (uint64_t i = first; i < last; i++)
+  {
+    double sum = 0.;
+    for (uint64_t k = ia[i]; k < ia[i + 1]; k++)
+    {
+      sum += x[ja[k]];
+    }
+    res[i] += sum;
+  }
+}
+
+#ifdef GRAPHEE_SPMV_X86
+
+/* The gathers are written with an explicit source and mask: the plain
+ * intrinsics start from an undefined register, which GCC 12 reports as
+ * maybe uninitialized */
+
+__attribute__((target("avx2"))) inline double hsum_avx2(__m256d acc)
+{
+  __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+__attribute__((target("avx512f,avx512vl"))) inline double hsum_avx512(__m512d acc)
+{
+  double lanes[8];
+  _mm512_storeu_pd(lanes, acc);
+  return hsum_avx2(_mm256_add_pd(_mm256_loadu_pd(lanes), _mm256_loadu_pd(lanes + 4)));
+}
+
+__attribute__((target("avx2"))) inline void SpmvKernel::csr_rows_avx2(const uint64_t *ia, const uint64_t *ja,
+                                                                     const double *x, double *res,
+                                                                     uint64_t first, uint64_t last)
+{
+  for (uint64_t i = first; i < last; i++)
+  {
+    uint64_t k = ia[i];
+    const uint64_t end = ia[i + 1];
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    __m256d acc = zero;
+    for (; k + 4 <= end; k += 4)
+    {
+      __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ja + k));
+      acc = _mm256_add_pd(acc, _mm256_mask_i64gather_pd(zero, x, idx, all, 8));
+    }
+
+    double sum = hsum_avx2(acc);
+    for (; k < end; k++)
+    {
+      sum += x[ja[k]];
+    }
+    res[i] += sum;
+  }
+}
+
+__attribute__((target("avx2"))) inline void SpmvKernel::csr_rows_avx2(const uint64_t *ia, const uint32_t *ja,
+                                                                     const double *x, double *res,
+                                                                     uint64_t first, uint64_t last)
+{
+  for (uint64_t i = first; i < last; i++)
+  {
+    uint64_t k = ia[i];
+    const uint64_t end = ia[i + 1];
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    __m256d acc = zero;
+    for (; k + 4 <= end; k += 4)
+    {
+      __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ja + k));
+      acc = _mm256_add_pd(acc, _mm256_mask_i32gather_pd(zero, x, idx, all, 8));
+    }
+
+    double sum = hsum_avx2(acc);
+    for (; k < end; k++)
+    {
+      sum += x[ja[k]];
+    }
+    res[i] += sum;
+  }
+}
+
+/*! The last elements of a line are gathered under a mask */
+__attribute__((target("avx512f,avx512vl"))) inline void SpmvKernel::csr_rows_avx512(const uint64_t *ia, const uint64_t *ja,
+                                                                          const double *x, double *res,
+                                                                          uint64_t first, uint64_t last)
+{
+  for (uint64_t i = first; i < last; i++)
+  {
+    uint64_t k = ia[i];
+    const uint64_t end = ia[i + 1];
+
+    __m512d acc = _mm512_setzero_pd();
+    for (; k + 8 <= end; k += 8)
+    {
+      __m512i idx = _mm512_loadu_si512(ja + k);
+      acc = _mm512_add_pd(acc, _mm512_mask_i64gather_pd(_mm512_setzero_pd(), 0xff, idx, x, 8));
+    }
+
+    if (k < end)
+    {
+      __mmask8 tail = static_cast<__mmask8>((1u << (end - k)) - 1);
+      __m512i idx = _mm512_maskz_loadu_epi64(tail, ja + k);
+      acc = _mm512_add_pd(acc, _mm512_mask_i64gather_pd(_mm512_setzero_pd(), tail, idx, x, 8));
+    }
+
+    res[i] += hsum_avx512(acc);
+  }
+}
+
+__attribute__((target("avx512f,avx512vl"))) inline void SpmvKernel::csr_rows_avx512(const uint64_t *ia, const uint32_t *ja,
+                                                                          const double *x, double *res,
+                                                                          uint64_t first, uint64_t last)
+{
+  for (uint64_t i = first; i < last; i++)
+  {
+    uint64_t k = ia[i];
+    const uint64_t end = ia[i + 1];
+
+    __m512d acc = _mm512_setzero_pd();
+    for (; k + 8 <= end; k += 8)
+    {
+      __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ja + k));
+      acc = _mm512_add_pd(acc, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff, idx, x, 8));
+    }
+
+    if (k < end)
+    {
+      __mmask8 tail = static_cast<__mmask8>((1u << (end - k)) - 1);
+      __m256i idx = _mm256_maskz_loadu_epi32(tail, ja + k);
+      acc = _mm512_add_pd(acc, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), tail, idx, x, 8));
+    }
+
+    res[i] += hsum_avx512(acc);
+  }
+}
+
+#endif // GRAPHEE_SPMV_X86
+
+} // namespace graphee
+
+#endif // GRAPHEE_SPMV_KERNEL_HPP__
@@ -0,0 +1,240 @@
+#ifndef GRAPHEE_STORAGE_ROOTS_HPP__
+#define GRAPHEE_STORAGE_ROOTS_HPP__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <algorithm>
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include "utils.hpp"
+#include "properties.hpp"
+
+namespace graphee
+{
+
+/*! \brief Directories, one per drive, among which the `.gpe` files are spread
+ *
+ * The files are grouped by `key`: the blocks [line; col] by `line + col`,
+ * the slices by their id. Consecutive blocks of a line or of a column,
+ * and the slices read together, thus sit on different drives.
+ * - `ROUND_ROBIN` puts the group `key` on the root `key % nroots`,
+ * - `BY_SIZE` puts each new block on the root with the most free space
+ *   left once the files already placed are counted, the spill runs
+ *   and the slices, of equal sizes, stay round-robin. The slices of
+ *   all the vectors share the same roots so that `DiskVector::swap`
+ *   only renames files within a drive.
+ *
+ * `acquire()` and `release()` bound the number of concurrent streams
+ * on each drive: the builders of the blocks then read and write all the
+ * drives at once instead of piling up on one of them.
+ *
+ * Ignored when the graph is stored in a `GraphContainer`.
+ */
+
+class StorageRoots
+{
+public:
+  enum
+  {
+    ROUND_ROBIN,
+    BY_SIZE
+  };
+
+  /*! Groups of files, shifted from each other so that the spill run of
+   * a block, and the blocks built from it, are on different drives
+   */
+  enum
+  {
+    SPILL,
+    BLOCK,
+    DIRECT_BLOCK,
+    SLICE
+  };
+
+  StorageRoots(std::vector<std::string> roots, int placement = ROUND_ROBIN, uint64_t streams_per_root = 2);
+
+  std::string path(const std::string &filename, int kind, uint64_t key, size_t bytes = 0);
+  uint64_t root_of(const std::string &filename, int kind, uint64_t key, size_t bytes = 0);
+
+  void acquire(uint64_t root);
+  void release(uint64_t root);
+
+  uint64_t nroots() const
+  {
+    return roots.size();
+  }
+
+private:
+  std::vector<std::string> roots;
+  int placement;
+  uint64_t streams_per_root;
+
+  std::mutex mtx;
+  std::condition_variable cond;
+
+  std::map<std::string, uint64_t> placed;
+  std::vector<size_t> placed_bytes;
+  std::vector<uint64_t> streams;
+
+  bool exists(uint64_t root, const std::string &filename) const;
+  size_t free_bytes(uint64_t root) const;
+}; // class graphee::StorageRoots
+
+/*! Holds a stream on the root of a file for the scope of the guard */
+class StorageStream
+{
+public:
+  StorageStream(StorageRoots *storage, uint64_t root) : storage(storage), root(root)
+  {
+    if (storage != nullptr)
+      storage->acquire(root);
+  }
+
+  ~StorageStream()
+  {
+    if (storage != nullptr)
+      storage->release(root);
+  }
+
+  StorageStream(const StorageStream &) = delete;
+  StorageStream &operator=(const StorageStream &) = delete;
+
+private:
+  StorageRoots *storage;
+  uint64_t root;
+}; // class graphee::StorageStream
+
+inline StorageRoots::StorageRoots(std::vector<std::string> roots, int placement, uint64_t streams_per_root)
+  : roots(roots), placement(placement), streams_per_root(std::max<uint64_t>(streams_per_root, 1)),
+    placed_bytes(roots.size(), 0), streams(roots.size(), 0)
+{
+  if (roots.empty())
+  {
+    print_error("At least one storage root is needed");
+    exit(-1);
+  }
+
+  for (std::string &root : this->roots)
+  {
+    struct stat st;
+    if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+      std::ostringstream err;
+      err << "Storage root \'" << root << "\' is not a directory";
+      print_error(err.str());
+      exit(-1);
+    }
+
+    if (root.back() != '/')
+      root += '/';
+  }
+}
+
+/*! Path of `filename`, `bytes` is its expected size */
+inline std::string StorageRoots::path(const std::string &filename, int kind, uint64_t key, size_t bytes)
+{
+  return roots[root_of(filename, kind, key, bytes)] + filename;
+}
+
+inline uint64_t StorageRoots::root_of(const std::string &filename, int kind, uint64_t key, size_t bytes)
+{
+  uint64_t round_robin = (key + static_cast<uint64_t>(kind == SLICE ? 0 : kind)) % roots.size();
+
+  if (placement != BY_SIZE || (kind != BLOCK && kind != DIRECT_BLOCK) || roots.size() == 1)
+    return round_robin;
+
+  std::lock_guard<std::mutex> lock(mtx);
+
+  auto found = placed.find(filename);
+  if (found != placed.end())
+    return found->second;
+
+  /* Written by a previous run */
+  uint64_t best = roots.size();
+  for (uint64_t root = 0; root < roots.size() && best == roots.size(); root++)
+  {
+    if (exists(root, filename))
+      best = root;
+  }
+
+  if (best == roots.size())
+  {
+    best = round_robin;
+    size_t best_left = 0;
+    for (uint64_t root = 0; root < roots.size(); root++)
+    {
+      size_t free = free_bytes(root);
+      size_t left = free > placed_bytes[root] ? free - placed_bytes[root] : 0;
+      if (left > best_left)
+      {
+        best = root;
+        best_left = left;
+      }
+    }
+  }
+
+  placed[filename] = best;
+  placed_bytes[best] += bytes;
+  return best;
+}
+
+/*! Waits for a free stream on `root` */
+inline void StorageRoots::acquire(uint64_t root)
+{
+  std::unique_lock<std::mutex> lock(mtx);
+  while (streams[root] >= streams_per_root)
+  {
+    cond.wait(lock);
+  }
+  streams[root]++;
+}
+
+inline void StorageRoots::release(uint64_t root)
+{
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    streams[root]--;
+  }
+  cond.notify_all();
+}
+
+inline bool StorageRoots::exists(uint64_t root, const std::string &filename) const
+{
+  struct stat st;
+  return stat((roots[root] + filename).c_str(), &st) == 0;
+}
+
+inline size_t StorageRoots::free_bytes(uint64_t root) const
+{
+  struct statvfs st;
+  if (statvfs(roots[root].c_str(), &st) != 0)
+    return 0;
+  return static_cast<size_t>(st.f_bavail) * st.f_frsize;
+}
+
+/*! Path of a `.gpe` file, in the working directory without storage roots */
+inline std::string storage_path(Properties *props, const std::string &filename, int kind, uint64_t key,
+                                size_t bytes = 0)
+{
+  if (props->storage == nullptr)
+    return filename;
+  return props->storage->path(filename, kind, key, bytes);
+}
+
+inline uint64_t storage_root(Properties *props, const std::string &filename, int kind, uint64_t key,
+                             size_t bytes = 0)
+{
+  if (props->storage == nullptr)
+    return 0;
+  return props->storage->root_of(filename, kind, key, bytes);
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_STORAGE_ROOTS_HPP__
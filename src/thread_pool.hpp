@@ -0,0 +1,129 @@
+#ifndef GRAPHEE_THREAD_POOL_HPP__
+#define GRAPHEE_THREAD_POOL_HPP__
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+
+namespace graphee
+{
+
+/*! \brief Fixed-size pool of worker threads
+ *
+ * Tasks are run in submission order by the first free worker.
+ * A task must never wait for another task of the same pool.
+ * `ThreadPool::shared()` is the process-wide pool used by the
+ * I/O paths (chunk compression, ...), it has one worker per core.
+ */
+
+class ThreadPool
+{
+public:
+  ThreadPool(size_t nworkers);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  template <typename FuncT>
+  std::future<typename std::result_of<FuncT()>::type> submit(FuncT func);
+
+  size_t size() const;
+
+  static ThreadPool &shared();
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  bool stopping;
+
+  void work();
+}; // class graphee::ThreadPool
+
+inline ThreadPool::ThreadPool(size_t nworkers) : stopping(false)
+{
+  for (size_t i = 0; i < std::max<size_t>(nworkers, 1); i++)
+  {
+    workers.push_back(std::thread(&ThreadPool::work, this));
+  }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  cond.notify_all();
+
+  for (auto &thd : workers)
+  {
+    thd.join();
+  }
+}
+
+template <typename FuncT>
+std::future<typename std::result_of<FuncT()>::type> ThreadPool::submit(FuncT func)
+{
+  using ResultT = typename std::result_of<FuncT()>::type;
+
+  /* std::function needs a copyable callable, thus the shared_ptr */
+  std::shared_ptr<std::packaged_task<ResultT()>> task =
+      std::make_shared<std::packaged_task<ResultT()>>(std::move(func));
+  std::future<ResultT> res = task->get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    tasks.push_back([task]() { (*task)(); });
+  }
+  cond.notify_one();
+
+  return res;
+}
+
+inline size_t ThreadPool::size() const
+{
+  return workers.size();
+}
+
+inline ThreadPool &ThreadPool::shared()
+{
+  static ThreadPool pool(std::thread::hardware_concurrency());
+  return pool;
+}
+
+inline void ThreadPool::work()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      while (!stopping && tasks.empty())
+      {
+        cond.wait(lock);
+      }
+
+      if (tasks.empty())
+        return; // stopping and nothing left to do
+
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_THREAD_POOL_HPP__
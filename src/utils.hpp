@@ -19,7 +19,13 @@ public:
     PLAIN,
     GZ,
     BIN,
-    SNAPPY
+    SNAPPY,
+    ALIGNED,
+    SNAPPY_CHUNKS,
+    ZSTD,
+    LZ4,
+    BVGRAPH,
+    MAPPED
   };
   static const int DIRECT = 0x00000001;
   static const int TRANS = 0x00000010;
@@ -27,6 +33,32 @@ public:
   static const int OB = 0x00001000;
 };
 
+/*! \brief Compensated (Kahan) summation, the rounding error of each
+ *         addition is carried to the next one
+ */
+class KahanSum
+{
+public:
+  KahanSum() : sum(0.), compensation(0.) {}
+
+  void add(double val)
+  {
+    double y = val - compensation;
+    double t = sum + y;
+    compensation = (t - sum) - y;
+    sum = t;
+  }
+
+  double get() const
+  {
+    return sum;
+  }
+
+private:
+  double sum;
+  double compensation;
+};
+
 void print_log(std::string message);
 void print_strong_log(std::string message);
 void print_warning(std::string message);
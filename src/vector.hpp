@@ -9,6 +9,12 @@
 
 #include "utils.hpp"
 #include "properties.hpp"
+#include "codec.hpp"
+#include "block_writer.hpp"
+#include "block_header.hpp"
+#include "vector_filter.hpp"
+#include "mapped_file.hpp"
+#include "graph_container.hpp"
 
 #include "sparse_bmatrix_csr.hpp"
 #include "sparse_matrix_csr.hpp"
@@ -16,11 +22,94 @@
 namespace graphee
 {
 
+/*! Name written in the files of a `Vector<ValueT>`, the stored values
+ * are not converted on load. Vectors of `double` keep the original name.
+ */
+template <typename ValueT>
+inline std::string vector_typename_of()
+{
+  return "Vector";
+}
+
+template <>
+inline std::string vector_typename_of<float>()
+{
+  return "Vector<float>";
+}
+
+template <>
+inline std::string vector_typename_of<uint32_t>()
+{
+  return "Vector<uint32>";
+}
+
+template <typename ValueT>
+class Vector;
+
+/*! \brief Non-owning view of the values of a vector slice, e.g. in the
+ *         mapping of a `DiskVector`
+ */
+template <typename ValueT>
+class VectorView
+{
+public:
+  VectorView(ValueT *values, uint64_t nvalues) : values(values), nvalues(nvalues) {}
+
+  ValueT &operator[](uint64_t i) const
+  {
+    return values[i];
+  }
+
+  ValueT *data() const
+  {
+    return values;
+  }
+
+  uint64_t size() const
+  {
+    return nvalues;
+  }
+
+  uint64_t get_lines() const
+  {
+    return nvalues;
+  }
+
+  ValueT *begin() const
+  {
+    return values;
+  }
+
+  ValueT *end() const
+  {
+    return values + nvalues;
+  }
+
+  /*! The sizes must be equal, the view is not resized */
+  template <typename FromT>
+  const VectorView<ValueT> &convert_from(const Vector<FromT> &rvec) const
+  {
+    for (uint64_t i = 0; i < nvalues; i++)
+    {
+      values[i] = static_cast<ValueT>(rvec[i]);
+    }
+    return *this;
+  }
+
+private:
+  ValueT *values;
+  uint64_t nvalues;
+}; // class graphee::VectorView
+
 /*! \brief Graphee Vector class
  *         Includes load/dump of data on disk
  *
  * It contains overloaded operators for operations
  * with `sparseMatrix*` classes
+ *
+ * Compressed formats accept the `VectorFilter` flags, e.g.
+ * `Utils::ZSTD | VectorFilter::SHUFFLE`. With `XOR_DELTA`, the
+ * `reference` given to `save()` must also be given to `load()`.
  */
 
 template <typename ValueT>
@@ -37,8 +126,14 @@ public:
 
   ~Vector() {}
 
-  void save(std::string name, int fileformat = Utils::BIN);
-  void load(std::string name);
+  void save(std::string name, int fileformat = Utils::BIN, const Vector<ValueT> *reference = nullptr);
+  void save(GraphContainer &container, std::string key, int fileformat = Utils::BIN,
+            const Vector<ValueT> *reference = nullptr);
+  void save(BlockWriter &vecfp, int fileformat, const Vector<ValueT> *reference = nullptr);
+
+  void load(std::string name, const Vector<ValueT> *reference = nullptr);
+  void load(GraphContainer &container, std::string key, const Vector<ValueT> *reference = nullptr);
+  void load(std::istream &vecfp, std::string name, const Vector<ValueT> *reference = nullptr);
 
   Vector<ValueT> &operator+=(const Vector<ValueT>& rvec);
   Vector<ValueT> &operator+=(ValueT val);
@@ -50,7 +145,12 @@ public:
 
   Vector<ValueT> &divide_and_sum_Nan(Vector<ValueT> &rvec, ValueT& aggs);
 
-  const std::string vector_typename{"Vector"};
+  template <typename FromT>
+  Vector<ValueT> &convert_from(const Vector<FromT> &rvec);
+  template <typename FromT>
+  Vector<ValueT> &convert_from(const VectorView<FromT> &rvec);
+
+  const std::string vector_typename{vector_typename_of<ValueT>()};
 
   uint64_t get_lines() const;
 
@@ -64,46 +164,119 @@ private:
 }; // class graphee::Vector
 
 template <class ValueT>
-void Vector<ValueT>::save(std::string name, int fileformat)
+void Vector<ValueT>::save(std::string name, int fileformat, const Vector<ValueT> *reference)
 {
-  std::ofstream vecfp(name, std::ios_base::binary);
+  BlockWriter vecfp(name);
+  save(vecfp, fileformat, reference);
+  vecfp.close();
+}
+
+/*! Stores the vector as the extent `key` of a `GraphContainer` */
+template <class ValueT>
+void Vector<ValueT>::save(GraphContainer &container, std::string key, int fileformat,
+                          const Vector<ValueT> *reference)
+{
+  std::vector<char> image;
+  BlockWriter vecfp(&image);
+  save(vecfp, fileformat, reference);
+  vecfp.close();
+
+  container.write(key, image);
+}
 
+template <class ValueT>
+void Vector<ValueT>::save(BlockWriter &vecfp, int fileformat, const Vector<ValueT> *reference)
+{
   size_t vector_typename_size = vector_typename.size();
 
+  /* Filters are useless without compression, XOR_DELTA needs a reference */
+  int filters = VectorFilter::filters_of(fileformat);
+  fileformat = VectorFilter::format_of(fileformat);
+  if (fileformat == Utils::BIN)
+  {
+    filters = VectorFilter::NONE;
+  }
+  if (reference == nullptr || reference->size() != this->size())
+  {
+    filters &= ~VectorFilter::XOR_DELTA;
+  }
+
   /* Save explicitly Vector properties */
   vecfp.write(reinterpret_cast<const char *>(&vector_typename_size), sizeof(size_t));
   vecfp.write(reinterpret_cast<const char *>(vector_typename.c_str()), vector_typename_size);
 
-  /* Save fileformat {BIN, SNAPPY} */
-  vecfp.write(reinterpret_cast<const char *>(&fileformat), sizeof(int));
+  /* Save fileformat {BIN, SNAPPY, SNAPPY_CHUNKS, ZSTD, LZ4} and its filters */
+  int packed = fileformat | filters;
+  vecfp.write(reinterpret_cast<const char *>(&packed), sizeof(int));
 
   /* Vector dimension */
   size_t vec_size = this->size();
   vecfp.write(reinterpret_cast<const char *>(&vec_size), sizeof(size_t));
 
+  /* The filters work on the chunks that are compressed */
+  std::vector<uint64_t> row_cuts;
+  if (Codec::is_chunked(fileformat))
+  {
+    row_cuts = BlockHeader::dense_row_cuts(this->size(), sizeof(ValueT));
+  }
+  else
+  {
+    row_cuts = {0, this->size()};
+  }
+
+  const char *values = reinterpret_cast<const char *>(this->data());
+  if (filters != VectorFilter::NONE)
+  {
+    std::vector<char> filtered(this->size() * sizeof(ValueT));
+    VectorFilter::encode(values, reference ? reinterpret_cast<const char *>(reference->data()) : nullptr,
+                         filtered.data(), sizeof(ValueT), row_cuts, filters, props->nthreads);
+    values = vecfp.hold(std::move(filtered));
+  }
+
   if (fileformat == Utils::BIN)
   {
-    vecfp.write(reinterpret_cast<const char *>(this->data()), this->size() * sizeof(ValueT));
+    vecfp.write_array(values, this->size() * sizeof(ValueT));
   }
   else if (fileformat == Utils::SNAPPY)
   {
     size_t vec_snappy_size = snappy::MaxCompressedLength64(this->size() * sizeof(ValueT));
     char *vec_snappy = new char[vec_snappy_size];
-    snappy::RawCompress64(reinterpret_cast<char *>(this->data()), this->size() * sizeof(ValueT), vec_snappy, &vec_snappy_size);
+    snappy::RawCompress64(values, this->size() * sizeof(ValueT), vec_snappy, &vec_snappy_size);
 
     vecfp.write(reinterpret_cast<const char *>(&vec_snappy_size), sizeof(size_t));
     vecfp.write(reinterpret_cast<const char *>(vec_snappy), vec_snappy_size);
     delete[] vec_snappy;
   }
+  else if (Codec::is_chunked(fileformat))
+  {
+    /* Version 2 layout, a single section with one element per row */
+    BlockHeader::write(vecfp, fileformat, row_cuts,
+    {
+      BlockHeader::row_section(values, sizeof(ValueT), this->size(), row_cuts)
+    });
+  }
+}
 
+template <class ValueT>
+void Vector<ValueT>::load(std::string name, const Vector<ValueT> *reference)
+{
+  std::ifstream vecfp(name, std::ios_base::binary);
+  load(vecfp, name, reference);
   vecfp.close();
 }
 
+/*! Reads an extent of a `GraphContainer` */
 template <class ValueT>
-void Vector<ValueT>::load(std::string name)
+void Vector<ValueT>::load(GraphContainer &container, std::string key, const Vector<ValueT> *reference)
+{
+  MappedStream vecfp(container.map(key));
+  load(vecfp, key, reference);
+}
+
+template <class ValueT>
+void Vector<ValueT>::load(std::istream &vecfp, std::string name, const Vector<ValueT> *reference)
 {
   this->clear();
-  std::ifstream vecfp(name, std::ios_base::binary);
 
   /* Save explicitly Vector properties */
   size_t vector_typename_size;
@@ -122,14 +295,28 @@ void Vector<ValueT>::load(std::string name)
     exit(-1);
   }
 
-  /* Read fileformat {BIN, SNAPPY} */
+  /* Read fileformat {BIN, SNAPPY, SNAPPY_CHUNKS, ZSTD, LZ4} and its filters */
   int fileformat;
   vecfp.read(reinterpret_cast<char *>(&fileformat), sizeof(int));
 
+  int filters = VectorFilter::filters_of(fileformat);
+  fileformat = VectorFilter::format_of(fileformat);
+
   /* Vector dimension */
   size_t m;
   vecfp.read(reinterpret_cast<char *>(&m), sizeof(size_t));
 
+  if ((filters & VectorFilter::XOR_DELTA) && (reference == nullptr || reference->size() != m))
+  {
+    std::ostringstream err;
+    err << "\'" << name << "\' is stored as a delta, its reference vector is missing";
+    print_error(err.str());
+    exit(-1);
+  }
+
+  /* Chunks on which the filters were applied */
+  std::vector<uint64_t> row_cuts = {0, m};
+
   if (m * sizeof(ValueT) < props->ram_limit)
   {
     this->resize(m, 0);
@@ -137,7 +324,6 @@ void Vector<ValueT>::load(std::string name)
   else
   {
     print_error("Requested size is beyond \'ram_limit\'");
-    vecfp.close();
     exit(-1);
   }
 
@@ -161,13 +347,37 @@ void Vector<ValueT>::load(std::string name)
     if (!uncomp_succeed)
     {
       print_error("SNAPPY uncompression of vec failed");
+      exit(-1);
+    }
+  }
+  else if (Codec::is_chunked(fileformat))
+  {
+    BlockHeader header;
+    bool succeed = header.read(vecfp, fileformat)
+                   && header.read_elements(vecfp, 0, 0, this->size(), reinterpret_cast<char *>(this->data()), props->nthreads);
+
+    if (succeed && filters != VectorFilter::NONE)
+    {
+      row_cuts = {0};
+      for (const ChunkEntry &chunk : header.sections[0].chunks)
+        row_cuts.push_back(chunk.elem_end);
+    }
 
-      vecfp.close();
+    if (!succeed)
+    {
+      std::ostringstream err;
+      err << "Chunked uncompression of \'" << name << "\' failed";
+      print_error(err.str());
       exit(-1);
     }
   }
 
-  vecfp.close();
+  if (filters != VectorFilter::NONE)
+  {
+    VectorFilter::decode(reinterpret_cast<char *>(this->data()),
+                         reference ? reinterpret_cast<const char *>(reference->data()) : nullptr,
+                         sizeof(ValueT), row_cuts, filters, props->nthreads);
+  }
 }
 
 template <typename ValueT>
@@ -252,6 +462,37 @@ Vector<ValueT> &Vector<ValueT>::divide_and_sum_Nan(Vector<ValueT> &rvec, ValueT&
   return (*this);
 }
 
+/*! Copies `rvec` with a conversion of each value to `ValueT` */
+template <typename ValueT>
+template <typename FromT>
+Vector<ValueT> &Vector<ValueT>::convert_from(const Vector<FromT> &rvec)
+{
+  this->resize(rvec.size());
+
+#pragma omp parallel for num_threads(props->nthreads)
+  for (uint64_t i = 0; i < this->size(); i++)
+  {
+    (*this)[i] = static_cast<ValueT>(rvec[i]);
+  }
+
+  return (*this);
+}
+
+template <typename ValueT>
+template <typename FromT>
+Vector<ValueT> &Vector<ValueT>::convert_from(const VectorView<FromT> &rvec)
+{
+  this->resize(rvec.size());
+
+#pragma omp parallel for num_threads(props->nthreads)
+  for (uint64_t i = 0; i < this->size(); i++)
+  {
+    (*this)[i] = static_cast<ValueT>(rvec[i]);
+  }
+
+  return (*this);
+}
+
 template <typename ValueT>
 Properties* Vector<ValueT>::get_properties()
 {
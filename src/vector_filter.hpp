@@ -0,0 +1,162 @@
+#ifndef GRAPHEE_VECTOR_FILTER_HPP__
+#define GRAPHEE_VECTOR_FILTER_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace graphee
+{
+
+/*! \brief Reversible transforms of the values of a `Vector` before compression
+ *
+ * - `SHUFFLE` stores the first byte of every value, then the second
+ *   bytes, and so on. Sign, exponent and high mantissa bytes of close
+ *   floating point values are repeated, the compressor finds them once
+ *   they are contiguous.
+ * - `XOR_DELTA` stores the values XOR a reference vector of the same
+ *   size, e.g. the previous iteration, only the changing bits are left.
+ *   The same reference is needed to read the vector.
+ *
+ * The filters are applied chunk by chunk, on the chunks of the
+ * `BlockHeader`, and are recorded in the bits 8 to 15 of the fileformat
+ * of the vector file (`Utils::ZSTD | VectorFilter::SHUFFLE`).
+ */
+
+class VectorFilter
+{
+public:
+  enum
+  {
+    NONE = 0,
+    SHUFFLE = 1 << 8,
+    XOR_DELTA = 1 << 9
+  };
+
+  static int format_of(int packed)
+  {
+    return packed & 0xff;
+  }
+
+  static int filters_of(int packed)
+  {
+    return packed & (SHUFFLE | XOR_DELTA);
+  }
+
+  static void encode(const char *data, const char *reference, char *out, size_t elem_size,
+                     const std::vector<uint64_t> &elem_cuts, int filters, uint64_t nthreads);
+  static void decode(char *data, const char *reference, size_t elem_size,
+                     const std::vector<uint64_t> &elem_cuts, int filters, uint64_t nthreads);
+
+  static void shuffle(const char *in, char *out, uint64_t nelems, size_t elem_size);
+  static void unshuffle(const char *in, char *out, uint64_t nelems, size_t elem_size);
+  static void xor_bytes(char *data, const char *reference, size_t bytes);
+}; // class graphee::VectorFilter
+
+/*! Writes into `out` the filtered chunks [elem_cuts[c], elem_cuts[c + 1])
+ * of `data`, `reference` is only read with `XOR_DELTA`
+ */
+inline void VectorFilter::encode(const char *data, const char *reference, char *out, size_t elem_size,
+                                 const std::vector<uint64_t> &elem_cuts, int filters, uint64_t nthreads)
+{
+  const uint64_t nchunks = elem_cuts.size() - 1;
+
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+  for (uint64_t c = 0; c < nchunks; c++)
+  {
+    const uint64_t nelems = elem_cuts[c + 1] - elem_cuts[c];
+    const size_t offset = elem_cuts[c] * elem_size;
+    const size_t bytes = nelems * elem_size;
+
+    std::vector<char> delta;
+    const char *src = data + offset;
+
+    if (filters & XOR_DELTA)
+    {
+      delta.assign(src, src + bytes);
+      xor_bytes(delta.data(), reference + offset, bytes);
+      src = delta.data();
+    }
+
+    if (filters & SHUFFLE)
+    {
+      shuffle(src, out + offset, nelems, elem_size);
+    }
+    else
+    {
+      std::memcpy(out + offset, src, bytes);
+    }
+  }
+}
+
+/*! Reverts `encode()` in place */
+inline void VectorFilter::decode(char *data, const char *reference, size_t elem_size,
+                                 const std::vector<uint64_t> &elem_cuts, int filters, uint64_t nthreads)
+{
+  const uint64_t nchunks = elem_cuts.size() - 1;
+
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+  for (uint64_t c = 0; c < nchunks; c++)
+  {
+    const uint64_t nelems = elem_cuts[c + 1] - elem_cuts[c];
+    const size_t offset = elem_cuts[c] * elem_size;
+    const size_t bytes = nelems * elem_size;
+
+    if (filters & SHUFFLE)
+    {
+      std::vector<char> shuffled(data + offset, data + offset + bytes);
+      unshuffle(shuffled.data(), data + offset, nelems, elem_size);
+    }
+
+    if (filters & XOR_DELTA)
+    {
+      xor_bytes(data + offset, reference + offset, bytes);
+    }
+  }
+}
+
+/*! Byte `b` of the value `i` goes to `out[b * nelems + i]` */
+inline void VectorFilter::shuffle(const char *in, char *out, uint64_t nelems, size_t elem_size)
+{
+  for (uint64_t i = 0; i < nelems; i++)
+  {
+    for (size_t b = 0; b < elem_size; b++)
+    {
+      out[b * nelems + i] = in[i * elem_size + b];
+    }
+  }
+}
+
+inline void VectorFilter::unshuffle(const char *in, char *out, uint64_t nelems, size_t elem_size)
+{
+  for (size_t b = 0; b < elem_size; b++)
+  {
+    for (uint64_t i = 0; i < nelems; i++)
+    {
+      out[i * elem_size + b] = in[b * nelems + i];
+    }
+  }
+}
+
+inline void VectorFilter::xor_bytes(char *data, const char *reference, size_t bytes)
+{
+  size_t words = bytes / sizeof(uint64_t);
+
+  for (size_t w = 0; w < words; w++)
+  {
+    uint64_t lhs, rhs;
+    std::memcpy(&lhs, data + w * sizeof(uint64_t), sizeof(uint64_t));
+    std::memcpy(&rhs, reference + w * sizeof(uint64_t), sizeof(uint64_t));
+    lhs ^= rhs;
+    std::memcpy(data + w * sizeof(uint64_t), &lhs, sizeof(uint64_t));
+  }
+
+  for (size_t b = words * sizeof(uint64_t); b < bytes; b++)
+  {
+    data[b] ^= reference[b];
+  }
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_VECTOR_FILTER_HPP__
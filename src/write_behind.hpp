@@ -0,0 +1,152 @@
+#ifndef GRAPHEE_WRITE_BEHIND_HPP__
+#define GRAPHEE_WRITE_BEHIND_HPP__
+
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "utils.hpp"
+#include "thread_pool.hpp"
+
+namespace graphee
+{
+
+/*! \brief Writes handed to a pool of writer threads, which compress and
+ *         save them while the caller goes on
+ *
+ * A write is known by its key, the name of the file it writes: a second
+ * write of a key waits for the first one, and `wait(key)` is called
+ * before reading it back. The caller is held back as long as more than
+ * `max_dirty_bytes` are still to be written, and `barrier()` waits for
+ * all of them, e.g. at the end of an iteration.
+ *
+ * A durable queue syncs the written files to the disk, see `sync_file()`.
+ */
+
+class WriteBehind
+{
+public:
+  WriteBehind(size_t nworkers, uint64_t max_dirty_bytes, bool durable = false)
+    : max_dirty_bytes(max_dirty_bytes), durable(durable), dirty_bytes(0), nwrites(0), written_bytes(0),
+      throttle_ns(0), pool(nworkers)
+  {
+  }
+
+  WriteBehind(const WriteBehind &) = delete;
+  WriteBehind &operator=(const WriteBehind &) = delete;
+
+  /*! The writes still queued reference their owner, they are waited for */
+  ~WriteBehind()
+  {
+    barrier();
+  }
+
+  void push(const std::string &key, uint64_t bytes, std::function<void()> write);
+  void wait(const std::string &key);
+  void barrier();
+
+  bool is_durable() const
+  {
+    return durable;
+  }
+
+  static void sync_file(const std::string &path);
+
+  std::string report() const;
+
+private:
+  const uint64_t max_dirty_bytes;
+  const bool durable;
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  uint64_t dirty_bytes;
+  std::map<std::string, uint64_t> pending;
+
+  std::atomic<uint64_t> nwrites;
+  std::atomic<uint64_t> written_bytes;
+  std::atomic<uint64_t> throttle_ns;
+
+  /* Last, its workers are joined first */
+  ThreadPool pool;
+}; // class graphee::WriteBehind
+
+/*! A write larger than `max_dirty_bytes` is queued once nothing else is */
+inline void WriteBehind::push(const std::string &key, uint64_t bytes, std::function<void()> write)
+{
+  auto start = std::chrono::steady_clock::now();
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (pending.count(key) > 0 || (dirty_bytes > 0 && dirty_bytes + bytes > max_dirty_bytes))
+    {
+      cond.wait(lock);
+    }
+    dirty_bytes += bytes;
+    pending[key] = bytes;
+  }
+  throttle_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start).count();
+
+  pool.submit([this, key, bytes, write]()
+  {
+    write();
+    nwrites++;
+    written_bytes += bytes;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    dirty_bytes -= bytes;
+    pending.erase(key);
+    cond.notify_all();
+  });
+}
+
+inline void WriteBehind::wait(const std::string &key)
+{
+  std::unique_lock<std::mutex> lock(mtx);
+  while (pending.count(key) > 0)
+  {
+    cond.wait(lock);
+  }
+}
+
+inline void WriteBehind::barrier()
+{
+  std::unique_lock<std::mutex> lock(mtx);
+  while (!pending.empty())
+  {
+    cond.wait(lock);
+  }
+}
+
+inline void WriteBehind::sync_file(const std::string &path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0 || fsync(fd) != 0)
+  {
+    std::ostringstream oss;
+    oss << "Could not sync the file \'" << path << "\'";
+    print_error(oss.str());
+  }
+  if (fd >= 0)
+    close(fd);
+}
+
+inline std::string WriteBehind::report() const
+{
+  std::ostringstream oss;
+  oss << "Write-behind: " << nwrites << " writes of " << written_bytes / (1UL << 20) << " MB, throttled "
+      << throttle_ns * 1e-9 << " s";
+  return oss.str();
+}
+
+} // namespace graphee
+
+#endif // GRAPHEE_WRITE_BEHIND_HPP__
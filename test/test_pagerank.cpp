@@ -3,21 +3,36 @@
 #include "pagerank.hpp"
 #include "vector.hpp"
 #include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <zlib.h>
 
 // #define PRECISION double
 
-void clean_pagerank_files(const graphee::Properties& props){
+void clean_pagerank_files(const graphee::Properties& props, const std::string& dir = ""){
+    std::remove((dir+props.name+"_adj_dmatmanifest.gpe").c_str());
+    std::remove((dir+props.name+"_adj_dmatdirmanifest.gpe").c_str());
     for(int i = 0; i < props.nslices; i++){
         for(int j = 0; j < props.nslices; j++){
-            std::remove((props.name+"_adj_dmatblk_"+std::to_string(i)+"_"+std::to_string(j)+".gpe").c_str());
-            std::remove((props.name+"_adj_tmpblk_"+std::to_string(i)+"_"+std::to_string(j)+".gpe").c_str());
+            std::remove((dir+props.name+"_adj_dmatblk_"+std::to_string(i)+"_"+std::to_string(j)+".gpe").c_str());
+            std::remove((dir+props.name+"_adj_dmatdirblk_"+std::to_string(i)+"_"+std::to_string(j)+".gpe").c_str());
+            std::remove((dir+props.name+"_adj_tmpblk_"+std::to_string(i)+"_"+std::to_string(j)+".gpe").c_str());
         }
-        std::remove((props.name+"_ob_dvecslc_"+std::to_string(i)+".gpe").c_str());
-        std::remove((props.name+"_prp1_dvecslc_"+std::to_string(i)+".gpe").c_str());
-        std::remove((props.name+"_pr_dvecslc_"+std::to_string(i)+".gpe").c_str());
+        std::remove((dir+props.name+"_ob_dvecslc_"+std::to_string(i)+".gpe").c_str());
+        std::remove((dir+props.name+"_prp1_dvecslc_"+std::to_string(i)+".gpe").c_str());
+        std::remove((dir+props.name+"_pr_dvecslc_"+std::to_string(i)+".gpe").c_str());
+        std::remove((dir+props.name+"_iob_dvecslc_"+std::to_string(i)+".gpe").c_str());
+        std::remove((dir+props.name+"_contrib_dvecslc_"+std::to_string(i)+".gpe").c_str());
     }
+    std::remove((dir+props.name+"_ob_dvecmap.gpe").c_str());
+    std::remove((dir+props.name+"_iob_dvecmap.gpe").c_str());
+    std::remove((dir+props.name+"_contrib_dvecmap.gpe").c_str());
+    std::remove((dir+props.name+"_prp1_dvecmap.gpe").c_str());
+    std::remove((dir+props.name+"_pr_dvecmap.gpe").c_str());
 }
 
+template <typename RankT = double, typename DegreeT = double>
 void pagerank_routine(graphee::Properties& props, 
     std::vector<std::string>& filenames,
     int iters) {
@@ -27,7 +42,7 @@ void pagerank_routine(graphee::Properties& props,
   
   adjacency_matrix.load_edgelist(filenames);
   
-    graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+    graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>, RankT, DegreeT>
         pagerank(&props,            // graph properties
                  &adjacency_matrix, // give the adress to the adjacency matrix
                  0.85); // damping factor of the Pagerank (original value)
@@ -69,6 +84,38 @@ BOOST_AUTO_TEST_CASE( test_dense_web )
   std::cout<<"NVERTEX : "<<n<<std::endl;
 }
 
+BOOST_AUTO_TEST_CASE( test_dense_web_mixed_precision )
+/* Same as test_dense_web with float scores and uint32 degrees */
+{
+  graphee::Properties props(
+      std::string("test_pagerank_web_f32"),        // name of your graph
+      325729,                              // number of nodes
+      5,                         // number of slices
+      4,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      32 * graphee::Properties::MB); // max size of sorting vector
+  
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/web-NotreDame.txt.gz");
+  pagerank_routine<float, uint32_t>(props, filenames, 100);
+
+  double score_sum=0;
+  graphee::Vector<float> vec(&props);
+  for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+      vec.load("test_pagerank_web_f32_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+      for(float score : vec){
+          score_sum+=score;
+      }
+  }
+  BOOST_CHECK(abs(score_sum-1.)<0.001);
+  std::cout<<"SCORE SUM : "<<score_sum<<std::endl;
+
+  /* The contributions read by the product are stored as float too */
+  vec.load("test_pagerank_web_f32_contrib_dvecslc_0.gpe");
+  BOOST_CHECK(vec.size() == props.window);
+  clean_pagerank_files(props);
+}
+
 BOOST_AUTO_TEST_CASE( test_smallGraph )
 /* Compare with void free_test_function() */
 {
@@ -106,66 +153,1252 @@ BOOST_AUTO_TEST_CASE( test_smallGraph )
 }
 
 
-BOOST_AUTO_TEST_CASE( test_oneEdge )
-/* Compare with void free_test_function() */
+BOOST_AUTO_TEST_CASE( test_smallGraph_aligned_blocks )
+/* Same graph as test_smallGraph with blocks mapped in place */
 {
   graphee::Properties props(
-      std::string("test_oneEdge"),            // name of your graph
-      2,                              // number of nodes
+      std::string("test_smallGraph_aligned"),            // name of your graph
+      6,                              // number of nodes
       2,                         // number of slices
       1,                              // number of threads
       5 * graphee::Properties::GB,    // max RAM value
       128 * graphee::Properties::MB); // max size of sorting vector
-  
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(
+      &props, // graph properties
+      "adj");
+  adjacency_matrix.set_block_format(graphee::Utils::ALIGNED);
+
   std::vector<std::string> filenames;
-  filenames.push_back("test/ressources/oneEdge.txt.gz");
-  pagerank_routine(props, filenames, 3);
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  graphee::SparseBMatrixCSR block(std::move(*adjacency_matrix.get_block(0, 0)));
+  BOOST_CHECK(block.is_mapped());
+
+  /* A mapped block saved again in the other formats keeps its elements */
+  graphee::SparseBMatrixCSR mapped(std::move(*adjacency_matrix.get_block(0, 1)));
+  graphee::Vector<double> ones(&props, props.window, 1.);
+  graphee::Vector<double> expected_res = mapped * ones;
+  for (int format : {graphee::Utils::BIN, graphee::Utils::SNAPPY}) {
+    mapped.save("test_smallGraph_aligned_resaved.gpe", format);
+    graphee::SparseBMatrixCSR resaved(&props);
+    resaved.load("test_smallGraph_aligned_resaved.gpe");
+    BOOST_CHECK(resaved.get_nonzeros() == mapped.get_nonzeros());
+    graphee::Vector<double> res = resaved * ones;
+    for (uint64_t i = 0; i < props.window; i++) {
+      BOOST_CHECK(res[i] == expected_res[i]);
+    }
+  }
+  std::remove("test_smallGraph_aligned_resaved.gpe");
+
+  graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+      pagerank(&props, &adjacency_matrix, 0.85);
+  pagerank.compute_pagerank(10);
 
   long n=0;
-  double score_sum=0;
   graphee::Vector<double> vec(&props);
+  double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
   for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
-      vec.load("test_oneEdge_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+      vec.load("test_smallGraph_aligned_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
       for(double score : vec){
-          std::cout<<n<<"\t"<<score<<std::endl;
-          score_sum+=score;
+          BOOST_CHECK(abs(score-expected[n])<0.00001);
           n++;
       }
   }
-  std::cout<<"SCORE SUM : "<<score_sum<<std::endl;
-  BOOST_CHECK(abs(score_sum-1)<0.00001);
   clean_pagerank_files(props);
 }
 
 
-BOOST_AUTO_TEST_CASE( test_smallGraph_sum_columns )
-/* Compare with void free_test_function() */
+BOOST_AUTO_TEST_CASE( test_smallGraph_hybrid_blocks )
+/* Same graph as test_smallGraph with the layout chosen per block,
+ * then with Hilbert ordered blocks */
+{
+  int layouts[] = {graphee::BlockLayout::AUTO, graphee::BlockLayout::AUTO, graphee::BlockLayout::HILBERT};
+  int formats[] = {graphee::Utils::SNAPPY, graphee::Utils::SNAPPY_CHUNKS, graphee::Utils::SNAPPY_CHUNKS};
+  for(int k=0; k<3; k++){
+    graphee::Properties props(
+        std::string("test_smallGraph_hybrid"),             // name of your graph
+        6,                              // number of nodes
+        2,                         // number of slices
+        1,                              // number of threads
+        5 * graphee::Properties::GB,    // max RAM value
+        128 * graphee::Properties::MB); // max size of sorting vector
+
+    graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(
+        &props, // graph properties
+        "adj");
+    adjacency_matrix.set_block_format(formats[k]);
+    adjacency_matrix.set_block_layout(layouts[k]);
+
+    std::vector<std::string> filenames;
+    filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+    adjacency_matrix.load_edgelist(filenames);
+
+    uint64_t ncsr = 0;
+    for(uint64_t line=0; line<props.nslices; line++){
+        for(uint64_t col=0; col<props.nslices; col++){
+            if(adjacency_matrix.get_block(line, col)->get_layout() == graphee::BlockLayout::CSR)
+                ncsr++;
+        }
+    }
+    BOOST_CHECK(ncsr < props.nblocks);
+
+    graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+        pagerank(&props, &adjacency_matrix, 0.85);
+    pagerank.compute_pagerank(10);
+
+    long n=0;
+    graphee::Vector<double> vec(&props);
+    double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
+    for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+        vec.load("test_smallGraph_hybrid_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+        for(double score : vec){
+            BOOST_CHECK(abs(score-expected[n])<0.00001);
+            n++;
+        }
+    }
+    clean_pagerank_files(props);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_both_orientations )
+/* Same graph as test_smallGraph, the transposed blocks are built by
+ * the same ingestion */
 {
   graphee::Properties props(
-      std::string("test_sum_columns"),            // name of your graph
-      1000,                              // number of nodes
-      20,                         // number of slices
-      4,                              // number of threads
-      10 * graphee::Properties::GB,    // max RAM value
-      1 * graphee::Properties::MB); // max size of sorting vector
-  
+      std::string("test_smallGraph_orient"),             // name of your graph
+      6,                              // number of nodes
+      2,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
   graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(
       &props, // graph properties
       "adj");
-  
+
   std::vector<std::string> filenames;
-  filenames.push_back("test/ressources/test_sum_columns.txt.gz");
-  adjacency_matrix.load_edgelist(filenames);
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames, graphee::Utils::GZ, graphee::Utils::TRANS | graphee::Utils::DIRECT);
 
-    graphee::DiskVector<graphee::Vector<double>> out_bounds = std::move(graphee::DiskVector<graphee::Vector<double>>(&props, "ob", 0.));
-out_bounds.dmat_columns_sum(adjacency_matrix);
-double n = 0;
-for(int slice = 0 ; slice < props.nslices ; slice++){
-      graphee::Vector<double>& vec = out_bounds.get_slice(slice);
-      for(int i = 0;i<vec.get_lines();i++){
-        BOOST_CHECK_EQUAL(vec.at(i),n);
-        n+=1;
+  /* Lines of the direct blocks are the columns of the transposed ones */
+  for(uint64_t line=0; line<props.nslices; line++){
+      for(uint64_t col=0; col<props.nslices; col++){
+          graphee::SparseBMatrixCSR trans(std::move(*adjacency_matrix.get_block(line, col)));
+          graphee::SparseBMatrixCSR direct(std::move(*adjacency_matrix.get_block(col, line, graphee::Utils::DIRECT)));
+          BOOST_CHECK(trans.get_nonzeros() == direct.get_nonzeros());
+
+          graphee::Vector<double> ones(&props, props.window, 1.);
+          graphee::Vector<double> outdeg = direct * ones;
+          graphee::Vector<double> colsum = trans.columns_sum();
+          for(uint64_t i=0; i<props.window; i++){
+              BOOST_CHECK(outdeg[i] == colsum[i]);
+          }
+      }
+  }
+  BOOST_CHECK(adjacency_matrix.check_blocks());
+
+  graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+      pagerank(&props, &adjacency_matrix, 0.85);
+  pagerank.compute_pagerank(10);
+
+  long n=0;
+  graphee::Vector<double> vec(&props);
+  double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
+  for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+      vec.load("test_smallGraph_orient_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+      for(double score : vec){
+          BOOST_CHECK(abs(score-expected[n])<0.00001);
+          n++;
+      }
+  }
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_container )
+/* Same graph as test_smallGraph, blocks and slices in a single file */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_container"),            // name of your graph
+      6,                              // number of nodes
+      2,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  {
+    graphee::GraphContainer container("test_smallGraph_container.gpc");
+    props.container = &container;
+
+    graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(
+        &props, // graph properties
+        "adj");
+    adjacency_matrix.set_block_format(graphee::Utils::ALIGNED);
+
+    std::vector<std::string> filenames;
+    filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+    adjacency_matrix.load_edgelist(filenames);
+
+    graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+        pagerank(&props, &adjacency_matrix, 0.85);
+    pagerank.compute_pagerank(10);
+  }
+
+  /* Reopened from its last commit */
+  graphee::GraphContainer container("test_smallGraph_container.gpc");
+  BOOST_CHECK(container.contains("test_smallGraph_container_adj_dmatblk_1_1.gpe"));
+
+  long n=0;
+  graphee::Vector<double> vec(&props);
+  double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
+  for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+      vec.load(container, "test_smallGraph_container_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+      for(double score : vec){
+          BOOST_CHECK(abs(score-expected[n])<0.00001);
+          n++;
       }
+  }
+  props.container = nullptr;
+  clean_pagerank_files(props);
+  std::remove("test_smallGraph_container.gpc");
+}
+
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_storage_roots )
+/* Same graph as test_smallGraph, files spread among two directories */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_roots"),            // name of your graph
+      6,                              // number of nodes
+      2,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  std::vector<std::string> roots = {"test_storage_a/", "test_storage_b/"};
+  for (std::string root : roots) {
+    mkdir(root.c_str(), 0755);
+  }
+
+  for (int placement : {graphee::StorageRoots::ROUND_ROBIN, graphee::StorageRoots::BY_SIZE}) {
+    graphee::StorageRoots storage(roots, placement);
+    props.storage = &storage;
+
+    std::vector<std::string> filenames;
+    filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+    pagerank_routine(props, filenames, 10);
+
+    long n=0;
+    graphee::Vector<double> vec(&props);
+    double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
+    for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+        /* Slice i is on the root i */
+        vec.load(roots[slice_i]+"test_smallGraph_roots_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+        for(double score : vec){
+            BOOST_CHECK(abs(score-expected[n])<0.00001);
+            n++;
+        }
     }
-    clean_pagerank_files(props);
+    props.storage = nullptr;
+
+    for (std::string root : roots) {
+      clean_pagerank_files(props, root);
+    }
+  }
+
+  for (std::string root : roots) {
+    BOOST_CHECK(rmdir(root.c_str()) == 0);
+  }
+}
+
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_block_store )
+/* Snapshots sharing their blocks through a store */
+{
+  std::vector<std::string> names = {"test_store_a", "test_store_b", "test_store_c", "test_store_plain"};
+  std::vector<graphee::Properties *> props;
+  for (std::string name : names) {
+    props.push_back(new graphee::Properties(name, 6, 2, 1, 5 * graphee::Properties::GB, 128 * graphee::Properties::MB));
+  }
+
+  /* test_smallGraph with one more edge */
+  gzFile gzfp = gzopen("test_store_changed.txt.gz", "wb");
+  gzputs(gzfp, "0\t4\n1\t3\n2\t3\n3\t0\n3\t1\n4\t0\n4\t3\n4\t5\n1\t0\n");
+  gzclose(gzfp);
+
+  std::vector<std::string> original = {"test/ressources/test_smallGraph.txt.gz"};
+  std::vector<std::string> changed = {"test_store_changed.txt.gz"};
+
+  mkdir("test_store", 0755);
+  graphee::BlockStore store("test_store");
+  graphee::BlockStore delta_store("test_store", 1.0);
+
+  /* load_edgelist takes the list of files, each build gets a copy */
+  auto build = [](graphee::Properties *props, std::vector<std::string> filenames,
+                  graphee::BlockStore *store, std::string base) {
+    graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(props, "adj");
+    if (store != nullptr) {
+      adjacency_matrix.set_block_store(store, base);
+    }
+    adjacency_matrix.load_edgelist(filenames);
+  };
+  auto inode = [](std::string filename) {
+    struct stat st;
+    stat(filename.c_str(), &st);
+    return st.st_ino;
+  };
+  auto block_name = [](std::string name, int line, int col) {
+    return name + "_adj_dmatblk_" + std::to_string(line) + "_" + std::to_string(col) + ".gpe";
+  };
+
+  build(props[0], original, &store, "");
+  build(props[1], original, &store, "test_store_a");
+  build(props[2], changed, &delta_store, "test_store_a");
+  build(props[3], changed, nullptr, "");
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> matrix_c(props[2], "adj");
+  matrix_c.set_block_store(&store);
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> matrix_plain(props[3], "adj");
+
+  int ndeltas = 0;
+  for (int line = 0; line < 2; line++) {
+    for (int col = 0; col < 2; col++) {
+      /* Identical blocks are the same file */
+      BOOST_CHECK(inode(block_name("test_store_a", line, col)) == inode(block_name("test_store_b", line, col)));
+
+      ndeltas += graphee::BlockDelta::is_delta(block_name("test_store_c", line, col));
+      auto block_c = matrix_c.get_block(line, col);
+      auto block_plain = matrix_plain.get_block(line, col);
+      BOOST_CHECK(block_c->element_keys() == block_plain->element_keys());
+    }
+  }
+  BOOST_CHECK(ndeltas == 1);
+  BOOST_CHECK(store.reused_bytes > 0);
+
+  for (graphee::Properties *p : props) {
+    clean_pagerank_files(*p);
+    delete p;
+  }
+  std::remove("test_store_changed.txt.gz");
+
+  DIR *dir = opendir("test_store");
+  for (struct dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+    std::string object = entry->d_name;
+    if (object != "." && object != "..") {
+      std::remove(("test_store/" + object).c_str());
+    }
+  }
+  closedir(dir);
+  BOOST_CHECK(rmdir("test_store") == 0);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_bvgraph )
+/* Same graph as test_smallGraph, compressed by WebGraph, the lists are
+ * decoded by 3 threads */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_bv"),             // name of your graph
+      6,                              // number of nodes
+      2,                         // number of slices
+      3,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::BVGraph graph("test/ressources/test_smallGraph");
+  BOOST_CHECK(graph.get_nodes() == 6);
+  BOOST_CHECK(graph.split(3).size() > 2);
+
+  std::vector<uint64_t> successors[] = {{4}, {3}, {3}, {0, 1}, {0, 3, 5}, {}};
+  graphee::BVGraphReader reader(graph, 0, graph.get_nodes());
+  while(reader.next()){
+      BOOST_CHECK(reader.successors() == successors[reader.node()]);
+  }
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+
+  std::vector<std::string> basenames;
+  basenames.push_back("test/ressources/test_smallGraph");
+  adjacency_matrix.load_edgelist(basenames, graphee::Utils::BVGRAPH);
+
+  graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+      pagerank(&props, &adjacency_matrix, 0.85);
+  pagerank.compute_pagerank(10);
+
+  long n=0;
+  graphee::Vector<double> vec(&props);
+  double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
+  for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+      vec.load("test_smallGraph_bv_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+      for(double score : vec){
+          BOOST_CHECK(abs(score-expected[n])<0.00001);
+          n++;
+      }
+  }
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_manifest )
+/* Same graph as test_smallGraph in 3 slices, the blocks [0;0] and [2;1]
+ * are empty and skipped by the products */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_manifest"),       // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  {
+    graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+    std::vector<std::string> filenames;
+    filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+    adjacency_matrix.load_edgelist(filenames);
+  }
+
+  /* Read back from the manifest file */
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  const graphee::BlockManifest &manifest = adjacency_matrix.get_manifest();
+  BOOST_CHECK(manifest.is_loaded());
+  BOOST_CHECK(manifest.is_empty(0, 0) && manifest.is_empty(2, 1));
+  BOOST_CHECK(!manifest.is_empty(0, 1));
+
+  /* Edges 3 -> 0 and 3 -> 1 */
+  const graphee::BlockStats &stats = manifest.get(0, 1);
+  BOOST_CHECK(stats.nnz == 2 && stats.nrows == 2 && stats.ncols == 1);
+  BOOST_CHECK(stats.min_line == 0 && stats.max_line == 1 && stats.min_col == 1 && stats.max_col == 1);
+  BOOST_CHECK(stats.bytes > 0);
+  BOOST_CHECK(manifest.lines_by_size().size() == props.nslices);
+
+  graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+      pagerank(&props, &adjacency_matrix, 0.85);
+  pagerank.compute_pagerank(10);
+
+  long n=0;
+  graphee::Vector<double> vec(&props);
+  double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
+  for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+      vec.load("test_smallGraph_manifest_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+      for(double score : vec){
+          BOOST_CHECK(abs(score-expected[n])<0.00001);
+          n++;
+      }
+  }
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_failed_block )
+/* A block larger than the `ram_limit` is not built, the matrix is left
+ * without manifest instead of skipping it */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_failed"),       // name of your graph
+      6,                              // number of nodes
+      1,                         // number of slices
+      1,                              // number of threads
+      64,    // max RAM value
+      16); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  BOOST_CHECK(!adjacency_matrix.get_manifest().is_loaded());
+  struct stat st;
+  BOOST_CHECK(stat("test_smallGraph_failed_adj_dmatmanifest.gpe", &st) != 0);
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_mapped_vectors )
+/* Same as test_smallGraph with the vectors mapped in a single file each */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_mapped"),      // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  {
+    graphee::Pagerank<graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR>>
+        pagerank(&props, &adjacency_matrix, 0.85);
+    pagerank.set_vector_format(graphee::Utils::MAPPED);
+    pagerank.compute_pagerank(10);
+  }
+
+  /* No slice file, the values follow the header page */
+  std::ifstream slice_file("test_smallGraph_mapped_pr_dvecslc_0.gpe");
+  BOOST_CHECK(!slice_file.is_open());
+
+  graphee::MappedFile prfile("test_smallGraph_mapped_pr_dvecmap.gpe");
+  BOOST_CHECK(prfile.size() == graphee::MappedFile::alignment + props.nvertices * sizeof(double));
+  double expected[] = {0.21495,0.15189,0.03953,0.26713,0.22387,0.10260};
+  for(uint64_t n=0; n<props.nvertices; n++){
+      double score = prfile.get<double>(graphee::MappedFile::alignment + n * sizeof(double));
+      BOOST_CHECK(abs(score-expected[n])<0.00001);
+  }
+
+  /* Views write in place, swap exchanges the files */
+  graphee::DiskVector<graphee::Vector<double>> lvec(&props, "lvec", 1., graphee::Utils::MAPPED);
+  graphee::DiskVector<graphee::Vector<double>> rvec(&props, "rvec", 2., graphee::Utils::MAPPED);
+  graphee::Vector<double> buffer(&props);
+  graphee::VectorView<double> view = lvec.view_slice(1, buffer);
+  BOOST_CHECK(buffer.empty() && view.size() == props.window);
+  view[0] = 5.;
+  lvec.commit();
+  lvec.swap(rvec);
+  BOOST_CHECK((*lvec.get_slice(1))[0] == 2. && (*rvec.get_slice(1))[0] == 5.);
+  BOOST_CHECK((*rvec.get_slice(0))[1] == 1.);
+
+  std::remove("test_smallGraph_mapped_lvec_dvecmap.gpe");
+  std::remove("test_smallGraph_mapped_rvec_dvecmap.gpe");
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_constant_vector_swap )
+/* Constant slices are written on their first save, swap and settle */
+{
+  graphee::Properties props(
+      std::string("test_constant"),            // name of your graph
+      6,                              // number of nodes
+      2,                         // number of slices
+      1,                              // number of threads
+      1 * graphee::Properties::GB,    // max RAM value
+      1 * graphee::Properties::MB); // max size of sorting vector
+
+  auto slice_file = [&props](std::string vecname, uint64_t slice_id) {
+    return "test_constant_" + vecname + "_dvecslc_" + std::to_string(slice_id) + ".gpe";
+  };
+
+  graphee::DiskVector<graphee::Vector<double>> lvec(&props, "lvec", 1.);
+  graphee::DiskVector<graphee::Vector<double>> rvec(&props, "rvec", 2.);
+  BOOST_CHECK(!std::ifstream(slice_file("lvec", 0)).is_open());
+
+  lvec += 0.5;
+  BOOST_CHECK(std::ifstream(slice_file("lvec", 1)).is_open());
+
+  /* rvec takes the files of lvec, lvec becomes the constant 2 */
+  lvec.swap(rvec);
+  auto lslice = lvec.get_slice(1);
+  auto rslice = rvec.get_slice(1);
+  BOOST_CHECK(*lslice == graphee::Vector<double>(&props, props.window, 2.));
+  BOOST_CHECK(*rslice == graphee::Vector<double>(&props, props.window, 1.5));
+
+  rvec.fill(3.);
+  rvec.settle(lvec);
+  graphee::Vector<double> rfile(&props);
+  rfile.load(slice_file("rvec", 0));
+  BOOST_CHECK(rfile == graphee::Vector<double>(&props, props.window, 3.));
+  rfile.load(slice_file("lvec", 0));
+  BOOST_CHECK(rfile == graphee::Vector<double>(&props, props.window, 2.));
+
+  for (std::string vecname : {"lvec", "rvec"}) {
+    for (uint64_t slice_id = 0; slice_id < props.nslices; slice_id++) {
+      std::remove(slice_file(vecname, slice_id).c_str());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_spmv_kernels )
+/* Every kernel level and index width gives the scalar product */
+{
+  graphee::Properties props(
+      std::string("test_spmv"),            // name of your graph
+      1000,                              // number of nodes
+      1,                         // number of slices
+      2,                              // number of threads
+      1 * graphee::Properties::GB,    // max RAM value
+      1 * graphee::Properties::MB); // max size of sorting vector
+
+  /* Lines of 0 to 20 elements, to cover the gathers and their tails */
+  std::vector<uint64_t> keys;
+  for (uint64_t i = 0; i < props.nvertices; i++) {
+    for (uint64_t k = 0; k < i % 21; k++) {
+      keys.push_back(i * props.nvertices + (i * 7 + k * 131) % props.nvertices);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  graphee::SparseBMatrixCSR block(&props, props.nvertices, props.nvertices, 0);
+  block.assign_keys(keys);
+
+  graphee::Vector<double> vec(&props, props.window);
+  for (uint64_t i = 0; i < props.window; i++) {
+    vec[i] = 1. / (i + 1);
+  }
+
+  graphee::Vector<double> expected(&props, props.window, 0.);
+  for (uint64_t key : keys) {
+    expected[key / props.nvertices] += vec[key % props.nvertices];
+  }
+
+  const int supported = graphee::SpmvKernel::supported_level();
+  for (int compact = 0; compact < 2; compact++) {
+    if (compact) {
+      BOOST_CHECK(block.compact_indices());
+    }
+    for (int level = 0; level <= supported; level++) {
+      graphee::SpmvKernel::set_level(level);
+      BOOST_CHECK(graphee::SpmvKernel::level() == level);
+      graphee::Vector<double> res = block * vec;
+      for (uint64_t i = 0; i < props.window; i++) {
+        BOOST_CHECK(std::abs(res[i] - expected[i]) < 1e-12);
+      }
+    }
+  }
+  graphee::SpmvKernel::set_level(supported);
+}
+
+BOOST_AUTO_TEST_CASE( test_merge_path_hub )
+/* A hub line shared by the threads of the CSR product */
+{
+  graphee::Properties props(
+      std::string("test_hub"),            // name of your graph
+      1000,                              // number of nodes
+      1,                         // number of slices
+      4,                              // number of threads
+      1 * graphee::Properties::GB,    // max RAM value
+      1 * graphee::Properties::MB); // max size of sorting vector
+
+  /* Line 500 holds 900 elements, the other even lines one */
+  std::vector<uint64_t> keys;
+  for (uint64_t i = 0; i < props.nvertices; i += 2) {
+    if (i == 500) {
+      for (uint64_t j = 0; j < 900; j++) {
+        keys.push_back(i * props.nvertices + j);
+      }
+    } else {
+      keys.push_back(i * props.nvertices + (i * 13) % props.nvertices);
+    }
+  }
+
+  graphee::SparseBMatrixCSR block(&props, props.nvertices, props.nvertices, 0);
+  block.assign_keys(keys);
+
+  std::vector<uint64_t> ia(props.nvertices + 1, 0);
+  for (uint64_t key : keys) {
+    ia[key / props.nvertices + 1]++;
+  }
+  for (uint64_t i = 0; i < props.nvertices; i++) {
+    ia[i + 1] += ia[i];
+  }
+
+  std::vector<graphee::MergePath::Coord> parts = graphee::MergePath::split(ia.data(), props.nvertices, props.nthreads);
+  BOOST_CHECK(parts.size() == props.nthreads + 1);
+  BOOST_CHECK(parts.back().row == props.nvertices && parts.back().nz == keys.size());
+  for (uint64_t p = 0; p < props.nthreads; p++) {
+    uint64_t work = parts[p + 1].row - parts[p].row + parts[p + 1].nz - parts[p].nz;
+    BOOST_CHECK(work * props.nthreads <= props.nvertices + keys.size() + props.nthreads);
+  }
+
+  graphee::Vector<double> vec(&props, props.window);
+  for (uint64_t i = 0; i < props.window; i++) {
+    vec[i] = 1. / (i + 1);
+  }
+
+  graphee::Vector<double> expected(&props, props.window, 0.);
+  for (uint64_t key : keys) {
+    expected[key / props.nvertices] += vec[key % props.nvertices];
+  }
+
+  /* The second product reuses the split of the first one */
+  for (int run = 0; run < 3; run++) {
+    if (run == 2) {
+      block.compact_indices();
+    }
+    graphee::Vector<double> res = block * vec;
+    for (uint64_t i = 0; i < props.window; i++) {
+      BOOST_CHECK(std::abs(res[i] - expected[i]) < 1e-12);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_repeated_bitmap )
+/* A dense block is a bitmap unless it holds a repeated element */
+{
+  graphee::Properties props(
+      std::string("test_bitmap"),            // name of your graph
+      64,                              // number of nodes
+      1,                         // number of slices
+      2,                              // number of threads
+      1 * graphee::Properties::GB,    // max RAM value
+      1 * graphee::Properties::MB); // max size of sorting vector
+
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < props.nvertices * props.nvertices; key++) {
+    keys.push_back(key);
+  }
+  graphee::Vector<double> vec(&props, props.window, 1.);
+
+  graphee::SparseBMatrixCSR dense(&props, props.nvertices, props.nvertices, 0);
+  dense.assign_keys(keys);
+  dense.convert(graphee::BlockLayout::AUTO);
+  BOOST_CHECK(dense.get_layout() == graphee::BlockLayout::BITMAP);
+
+  /* Line 3 holds the element (3, 5) twice */
+  keys.insert(keys.begin() + 3 * props.nvertices + 5, 3 * props.nvertices + 5);
+  for (int layout : {graphee::BlockLayout::AUTO, graphee::BlockLayout::BITMAP}) {
+    graphee::SparseBMatrixCSR repeated(&props, props.nvertices, props.nvertices, 0);
+    repeated.assign_keys(keys);
+    repeated.convert(layout);
+    BOOST_CHECK(repeated.get_layout() != graphee::BlockLayout::BITMAP);
+    BOOST_CHECK(repeated.get_nonzeros() == keys.size());
+
+    graphee::Vector<double> res = repeated * vec;
+    for (uint64_t i = 0; i < props.window; i++) {
+      BOOST_CHECK(res[i] == (i == 3 ? 65. : 64.));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_chunked_vector )
+/* A vector spanning several codec chunks */
+{
+  graphee::Properties props(
+      std::string("test_chunked"),            // name of your graph
+      3000000,                              // number of nodes
+      2,                         // number of slices
+      4,                              // number of threads
+      1 * graphee::Properties::GB,    // max RAM value
+      1 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::Vector<double> vec(&props, props.window);
+  for(uint64_t i=0; i<vec.size(); i++){
+      vec[i] = i%7 == 0 ? 0. : 1./(i+1);
+  }
+  vec.save("test_chunked_vec.gpe", graphee::Utils::SNAPPY_CHUNKS);
+
+  graphee::Vector<double> res(&props);
+  res.load("test_chunked_vec.gpe");
+  BOOST_CHECK(res == vec);
+  std::remove("test_chunked_vec.gpe");
+}
+
+
+BOOST_AUTO_TEST_CASE( test_filtered_vector )
+/* Shuffled and delta encoded vectors */
+{
+  graphee::Properties props(
+      std::string("test_filtered"),            // name of your graph
+      3000000,                              // number of nodes
+      2,                         // number of slices
+      4,                              // number of threads
+      1 * graphee::Properties::GB,    // max RAM value
+      1 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::Vector<double> prev(&props, props.window);
+  graphee::Vector<double> vec(&props, props.window);
+  for(uint64_t i=0; i<vec.size(); i++){
+      prev[i] = 1./(i+1);
+      vec[i] = i%3 == 0 ? prev[i] : prev[i]*0.85;
+  }
+
+  for (int fileformat : {graphee::Utils::SNAPPY, graphee::Utils::SNAPPY_CHUNKS}) {
+    vec.save("test_filtered_vec.gpe", fileformat | graphee::VectorFilter::SHUFFLE);
+    graphee::Vector<double> res(&props);
+    res.load("test_filtered_vec.gpe");
+    BOOST_CHECK(res == vec);
+
+    vec.save("test_filtered_vec.gpe",
+             fileformat | graphee::VectorFilter::SHUFFLE | graphee::VectorFilter::XOR_DELTA, &prev);
+    graphee::Vector<double> delta(&props);
+    delta.load("test_filtered_vec.gpe", &prev);
+    BOOST_CHECK(delta == vec);
+  }
+  std::remove("test_filtered_vec.gpe");
+
+  /* Slices of a DiskVector stored against another one */
+  graphee::DiskVector<graphee::Vector<double>> dprev(&props, "prev", 1., graphee::Utils::SNAPPY_CHUNKS);
+  graphee::DiskVector<graphee::Vector<double>> dvec(&props, "vec", 0., graphee::Utils::SNAPPY_CHUNKS);
+  dvec.set_slice_reference(&dprev);
+  dvec.set_slice_format(graphee::Utils::SNAPPY_CHUNKS | graphee::VectorFilter::SHUFFLE
+                        | graphee::VectorFilter::XOR_DELTA);
+  dvec += 0.5;
+
+  for (uint64_t slice_id = 0; slice_id < props.nslices; slice_id++) {
+    auto slice = dvec.get_slice(slice_id);
+    BOOST_CHECK(*slice == graphee::Vector<double>(&props, props.window, 0.5));
+  }
+
+  for (std::string vecname : {"prev", "vec"}) {
+    for (uint64_t slice_id = 0; slice_id < props.nslices; slice_id++) {
+      std::remove(("test_filtered_" + vecname + "_dvecslc_" + std::to_string(slice_id) + ".gpe").c_str());
+    }
+  }
+}
+
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_partial_rows )
+/* Rows of a chunked block loaded alone */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_rows"),            // name of your graph
+      6,                              // number of nodes
+      2,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(
+      &props, // graph properties
+      "adj");
+  adjacency_matrix.set_block_format(graphee::Utils::SNAPPY_CHUNKS);
+
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  BOOST_CHECK(adjacency_matrix.check_blocks());
+
+  graphee::SparseBMatrixCSR block(std::move(*adjacency_matrix.get_block(1, 0)));
+  graphee::SparseBMatrixCSR rows(std::move(*adjacency_matrix.get_block_rows(1, 0, 1, 3)));
+  BOOST_CHECK(rows.get_lines() == 2);
+
+  graphee::Vector<double> ones(&props, props.window, 1.);
+  graphee::Vector<double> full_res = block * ones;
+  graphee::Vector<double> rows_res = rows * ones;
+  BOOST_CHECK(rows_res[0] == full_res[1]);
+  BOOST_CHECK(rows_res[1] == full_res[2]);
+
+  clean_pagerank_files(props);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_oneEdge )
+/* Compare with void free_test_function() */
+{
+  graphee::Properties props(
+      std::string("test_oneEdge"),            // name of your graph
+      2,                              // number of nodes
+      2,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+  
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/oneEdge.txt.gz");
+  pagerank_routine(props, filenames, 3);
+
+  long n=0;
+  double score_sum=0;
+  graphee::Vector<double> vec(&props);
+  for(uint64_t slice_i=0; slice_i<props.nslices; slice_i++){
+      vec.load("test_oneEdge_pr_dvecslc_"+std::to_string(slice_i)+".gpe");
+      for(double score : vec){
+          std::cout<<n<<"\t"<<score<<std::endl;
+          score_sum+=score;
+          n++;
+      }
+  }
+  std::cout<<"SCORE SUM : "<<score_sum<<std::endl;
+  BOOST_CHECK(abs(score_sum-1)<0.00001);
+  clean_pagerank_files(props);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_sum_columns )
+/* Compare with void free_test_function() */
+{
+  graphee::Properties props(
+      std::string("test_sum_columns"),            // name of your graph
+      1000,                              // number of nodes
+      20,                         // number of slices
+      4,                              // number of threads
+      10 * graphee::Properties::GB,    // max RAM value
+      1 * graphee::Properties::MB); // max size of sorting vector
+  
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(
+      &props, // graph properties
+      "adj");
+  
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_sum_columns.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+    graphee::DiskVector<graphee::Vector<double>> out_bounds = std::move(graphee::DiskVector<graphee::Vector<double>>(&props, "ob", 0.));
+out_bounds.dmat_columns_sum(adjacency_matrix);
+double n = 0;
+for(uint64_t slice = 0 ; slice < props.nslices ; slice++){
+      auto vec = out_bounds.get_slice(slice);
+      for(uint64_t i = 0;i<vec->get_lines();i++){
+        BOOST_CHECK_EQUAL(vec->at(i),n);
+        n+=1;
+      }
+    }
+    clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_contributions )
+/* Product by a / out_bounds, divided once or through the reciprocal */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_contrib"),     // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      2,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  graphee::DiskVector<graphee::Vector<double>> out_bounds(&props, "ob", 0.);
+  out_bounds.dmat_columns_sum(adjacency_matrix);
+  graphee::DiskVector<graphee::Vector<double>> ones(&props, "pr", 1.);
+
+  graphee::DiskVector<graphee::Vector<double>> divided(&props, "prp1", 0.);
+  divided.dmat_prod_dvec_over_dvec(0.85, adjacency_matrix, ones, out_bounds);
+
+  graphee::DiskVector<graphee::Vector<double>> inv_out_bounds(&props, "iob", 0.);
+  inv_out_bounds.reciprocal_of(out_bounds);
+  graphee::DiskVector<graphee::Vector<double>> contrib(&props, "contrib", 0.);
+  contrib.dvec_prod_dvec(0.85, ones, inv_out_bounds);
+  graphee::DiskVector<graphee::Vector<double>> multiplied(&props, "ob2", 0.);
+  multiplied.dmat_prod_contributions(adjacency_matrix, contrib);
+
+  /* Node 0 has the in-links 3 -> 0 and 4 -> 0, of out degrees 2 and 3 */
+  double expected0 = 0.85 * (1. / 2 + 1. / 3);
+  for (uint64_t slice = 0; slice < props.nslices; slice++) {
+    graphee::Vector<double> lslice(&props), rslice(&props);
+    divided.read_slice(slice, lslice);
+    multiplied.read_slice(slice, rslice);
+    for (uint64_t i = 0; i < props.window; i++) {
+      BOOST_CHECK(std::abs(lslice[i] - rslice[i]) < 1e-12);
+    }
+    if (slice == 0) {
+      BOOST_CHECK(std::abs(lslice[0] - expected0) < 1e-12);
+    }
+  }
+
+  /* The contributions of a product are removed with its result */
+  {
+    graphee::DiskVector<graphee::Vector<double>> scoped(&props, "prp2", 0.);
+    scoped.dmat_prod_dvec_over_dvec(0.85, adjacency_matrix, ones, out_bounds);
+    scoped.dmat_prod_dvec_over_dvec(0.85, adjacency_matrix, ones, out_bounds);
+  }
+  struct stat st;
+  for (uint64_t slice = 0; slice < props.nslices; slice++) {
+    BOOST_CHECK(stat(("test_smallGraph_contrib_prp2_contrib_dvecslc_" + std::to_string(slice) + ".gpe").c_str(), &st) != 0);
+    std::remove(("test_smallGraph_contrib_prp2_dvecslc_" + std::to_string(slice) + ".gpe").c_str());
+    std::remove(("test_smallGraph_contrib_ob2_dvecslc_" + std::to_string(slice) + ".gpe").c_str());
+  }
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_prefetch )
+/* The blocks read ahead give the product of the blocks read in order */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_prefetch"),    // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      2,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  graphee::DiskVector<graphee::Vector<double>> ones(&props, "pr", 1.);
+  graphee::DiskVector<graphee::Vector<double>> in_order(&props, "ob", 0.);
+  in_order.set_prefetch_depth(0);
+  in_order.dmat_prod_dvec(1., adjacency_matrix, ones);
+
+  graphee::DiskVector<graphee::Vector<double>> ahead(&props, "prp1", 0.);
+  ahead.set_prefetch_depth(2);
+  ahead.dmat_prod_dvec(1., adjacency_matrix, ones);
+  BOOST_CHECK(ahead.get_prefetch_stats().nloads > 0);
+
+  /* In degrees */
+  double expected[] = {2, 1, 0, 3, 1, 1};
+  for (uint64_t slice = 0; slice < props.nslices; slice++) {
+    graphee::Vector<double> lslice(&props), rslice(&props);
+    in_order.read_slice(slice, lslice);
+    ahead.read_slice(slice, rslice);
+    for (uint64_t i = 0; i < props.window; i++) {
+      BOOST_CHECK_EQUAL(lslice[i], rslice[i]);
+      BOOST_CHECK_EQUAL(rslice[i], expected[slice * props.window + i]);
+    }
+  }
+
+  /* No room for a block ahead */
+  graphee::Properties small_props(props.name, 6, 3, 2, 64, 128 * graphee::Properties::MB);
+  graphee::DiskVector<graphee::Vector<double>> out_bounds(&small_props, "iob", 0.);
+  out_bounds.set_prefetch_depth(2);
+  out_bounds.dmat_columns_sum(adjacency_matrix);
+  graphee::Vector<double> first(&small_props);
+  out_bounds.read_slice(0, first);
+  BOOST_CHECK_EQUAL(first[0], 1);
+  BOOST_CHECK_EQUAL(first[1], 1);
+
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_write_behind )
+/* Slices written behind the products are read back as written */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_wbehind"),     // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      2,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  graphee::DiskVector<graphee::Vector<double>> ones(&props, "pr", 1.);
+  graphee::DiskVector<graphee::Vector<double>> in_degrees(&props, "ob", 0.);
+  in_degrees.set_write_behind(1, true); // a single slice at a time
+  in_degrees.dmat_prod_dvec(1., adjacency_matrix, ones);
+
+  /* Read back behind the last writes, then rewritten and swapped */
+  BOOST_CHECK_EQUAL(in_degrees.countZeros(), 1);
+  in_degrees += 1.;
+  in_degrees.barrier();
+
+  graphee::DiskVector<graphee::Vector<double>> swapped(&props, "prp1", 0.);
+  swapped.set_write_behind(props.window * sizeof(double));
+  swapped.dmat_prod_dvec(2., adjacency_matrix, ones);
+  swapped.swap(in_degrees);
+  swapped.settle(in_degrees);
+
+  double expected[] = {2, 1, 0, 3, 1, 1};
+  for (uint64_t slice = 0; slice < props.nslices; slice++) {
+    graphee::Vector<double> lslice(&props), rslice(&props);
+    in_degrees.read_slice(slice, lslice);
+    swapped.read_slice(slice, rslice);
+    for (uint64_t i = 0; i < props.window; i++) {
+      BOOST_CHECK_EQUAL(lslice[i], 2 * expected[slice * props.window + i]);
+      BOOST_CHECK_EQUAL(rslice[i], expected[slice * props.window + i] + 1);
+    }
+  }
+
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_object_pools )
+/* Blocks and slices are recycled once the products run in steady state */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_pools"),      // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      1,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+  adjacency_matrix.set_block_cache(0);
+
+  graphee::DiskVector<graphee::Vector<double>> ones(&props, "pr", 1.);
+  graphee::DiskVector<graphee::Vector<double>> res(&props, "ob", 0.);
+  res.dmat_prod_dvec(1., adjacency_matrix, ones);
+
+  uint64_t nblocks = adjacency_matrix.get_block_pool().allocations();
+  uint64_t nslices = res.pool_allocations() + ones.pool_allocations();
+  for (int iter = 0; iter < 3; iter++) {
+    res.fill(0.);
+    res.dmat_prod_dvec(1., adjacency_matrix, ones);
+  }
+  BOOST_CHECK_EQUAL(adjacency_matrix.get_block_pool().allocations(), nblocks);
+  BOOST_CHECK_EQUAL(res.pool_allocations() + ones.pool_allocations(), nslices);
+
+  /* A handle gives its slice back to the pool */
+  {
+    graphee::Vector<double> expected(&props);
+    res.read_slice(0, expected);
+    auto slice = res.get_slice(0);
+    BOOST_CHECK(*slice == expected);
+  }
+  auto again = res.get_slice(1);
+  BOOST_CHECK_EQUAL(res.pool_allocations() + ones.pool_allocations(), nslices);
+
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_block_schedule )
+/* Products line by line and column by column read the planned bytes */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_schedule"),    // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      2,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+  adjacency_matrix.set_block_cache(0);
+
+  graphee::DiskVector<graphee::Vector<double>> out_bounds(&props, "ob", 0.);
+  out_bounds.dmat_columns_sum(adjacency_matrix);
+  graphee::DiskVector<graphee::Vector<double>> contrib(&props, "contrib", 0.);
+  contrib.reciprocal_of(out_bounds);
+
+  graphee::DiskVector<graphee::Vector<double>> by_lines(&props, "pr", 0.);
+  by_lines.set_block_order(graphee::BlockSchedule::LINES);
+  by_lines.dmat_prod_contributions(adjacency_matrix, contrib);
+  const graphee::BlockSchedule &lines = by_lines.get_block_schedule();
+  BOOST_CHECK_EQUAL(lines.slice_loads, 7);
+  BOOST_CHECK_EQUAL(lines.read_bytes(), lines.planned_bytes());
+
+  /* All the accumulators fit, then a single one */
+  for (uint64_t budget : {0UL, props.window * 2 * sizeof(double)}) {
+    graphee::DiskVector<graphee::Vector<double>> by_columns(&props, "prp1", 0.);
+    by_columns.set_schedule_budget(budget);
+    by_columns.dmat_prod_contributions(adjacency_matrix, contrib);
+    const graphee::BlockSchedule &columns = by_columns.get_block_schedule();
+    BOOST_CHECK_EQUAL(columns.read_bytes(), columns.planned_bytes());
+    if (budget == 0) {
+      BOOST_CHECK(columns.order == graphee::BlockSchedule::COLUMNS);
+      BOOST_CHECK_EQUAL(columns.slice_loads, 3);
+      BOOST_CHECK(columns.planned_slice_bytes < lines.planned_slice_bytes);
+    } else {
+      BOOST_CHECK_EQUAL(columns.groups.size(), props.nslices);
+    }
+
+    for (uint64_t slice = 0; slice < props.nslices; slice++) {
+      graphee::Vector<double> lslice(&props), rslice(&props);
+      by_lines.read_slice(slice, lslice);
+      by_columns.read_slice(slice, rslice);
+      for (uint64_t i = 0; i < props.window; i++) {
+        BOOST_CHECK(std::abs(lslice[i] - rslice[i]) < 1e-12);
+      }
+    }
+  }
+
+  clean_pagerank_files(props);
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_block_parts )
+/* Blocks cut in parts, and products with more threads than slices */
+{
+  int layouts[] = {graphee::BlockLayout::CSR, graphee::BlockLayout::AUTO, graphee::BlockLayout::HILBERT};
+  for (int layout : layouts) {
+    graphee::Properties props(
+        std::string("test_smallGraph_parts"),       // name of your graph
+        6,                              // number of nodes
+        2,                         // number of slices
+        4,                              // number of threads
+        5 * graphee::Properties::GB,    // max RAM value
+        128 * graphee::Properties::MB); // max size of sorting vector
+
+    graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+    adjacency_matrix.set_block_layout(layout);
+    std::vector<std::string> filenames;
+    filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+    adjacency_matrix.load_edgelist(filenames);
+
+    graphee::Vector<double> ones(&props, props.window, 1.);
+    for (uint64_t line = 0; line < props.nslices; line++) {
+      for (uint64_t col = 0; col < props.nslices; col++) {
+        auto block = adjacency_matrix.get_block(line, col);
+        graphee::Vector<double> full = *block * ones;
+        block->prepare_parts();
+        for (uint64_t nparts : {1, 3, 4}) {
+          graphee::Vector<double> parts(&props, props.window, 0.);
+          for (uint64_t part = 0; part < nparts; part++) {
+            block->multiply_add(ones, parts, part, nparts);
+          }
+          BOOST_CHECK(parts == full);
+        }
+      }
+    }
+
+    /* In-degrees, line by line then with all the lines held */
+    double in_degrees[] = {2, 1, 0, 3, 1, 1};
+    for (graphee::BlockSchedule::Order order : {graphee::BlockSchedule::LINES, graphee::BlockSchedule::COLUMNS}) {
+      graphee::DiskVector<graphee::Vector<double>> dones(&props, "pr", 1.);
+      graphee::DiskVector<graphee::Vector<double>> res(&props, "prp1", 0.);
+      res.set_block_order(order);
+      res.dmat_prod_dvec(1., adjacency_matrix, dones);
+      for (uint64_t slice = 0; slice < props.nslices; slice++) {
+        graphee::Vector<double> values(&props);
+        res.read_slice(slice, values);
+        for (uint64_t i = 0; i < props.window; i++) {
+          BOOST_CHECK_EQUAL(values[i], in_degrees[slice * props.window + i]);
+        }
+      }
+    }
+
+    clean_pagerank_files(props);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_smallGraph_block_cache )
+/* Products through the decoded and the compressed tiers of the cache */
+{
+  graphee::Properties props(
+      std::string("test_smallGraph_bcache"),      // name of your graph
+      6,                              // number of nodes
+      3,                         // number of slices
+      2,                              // number of threads
+      5 * graphee::Properties::GB,    // max RAM value
+      128 * graphee::Properties::MB); // max size of sorting vector
+
+  graphee::DiskSparseMatrix<graphee::SparseBMatrixCSR> adjacency_matrix(&props, "adj");
+  std::vector<std::string> filenames;
+  filenames.push_back("test/ressources/test_smallGraph.txt.gz");
+  adjacency_matrix.load_edgelist(filenames);
+
+  uint64_t image_bytes = 0;
+  const graphee::BlockManifest &manifest = adjacency_matrix.get_manifest();
+  for (uint64_t line = 0; line < props.nslices; line++) {
+    for (uint64_t col = 0; col < props.nslices; col++) {
+      image_bytes += manifest.get(line, col).bytes;
+    }
+  }
+
+  graphee::DiskVector<graphee::Vector<double>> ones(&props, "pr", 1.);
+  graphee::DiskVector<graphee::Vector<double>> uncached(&props, "ob", 0.);
+  adjacency_matrix.set_block_cache(0);
+  uncached.dmat_prod_dvec(1., adjacency_matrix, ones);
+
+  /* Room for the images only, then for the decoded blocks */
+  for (uint64_t limit : {image_bytes, 5 * graphee::Properties::MB}) {
+    adjacency_matrix.set_block_cache(limit);
+    graphee::DiskVector<graphee::Vector<double>> cached(&props, "prp1", 0.);
+    cached.dmat_prod_dvec(1., adjacency_matrix, ones);
+    cached.dmat_prod_dvec(1., adjacency_matrix, ones);
+
+    std::string report = adjacency_matrix.get_block_cache().report();
+    BOOST_CHECK(report.find(" 0 misses") != std::string::npos);
+    BOOST_CHECK_EQUAL(report.find("Block cache: 0 decoded") != std::string::npos,
+                      limit == image_bytes);
+
+    for (uint64_t slice = 0; slice < props.nslices; slice++) {
+      graphee::Vector<double> lslice(&props), rslice(&props);
+      uncached.read_slice(slice, lslice);
+      cached.read_slice(slice, rslice);
+      for (uint64_t i = 0; i < props.window; i++) {
+        BOOST_CHECK_EQUAL(2 * lslice[i], rslice[i]);
+      }
+    }
+  }
+
+  clean_pagerank_files(props);
 }